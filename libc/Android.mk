@@ -16,7 +16,6 @@ libc_common_src_files := \
 	unistd/fnmatch.c \
 	unistd/syslog.c \
 	unistd/system.c \
-	unistd/time.c \
 	stdio/asprintf.c \
 	stdio/fflush.c \
 	stdio/fgetc.c \
@@ -229,6 +228,7 @@ libc_bionic_src_files := \
     bionic/libc_logging.cpp \
     bionic/libgen.cpp \
     bionic/pthread_attr.cpp \
+    bionic/pthread_barrier.cpp \
     bionic/pthread_detach.cpp \
     bionic/pthread_equal.cpp \
     bionic/pthread_getcpuclockid.cpp \
@@ -240,6 +240,7 @@ libc_bionic_src_files := \
     bionic/pthread_setname_np.cpp \
     bionic/pthread_setschedparam.cpp \
     bionic/pthread_sigmask.cpp \
+    bionic/pthread_spinlock.cpp \
     bionic/raise.cpp \
     bionic/sbrk.cpp \
     bionic/scandir.cpp \
@@ -259,6 +260,7 @@ libc_bionic_src_files := \
     bionic/tdestroy.cpp \
     bionic/__thread_entry.cpp \
     bionic/tmpfile.cpp \
+    bionic/vdso.cpp \
     bionic/wait.cpp \
     bionic/wchar.cpp \
 
@@ -406,8 +408,8 @@ libc_common_src_files += \
 # If the kernel supports kernel user helpers for gettimeofday, use
 # that instead.
 ifeq ($(KERNEL_HAS_GETTIMEOFDAY_HELPER),true)
-  libc_common_src_files := $(filter-out arch-arm/syscalls/gettimeofday.S,$(libc_common_src_files))
-  libc_common_src_files := $(filter-out arch-arm/syscalls/clock_gettime.S,$(libc_common_src_files))
+  libc_common_src_files := $(filter-out arch-arm/syscalls/__gettimeofday.S,$(libc_common_src_files))
+  libc_common_src_files := $(filter-out arch-arm/syscalls/__clock_gettime.S,$(libc_common_src_files))
   libc_common_src_files += \
 	arch-arm/bionic/gettimeofday.c \
 	arch-arm/bionic/gettimeofday_syscall.S \
@@ -448,36 +450,19 @@ endif # x86
 
 ifeq ($(TARGET_ARCH),$(filter $(TARGET_ARCH),x86_64))
 libc_common_src_files += \
-    bionic/memchr.c \
-    bionic/memcmp.c \
-    bionic/memcpy.c \
-    bionic/memmove.c \
-    bionic/memrchr.c \
-    bionic/memset.c \
     bionic/pthread-atfork.c \
     bionic/pthread-rwlocks.c \
     bionic/pthread-timers.c \
     bionic/ptrace.c \
-    bionic/strchr.cpp \
-    bionic/strnlen.c \
     string/bcopy.c \
     string/index.c \
     string/strcat.c \
-    string/strcmp.c \
-    string/strcpy.c \
     string/strlcat.c \
     string/strlcpy.c \
-    string/strlen.c \
     string/strncat.c \
-    string/strncmp.c \
     string/strncpy.c \
-    string/strrchr.c \
     upstream-freebsd/lib/libc/string/wcscat.c \
-    upstream-freebsd/lib/libc/string/wcschr.c \
-    upstream-freebsd/lib/libc/string/wcscmp.c \
     upstream-freebsd/lib/libc/string/wcscpy.c \
-    upstream-freebsd/lib/libc/string/wcslen.c \
-    upstream-freebsd/lib/libc/string/wcsrchr.c \
     upstream-freebsd/lib/libc/string/wmemcmp.c \
 
 libc_static_common_src_files += \
@@ -14,6 +14,7 @@ syscall_src += arch-arm/syscalls/getegid.S
 syscall_src += arch-arm/syscalls/getresuid.S
 syscall_src += arch-arm/syscalls/getresgid.S
 syscall_src += arch-arm/syscalls/gettid.S
+syscall_src += arch-arm/syscalls/__set_tid_address.S
 syscall_src += arch-arm/syscalls/readahead.S
 syscall_src += arch-arm/syscalls/getgroups.S
 syscall_src += arch-arm/syscalls/getpgid.S
@@ -131,11 +132,11 @@ syscall_src += arch-arm/syscalls/unshare.S
 syscall_src += arch-arm/syscalls/swapon.S
 syscall_src += arch-arm/syscalls/swapoff.S
 syscall_src += arch-arm/syscalls/pause.S
-syscall_src += arch-arm/syscalls/gettimeofday.S
+syscall_src += arch-arm/syscalls/__gettimeofday.S
 syscall_src += arch-arm/syscalls/settimeofday.S
 syscall_src += arch-arm/syscalls/times.S
 syscall_src += arch-arm/syscalls/nanosleep.S
-syscall_src += arch-arm/syscalls/clock_gettime.S
+syscall_src += arch-arm/syscalls/__clock_gettime.S
 syscall_src += arch-arm/syscalls/clock_settime.S
 syscall_src += arch-arm/syscalls/clock_getres.S
 syscall_src += arch-arm/syscalls/clock_nanosleep.S
@@ -15,6 +15,7 @@ syscall_src += arch-mips/syscalls/getegid.S
 syscall_src += arch-mips/syscalls/getresuid.S
 syscall_src += arch-mips/syscalls/getresgid.S
 syscall_src += arch-mips/syscalls/gettid.S
+syscall_src += arch-mips/syscalls/__set_tid_address.S
 syscall_src += arch-mips/syscalls/readahead.S
 syscall_src += arch-mips/syscalls/getgroups.S
 syscall_src += arch-mips/syscalls/getpgid.S
@@ -134,11 +135,11 @@ syscall_src += arch-mips/syscalls/unshare.S
 syscall_src += arch-mips/syscalls/swapon.S
 syscall_src += arch-mips/syscalls/swapoff.S
 syscall_src += arch-mips/syscalls/pause.S
-syscall_src += arch-mips/syscalls/gettimeofday.S
+syscall_src += arch-mips/syscalls/__gettimeofday.S
 syscall_src += arch-mips/syscalls/settimeofday.S
 syscall_src += arch-mips/syscalls/times.S
 syscall_src += arch-mips/syscalls/nanosleep.S
-syscall_src += arch-mips/syscalls/clock_gettime.S
+syscall_src += arch-mips/syscalls/__clock_gettime.S
 syscall_src += arch-mips/syscalls/clock_settime.S
 syscall_src += arch-mips/syscalls/clock_getres.S
 syscall_src += arch-mips/syscalls/clock_nanosleep.S
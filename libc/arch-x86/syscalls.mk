@@ -15,6 +15,7 @@ syscall_src += arch-x86/syscalls/getegid.S
 syscall_src += arch-x86/syscalls/getresuid.S
 syscall_src += arch-x86/syscalls/getresgid.S
 syscall_src += arch-x86/syscalls/gettid.S
+syscall_src += arch-x86/syscalls/__set_tid_address.S
 syscall_src += arch-x86/syscalls/readahead.S
 syscall_src += arch-x86/syscalls/getgroups.S
 syscall_src += arch-x86/syscalls/getpgid.S
@@ -135,11 +136,11 @@ syscall_src += arch-x86/syscalls/unshare.S
 syscall_src += arch-x86/syscalls/swapon.S
 syscall_src += arch-x86/syscalls/swapoff.S
 syscall_src += arch-x86/syscalls/pause.S
-syscall_src += arch-x86/syscalls/gettimeofday.S
+syscall_src += arch-x86/syscalls/__gettimeofday.S
 syscall_src += arch-x86/syscalls/settimeofday.S
 syscall_src += arch-x86/syscalls/times.S
 syscall_src += arch-x86/syscalls/nanosleep.S
-syscall_src += arch-x86/syscalls/clock_gettime.S
+syscall_src += arch-x86/syscalls/__clock_gettime.S
 syscall_src += arch-x86/syscalls/clock_settime.S
 syscall_src += arch-x86/syscalls/clock_getres.S
 syscall_src += arch-x86/syscalls/clock_nanosleep.S
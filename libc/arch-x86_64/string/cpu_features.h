@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _X86_64_STRING_CPU_FEATURES_H
+#define _X86_64_STRING_CPU_FEATURES_H
+
+/*
+ * CPU feature bits for choosing between the SSE2 and AVX2 string routines.
+ * Only for use from assembler.
+ */
+
+/* Bits in __bionic_x86_64_cpu_features. */
+#define CPU_FEATURES_PROBED 0x1
+#define CPU_FEATURE_AVX2    0x2
+
+#define PROBE_CPU_FEATURES \
+    testl   $CPU_FEATURES_PROBED, __bionic_x86_64_cpu_features(%rip); \
+    jnz     98f; \
+    call    __bionic_x86_64_probe_cpu_features; \
+98:
+
+/*
+ * Jumps to 'avx2_entry' if both the CPU and the kernel support AVX2, probing
+ * them the first time through. Otherwise falls through to the SSE2 code.
+ * Only the flags are clobbered. Everything here is hidden and %rip-relative,
+ * so it works in the dynamic linker before it has relocated itself.
+ */
+#define DISPATCH_AVX2(avx2_entry) \
+    PROBE_CPU_FEATURES \
+    testl   $CPU_FEATURE_AVX2, __bionic_x86_64_cpu_features(%rip); \
+    jnz     avx2_entry
+
+/*
+ * Defines 'name' as an STT_GNU_IFUNC symbol whose resolver returns
+ * 'avx2_entry' or 'sse2_entry'. The dynamic linker calls the resolver while
+ * it relocates libc.so, before libc has initialized itself, so the resolver
+ * probes the CPU if that hasn't happened yet.
+ */
+#define IFUNC_AVX2(name, sse2_entry, avx2_entry) \
+    .text; \
+    .align  16; \
+    .globl  name; \
+    .type   name, @gnu_indirect_function; \
+name: \
+    PROBE_CPU_FEATURES \
+    leaq    sse2_entry(%rip), %rax; \
+    testl   $CPU_FEATURE_AVX2, __bionic_x86_64_cpu_features(%rip); \
+    jz      99f; \
+    leaq    avx2_entry(%rip), %rax; \
+99: ret; \
+    .size   name, . - name
+
+#endif /* _X86_64_STRING_CPU_FEATURES_H */
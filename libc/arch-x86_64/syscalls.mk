@@ -14,6 +14,7 @@ syscall_src += arch-x86_64/syscalls/getegid.S
 syscall_src += arch-x86_64/syscalls/getresuid.S
 syscall_src += arch-x86_64/syscalls/getresgid.S
 syscall_src += arch-x86_64/syscalls/gettid.S
+syscall_src += arch-x86_64/syscalls/__set_tid_address.S
 syscall_src += arch-x86_64/syscalls/readahead.S
 syscall_src += arch-x86_64/syscalls/getgroups.S
 syscall_src += arch-x86_64/syscalls/getpgid.S
@@ -129,11 +130,11 @@ syscall_src += arch-x86_64/syscalls/unshare.S
 syscall_src += arch-x86_64/syscalls/swapon.S
 syscall_src += arch-x86_64/syscalls/swapoff.S
 syscall_src += arch-x86_64/syscalls/pause.S
-syscall_src += arch-x86_64/syscalls/gettimeofday.S
+syscall_src += arch-x86_64/syscalls/__gettimeofday.S
 syscall_src += arch-x86_64/syscalls/settimeofday.S
 syscall_src += arch-x86_64/syscalls/times.S
 syscall_src += arch-x86_64/syscalls/nanosleep.S
-syscall_src += arch-x86_64/syscalls/clock_gettime.S
+syscall_src += arch-x86_64/syscalls/__clock_gettime.S
 syscall_src += arch-x86_64/syscalls/clock_settime.S
 syscall_src += arch-x86_64/syscalls/clock_getres.S
 syscall_src += arch-x86_64/syscalls/clock_nanosleep.S
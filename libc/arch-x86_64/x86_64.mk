@@ -12,8 +12,29 @@ _LIBC_ARCH_COMMON_SRC_FILES := \
     arch-x86_64/bionic/sigsetjmp.S \
     arch-x86_64/bionic/sigsuspend.c \
     arch-x86_64/bionic/syscall.S \
+    arch-x86_64/string/avx2-memchr.S \
+    arch-x86_64/string/avx2-memset.S \
+    arch-x86_64/string/avx2-strlen.S \
+    arch-x86_64/string/cpu_features.S \
+    arch-x86_64/string/sse2-memchr.S \
+    arch-x86_64/string/sse2-memcmp.S \
+    arch-x86_64/string/sse2-memmove.S \
+    arch-x86_64/string/sse2-memrchr.S \
+    arch-x86_64/string/sse2-memset.S \
+    arch-x86_64/string/sse2-strchr.S \
+    arch-x86_64/string/sse2-strcmp.S \
+    arch-x86_64/string/sse2-strcpy.S \
+    arch-x86_64/string/sse2-strlen.S \
+    arch-x86_64/string/sse2-strncmp.S \
+    arch-x86_64/string/sse2-strrchr.S \
+    arch-x86_64/string/sse2-wcschr.S \
+    arch-x86_64/string/sse2-wcscmp.S \
+    arch-x86_64/string/sse2-wcslen.S \
+    arch-x86_64/string/sse2-wcsrchr.S \
 
 _LIBC_ARCH_STATIC_SRC_FILES := \
+    arch-x86_64/string/dispatch-static.S \
     bionic/dl_iterate_phdr_static.c \
 
-_LIBC_ARCH_DYNAMIC_SRC_FILES :=
+_LIBC_ARCH_DYNAMIC_SRC_FILES := \
+    arch-x86_64/string/dispatch-ifunc.S \
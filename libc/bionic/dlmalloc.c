@@ -17,6 +17,7 @@
 #include "dlmalloc.h"
 
 #include "private/libc_logging.h"
+#include "pthread_internal.h"
 
 // Send dlmalloc errors to the log.
 static void __bionic_heap_corruption_error(const char* function);
@@ -42,3 +43,180 @@ static void __bionic_heap_usage_error(const char* function, void* address) {
   // TODO: improve the debuggerd protocol so we can tell it to dump an address when we abort.
   *((int**) 0xdeadbaad) = (int*) address;
 }
+
+/*
+ * Per-thread cache of small chunks.
+ *
+ * dlmalloc takes one global lock for every call, so small allocations from many threads
+ * contend for it. Instead, each thread keeps lists of the small chunks it has freed, one
+ * per chunk size, and serves malloc from them without locking. The lists are refilled
+ * with independent_comalloc and drained with bulk_free, a batch at a time, so the lock is
+ * taken once per batch rather than once per call.
+ *
+ * Cached chunks are ordinary in-use dlmalloc chunks, so realloc, malloc_usable_size and the
+ * debug malloc implementations work with anything the cache hands out. mallinfo(3) counts
+ * them as in use.
+ */
+
+#define THREAD_CACHE_MAX_REQUEST 256
+#define THREAD_CACHE_MAX_CHUNK request2size(THREAD_CACHE_MAX_REQUEST)
+#define THREAD_CACHE_BIN_COUNT (THREAD_CACHE_MAX_CHUNK / MALLOC_ALIGNMENT + 1)
+
+/* Each list holds up to about this many bytes, but at least 8 and at most 64 chunks. */
+#define THREAD_CACHE_BIN_BYTES 4096
+#define THREAD_CACHE_BIN_MIN 8
+#define THREAD_CACHE_BIN_MAX 64
+
+/* What pthread_exit leaves in pthread_internal_t::malloc_thread_cache. */
+#define THREAD_CACHE_DESTROYED ((struct thread_cache*) -1)
+
+struct thread_cache_bin {
+  /* Linked through the first word of each chunk; the second word points to the cache. */
+  void* head;
+  size_t count;
+};
+
+struct thread_cache {
+  struct thread_cache_bin bins[THREAD_CACHE_BIN_COUNT];
+};
+
+static struct thread_cache* thread_cache_get(void) {
+  pthread_internal_t* thread = __get_thread();
+  if (thread == NULL) {
+    return NULL;
+  }
+  struct thread_cache* cache = (struct thread_cache*) thread->malloc_thread_cache;
+  if (cache == NULL) {
+    cache = (struct thread_cache*) dlcalloc(1, sizeof(struct thread_cache));
+    thread->malloc_thread_cache = cache;
+  }
+  return (cache == THREAD_CACHE_DESTROYED) ? NULL : cache;
+}
+
+static size_t thread_cache_bin_limit(size_t chunk_size) {
+  size_t limit = THREAD_CACHE_BIN_BYTES / chunk_size;
+  if (limit < THREAD_CACHE_BIN_MIN) {
+    return THREAD_CACHE_BIN_MIN;
+  }
+  return (limit > THREAD_CACHE_BIN_MAX) ? THREAD_CACHE_BIN_MAX : limit;
+}
+
+static void thread_cache_push(struct thread_cache* cache, struct thread_cache_bin* bin, void* mem) {
+  ((void**) mem)[0] = bin->head;
+  ((void**) mem)[1] = cache;
+  bin->head = mem;
+  ++bin->count;
+}
+
+static void thread_cache_refill(struct thread_cache* cache, struct thread_cache_bin* bin,
+                                size_t chunk_size) {
+  size_t sizes[THREAD_CACHE_BIN_MAX / 2];
+  void* chunks[THREAD_CACHE_BIN_MAX / 2];
+  size_t n = thread_cache_bin_limit(chunk_size) / 2;
+  size_t i;
+  for (i = 0; i < n; ++i) {
+    sizes[i] = chunk_size - CHUNK_OVERHEAD;
+  }
+  if (dlindependent_comalloc(n, sizes, chunks) == NULL) {
+    return;
+  }
+  /* Push in reverse so that we hand the chunks out in address order. */
+  while (i > 0) {
+    thread_cache_push(cache, bin, chunks[--i]);
+  }
+}
+
+static void thread_cache_drain(struct thread_cache_bin* bin, size_t keep) {
+  void* chunks[THREAD_CACHE_BIN_MAX + 1];
+  size_t n = 0;
+  while (bin->count > keep) {
+    chunks[n] = bin->head;
+    bin->head = ((void**) chunks[n])[0];
+    --bin->count;
+    ++n;
+  }
+  if (n > 0) {
+    dlbulk_free(chunks, n);
+  }
+}
+
+void* __bionic_thread_cache_malloc(size_t bytes) {
+  if (bytes <= THREAD_CACHE_MAX_REQUEST) {
+    struct thread_cache* cache = thread_cache_get();
+    if (cache != NULL) {
+      size_t chunk_size = request2size(bytes);
+      struct thread_cache_bin* bin = &cache->bins[chunk_size / MALLOC_ALIGNMENT];
+      if (bin->head == NULL) {
+        thread_cache_refill(cache, bin, chunk_size);
+      }
+      void* mem = bin->head;
+      if (mem != NULL) {
+        bin->head = ((void**) mem)[0];
+        ((void**) mem)[1] = NULL;
+        --bin->count;
+        return mem;
+      }
+    }
+  }
+  return dlmalloc(bytes);
+}
+
+void __bionic_thread_cache_free(void* mem) {
+  if (mem == NULL) {
+    return;
+  }
+  mchunkptr p = mem2chunk(mem);
+  size_t chunk_size = chunksize(p);
+  /* Let dlfree report bad pointers, and take back mmapped chunks. */
+  if (chunk_size <= THREAD_CACHE_MAX_CHUNK && ok_address(gm, p) && ok_inuse(p) &&
+      !is_mmapped(p)) {
+    struct thread_cache* cache = thread_cache_get();
+    if (cache != NULL) {
+      struct thread_cache_bin* bin = &cache->bins[chunk_size / MALLOC_ALIGNMENT];
+      if (((void**) mem)[1] == cache) {
+        /* Probably a double free; make sure before we report it. */
+        void* cached;
+        for (cached = bin->head; cached != NULL; cached = ((void**) cached)[0]) {
+          if (cached == mem) {
+            USAGE_ERROR_ACTION(gm, mem);
+            return;
+          }
+        }
+      }
+      thread_cache_push(cache, bin, mem);
+      if (bin->count > thread_cache_bin_limit(chunk_size)) {
+        thread_cache_drain(bin, bin->count / 2);
+      }
+      return;
+    }
+  }
+  dlfree(mem);
+}
+
+void* __bionic_thread_cache_calloc(size_t n_elements, size_t elem_size) {
+  size_t bytes = n_elements * elem_size;
+  if (bytes <= THREAD_CACHE_MAX_REQUEST &&
+      (n_elements == 0 || bytes / n_elements == elem_size)) {
+    void* mem = __bionic_thread_cache_malloc(bytes);
+    if (mem != NULL) {
+      memset(mem, 0, bytes);
+    }
+    return mem;
+  }
+  return dlcalloc(n_elements, elem_size);
+}
+
+void __bionic_thread_cache_destroy(void) {
+  pthread_internal_t* thread = __get_thread();
+  struct thread_cache* cache = (struct thread_cache*) thread->malloc_thread_cache;
+  /* Anything this thread frees from now on goes straight back to dlmalloc. */
+  thread->malloc_thread_cache = THREAD_CACHE_DESTROYED;
+  if (cache == NULL || cache == THREAD_CACHE_DESTROYED) {
+    return;
+  }
+  size_t i;
+  for (i = 0; i < THREAD_CACHE_BIN_COUNT; ++i) {
+    thread_cache_drain(&cache->bins[i], 0);
+  }
+  dlfree(cache);
+}
@@ -17,6 +17,8 @@
 #ifndef LIBC_BIONIC_DLMALLOC_H_
 #define LIBC_BIONIC_DLMALLOC_H_
 
+#include <sys/cdefs.h>
+
 /* Configure dlmalloc. */
 #define HAVE_GETPAGESIZE 1
 #define MALLOC_INSPECT_ALL 1
@@ -32,4 +34,12 @@
 /* Include the proper definitions. */
 #include "../upstream-dlmalloc/malloc.h"
 
+/* The per-thread cache in front of dlmalloc for small allocations (see dlmalloc.c). */
+__BEGIN_DECLS
+void* __bionic_thread_cache_malloc(size_t bytes);
+void __bionic_thread_cache_free(void* mem);
+void* __bionic_thread_cache_calloc(size_t n_elements, size_t elem_size);
+void __bionic_thread_cache_destroy(void);
+__END_DECLS
+
 #endif  // LIBC_BIONIC_DLMALLOC_H_
@@ -48,6 +48,8 @@ int fork() {
   } else {
     // Fix the tid in the pthread_internal_t struct after a fork.
     __pthread_settid(pthread_self(), gettid());
+    __thread_stack_cache_after_fork();
+    __timer_table_after_fork();
     __bionic_atfork_run_child();
   }
   return result;
@@ -49,6 +49,9 @@
 extern "C" abort_msg_t** __abort_message_ptr;
 extern "C" unsigned __get_sp(void);
 extern "C" int __system_properties_init(void);
+#if defined(__x86_64__)
+extern "C" __LIBC_HIDDEN__ void __bionic_x86_64_probe_cpu_features(void);
+#endif
 
 // Not public, but well-known in the BSDs.
 const char* __progname;
@@ -110,6 +113,15 @@ void __libc_init_common(KernelArgumentBlock& args) {
   // AT_RANDOM is a pointer to 16 bytes of randomness on the stack.
   __stack_chk_guard = *reinterpret_cast<uintptr_t*>(getauxval(AT_RANDOM));
 
+  // Use the vDSO's clock_gettime(2) and friends if it has them. Requires '__libc_auxv'.
+  __libc_init_vdso();
+
+#if defined(__x86_64__)
+  // Find out which string routines suit this CPU. In libc.so the ifunc resolvers
+  // will already have done this, but static executables otherwise do it on first use.
+  __bionic_x86_64_probe_cpu_features();
+#endif
+
   // Get the main thread from TLS and add it to the thread list.
   pthread_internal_t* main_thread = __get_thread();
   main_thread->allocated_on_heap = false;
@@ -51,6 +51,7 @@ __END_DECLS
 #if defined(__cplusplus)
 class KernelArgumentBlock;
 void __LIBC_HIDDEN__ __libc_init_common(KernelArgumentBlock& args);
+void __LIBC_HIDDEN__ __libc_init_vdso();
 #endif
 
 #endif
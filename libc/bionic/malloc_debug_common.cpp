@@ -213,7 +213,8 @@ extern "C" int posix_memalign(void** memptr, size_t alignment, size_t size) {
 extern const MallocDebug __libc_malloc_default_dispatch;
 const MallocDebug __libc_malloc_default_dispatch __attribute__((aligned(32))) =
 {
-    dlmalloc, dlfree, dlcalloc, dlrealloc, dlmemalign, dlmalloc_usable_size,
+    __bionic_thread_cache_malloc, __bionic_thread_cache_free, __bionic_thread_cache_calloc,
+    dlrealloc, dlmemalign, dlmalloc_usable_size,
 };
 
 /* Selector of dispatch table to use for dispatching malloc calls. */
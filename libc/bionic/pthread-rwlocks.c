@@ -28,6 +28,10 @@
 
 #include "pthread_internal.h"
 #include <errno.h>
+#include <limits.h>
+
+#include "private/bionic_atomic_inline.h"
+#include "private/bionic_futex.h"
 
 /* Technical note:
  *
@@ -44,18 +48,42 @@
  *
  *  - Posix states that behavior is undefined it a thread tries to acquire
  *    the lock in two distinct modes (e.g. write after read, or read after write).
+ *    We let the writer take read locks, which are counted as extra write locks.
+ *
+ * All of this is kept in the single 'state' word, which is also the futex
+ * waiters sleep on:
+ *
+ *  - bits 0-27: the number of readers, or the write lock recursion count
+ *  - bit 28: the lock is held by a writer (writerThreadId)
+ *  - bit 29: some readers are sleeping
+ *  - bit 30: some writers are waiting, so new readers must block
  *
- *  - This implementation tries to avoid writer starvation by making the readers
- *    block as soon as there is a waiting writer on the lock. However, it cannot
- *    completely eliminate it: each time the lock is unlocked, all waiting threads
- *    are woken and battle for it, which one gets it depends on the kernel scheduler
- *    and is semi-random.
+ * Taking or releasing an uncontended lock is a single compare-and-swap on
+ * 'state', and readers never touch anything else, so they don't serialize.
  *
+ * To avoid writer starvation, readers block as soon as a writer is waiting.
+ * When the lock becomes free, a single waiting writer is woken if there is
+ * one (pendingWriters counts them); only when no writers remain are all the
+ * sleeping readers woken. Readers and writers sleep on the same word using
+ * different FUTEX_WAIT_BITSET masks so that each kind can be woken alone,
+ * which also lets us pass the callers' absolute CLOCK_REALTIME deadlines
+ * straight to the kernel.
  */
 
 #define  RWLOCKATTR_DEFAULT     0
 #define  RWLOCKATTR_SHARED_MASK 0x0010
 
+#define  RWLOCK_COUNT_MASK        0x0fffffff
+#define  RWLOCK_WRITE_LOCKED      0x10000000
+#define  RWLOCK_READERS_WAITING   0x20000000
+#define  RWLOCK_WRITERS_WAITING   0x40000000
+
+#define  RWLOCK_HELD_MASK         (RWLOCK_WRITE_LOCKED | RWLOCK_COUNT_MASK)
+
+/* FUTEX_WAIT_BITSET masks */
+#define  RWLOCK_READER_WAITER     1
+#define  RWLOCK_WRITER_WAITER     2
+
 extern pthread_internal_t* __get_thread(void);
 
 int pthread_rwlockattr_init(pthread_rwlockattr_t *attr)
@@ -102,39 +130,14 @@ int pthread_rwlockattr_getpshared(pthread_rwlockattr_t *attr, int *pshared)
 
 int pthread_rwlock_init(pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr)
 {
-    pthread_mutexattr_t*  lock_attr = NULL;
-    pthread_condattr_t*   cond_attr = NULL;
-    pthread_mutexattr_t   lock_attr0;
-    pthread_condattr_t    cond_attr0;
-    int                   ret;
-
     if (rwlock == NULL)
         return EINVAL;
 
-    if (attr && *attr == PTHREAD_PROCESS_SHARED) {
-        lock_attr = &lock_attr0;
-        pthread_mutexattr_init(lock_attr);
-        pthread_mutexattr_setpshared(lock_attr, PTHREAD_PROCESS_SHARED);
-
-        cond_attr = &cond_attr0;
-        pthread_condattr_init(cond_attr);
-        pthread_condattr_setpshared(cond_attr, PTHREAD_PROCESS_SHARED);
-    }
-
-    ret = pthread_mutex_init(&rwlock->lock, lock_attr);
-    if (ret != 0)
-        return ret;
-
-    ret = pthread_cond_init(&rwlock->cond, cond_attr);
-    if (ret != 0) {
-        pthread_mutex_destroy(&rwlock->lock);
-        return ret;
-    }
-
-    rwlock->numLocks = 0;
-    rwlock->pendingReaders = 0;
-    rwlock->pendingWriters = 0;
+    rwlock->state = 0;
+    rwlock->attr = (attr && *attr == PTHREAD_PROCESS_SHARED) ? PTHREAD_PROCESS_SHARED
+                                                             : PTHREAD_PROCESS_PRIVATE;
     rwlock->writerThreadId = 0;
+    rwlock->pendingWriters = 0;
 
     return 0;
 }
@@ -144,57 +147,123 @@ int pthread_rwlock_destroy(pthread_rwlock_t *rwlock)
     if (rwlock == NULL)
         return EINVAL;
 
-    if (rwlock->numLocks > 0)
+    if ((rwlock->state & RWLOCK_HELD_MASK) != 0)
         return EBUSY;
 
-    pthread_cond_destroy(&rwlock->cond);
-    pthread_mutex_destroy(&rwlock->lock);
     return 0;
 }
 
-/* Returns TRUE iff we can acquire a read lock. */
-static __inline__ int read_precondition(pthread_rwlock_t* rwlock, int tid)
+/* Sleeps on 'state' as long as it is equal to 'state', or until the absolute
+ * CLOCK_REALTIME deadline 'abs_timeout' passes. Returns 0 or an errno value.
+ */
+static int _pthread_rwlock_wait(pthread_rwlock_t* rwlock, int state, int waiter,
+                                const struct timespec* abs_timeout)
 {
-    /* We can't have the lock if any writer is waiting for it (writer bias).
-     * This tries to avoid starvation when there are multiple readers racing.
-     */
-    if (rwlock->pendingWriters > 0)
-        return 0;
+    int op = FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME;
+    if (rwlock->attr != PTHREAD_PROCESS_SHARED)
+        op |= FUTEX_PRIVATE_FLAG;
+
+    int saved_errno = errno;
+    int ret = futex(&rwlock->state, op, state, (void*) abs_timeout, NULL, waiter);
+    int err = errno;
+    errno = saved_errno;
+    return (ret == -1) ? err : 0;
+}
 
-    /* We can have the lock if there is no writer, or if we write-own it */
-    /* The second test avoids a self-dead lock in case of buggy code. */
-    if (rwlock->writerThreadId == 0 || rwlock->writerThreadId == tid)
-        return 1;
+static void _pthread_rwlock_wake(pthread_rwlock_t* rwlock, int count, int waiter)
+{
+    int op = FUTEX_WAKE_BITSET;
+    if (rwlock->attr != PTHREAD_PROCESS_SHARED)
+        op |= FUTEX_PRIVATE_FLAG;
 
-    /* Otherwise, we can't have it */
-    return 0;
+    int saved_errno = errno;
+    futex(&rwlock->state, op, count, NULL, NULL, waiter);
+    errno = saved_errno;
 }
 
-/* returns TRUE iff we can acquire a write lock. */
-static __inline__ int write_precondition(pthread_rwlock_t* rwlock, int tid)
+/* This function is called when the lock may have become available to some
+ * waiters: after it has been released, or after a writer gave up waiting.
+ * A waiting writer is preferred; otherwise, all the sleeping readers are
+ * woken up.
+ */
+static void _pthread_rwlock_pulse(pthread_rwlock_t *rwlock)
 {
-    /* We can get the lock if nobody has it */
-    if (rwlock->numLocks == 0)
-        return 1;
+    /* Pairs with the barrier in the waiters between announcing themselves
+     * and reading 'state': either they see our update, or we see them.
+     */
+    ANDROID_MEMBAR_FULL();
 
-    /* Or if we already own it */
-    if (rwlock->writerThreadId == tid)
-        return 1;
+    if (rwlock->pendingWriters > 0) {
+        if ((rwlock->state & RWLOCK_HELD_MASK) == 0)
+            _pthread_rwlock_wake(rwlock, 1, RWLOCK_WRITER_WAITER);
+        return;
+    }
 
-    /* Otherwise, not */
-    return 0;
+    for (;;) {
+        int state = rwlock->state;
+        if ((state & (RWLOCK_READERS_WAITING | RWLOCK_WRITERS_WAITING)) == 0)
+            return;
+        if (__bionic_cmpxchg(state, state & ~(RWLOCK_READERS_WAITING | RWLOCK_WRITERS_WAITING),
+                             &rwlock->state) == 0) {
+            if (state & RWLOCK_READERS_WAITING)
+                _pthread_rwlock_wake(rwlock, INT_MAX, RWLOCK_READER_WAITER);
+            return;
+        }
+    }
 }
 
-/* This function is used to waken any waiting thread contending
- * for the lock. One of them should be able to grab it after
- * that.
- */
-static void _pthread_rwlock_pulse(pthread_rwlock_t *rwlock)
+/* Tries to get a read lock without blocking. Returns 0, EBUSY or EAGAIN. */
+static __inline__ int _pthread_rwlock_tryrdlock(pthread_rwlock_t* rwlock)
 {
-    if (rwlock->pendingReaders > 0 || rwlock->pendingWriters > 0)
-        pthread_cond_broadcast(&rwlock->cond);
+    for (;;) {
+        int state = rwlock->state;
+
+        if (__predict_false(state & RWLOCK_WRITE_LOCKED)) {
+            /* We can have the lock if we write-own it. This avoids a
+             * self-dead lock in case of buggy code.
+             */
+            if (rwlock->writerThreadId != __get_thread()->tid)
+                return EBUSY;
+        } else if (__predict_false(state & RWLOCK_WRITERS_WAITING)) {
+            /* We can't have the lock if any writer is waiting for it (writer bias). */
+            return EBUSY;
+        }
+
+        if (__predict_false((state & RWLOCK_COUNT_MASK) == RWLOCK_COUNT_MASK))
+            return EAGAIN;
+
+        if (__bionic_cmpxchg(state, state + 1, &rwlock->state) == 0) {
+            ANDROID_MEMBAR_FULL();
+            return 0;
+        }
+    }
 }
 
+/* Tries to get the write lock without blocking. Returns 0, EBUSY or EAGAIN. */
+static __inline__ int _pthread_rwlock_trywrlock(pthread_rwlock_t* rwlock, int tid)
+{
+    for (;;) {
+        int state = rwlock->state;
+        int new_state;
+
+        if ((state & RWLOCK_HELD_MASK) == 0) {
+            new_state = state | RWLOCK_WRITE_LOCKED | 1;
+        } else if ((state & RWLOCK_WRITE_LOCKED) && rwlock->writerThreadId == tid) {
+            /* We already own it */
+            if ((state & RWLOCK_COUNT_MASK) == RWLOCK_COUNT_MASK)
+                return EAGAIN;
+            new_state = state + 1;
+        } else {
+            return EBUSY;
+        }
+
+        if (__bionic_cmpxchg(state, new_state, &rwlock->state) == 0) {
+            ANDROID_MEMBAR_FULL();
+            rwlock->writerThreadId = tid;
+            return 0;
+        }
+    }
+}
 
 int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
 {
@@ -203,43 +272,38 @@ int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
 
 int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock)
 {
-    int ret = 0;
-
     if (rwlock == NULL)
         return EINVAL;
 
-    pthread_mutex_lock(&rwlock->lock);
-    if (__predict_false(!read_precondition(rwlock, __get_thread()->tid)))
-        ret = EBUSY;
-    else
-        rwlock->numLocks ++;
-    pthread_mutex_unlock(&rwlock->lock);
-
-    return ret;
+    return _pthread_rwlock_tryrdlock(rwlock);
 }
 
 int pthread_rwlock_timedrdlock(pthread_rwlock_t *rwlock, const struct timespec *abs_timeout)
 {
-    int ret = 0;
-
     if (rwlock == NULL)
         return EINVAL;
 
-    pthread_mutex_lock(&rwlock->lock);
-    int tid = __get_thread()->tid;
-    if (__predict_false(!read_precondition(rwlock, tid))) {
-        rwlock->pendingReaders += 1;
-        do {
-            ret = pthread_cond_timedwait(&rwlock->cond, &rwlock->lock, abs_timeout);
-        } while (ret == 0 && !read_precondition(rwlock, tid));
-        rwlock->pendingReaders -= 1;
-        if (ret != 0)
-            goto EXIT;
+    for (;;) {
+        int ret = _pthread_rwlock_tryrdlock(rwlock);
+        if (__predict_true(ret != EBUSY))
+            return ret;
+
+        /* Tell the unlocker to wake us up, then sleep unless the
+         * lock changed in the meantime.
+         */
+        int state = rwlock->state;
+        if ((state & (RWLOCK_WRITE_LOCKED | RWLOCK_WRITERS_WAITING)) == 0)
+            continue;
+        if ((state & RWLOCK_READERS_WAITING) == 0) {
+            if (__bionic_cmpxchg(state, state | RWLOCK_READERS_WAITING, &rwlock->state) != 0)
+                continue;
+            state |= RWLOCK_READERS_WAITING;
+        }
+
+        ret = _pthread_rwlock_wait(rwlock, state, RWLOCK_READER_WAITER, abs_timeout);
+        if (ret == ETIMEDOUT || ret == EINVAL)
+            return ret;
     }
-    rwlock->numLocks ++;
-EXIT:
-    pthread_mutex_unlock(&rwlock->lock);
-    return ret;
 }
 
 
@@ -250,87 +314,107 @@ int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
 
 int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock)
 {
-    int ret = 0;
-
     if (rwlock == NULL)
         return EINVAL;
 
-    pthread_mutex_lock(&rwlock->lock);
-    int tid = __get_thread()->tid;
-    if (__predict_false(!write_precondition(rwlock, tid))) {
-        ret = EBUSY;
-    } else {
-        rwlock->numLocks ++;
-        rwlock->writerThreadId = tid;
-    }
-    pthread_mutex_unlock(&rwlock->lock);
-    return ret;
+    return _pthread_rwlock_trywrlock(rwlock, __get_thread()->tid);
 }
 
 int pthread_rwlock_timedwrlock(pthread_rwlock_t *rwlock, const struct timespec *abs_timeout)
 {
-    int ret = 0;
-
     if (rwlock == NULL)
         return EINVAL;
 
-    pthread_mutex_lock(&rwlock->lock);
     int tid = __get_thread()->tid;
-    if (__predict_false(!write_precondition(rwlock, tid))) {
-        /* If we can't read yet, wait until the rwlock is unlocked
-         * and try again. Increment pendingReaders to get the
-         * cond broadcast when that happens.
-         */
-        rwlock->pendingWriters += 1;
-        do {
-            ret = pthread_cond_timedwait(&rwlock->cond, &rwlock->lock, abs_timeout);
-        } while (ret == 0 && !write_precondition(rwlock, tid));
-        rwlock->pendingWriters -= 1;
-        if (ret != 0)
-            goto EXIT;
+    int ret = _pthread_rwlock_trywrlock(rwlock, tid);
+    if (__predict_true(ret != EBUSY))
+        return ret;
+
+    /* Register as a pending writer, which stops new readers from getting
+     * in, and wait until the lock is free.
+     */
+    __bionic_atomic_inc(&rwlock->pendingWriters);
+    ANDROID_MEMBAR_FULL();
+
+    for (;;) {
+        int state = rwlock->state;
+
+        if ((state & RWLOCK_HELD_MASK) == 0) {
+            if (__bionic_cmpxchg(state, state | RWLOCK_WRITE_LOCKED | 1, &rwlock->state) == 0) {
+                ANDROID_MEMBAR_FULL();
+                rwlock->writerThreadId = tid;
+                ret = 0;
+                break;
+            }
+            continue;
+        }
+
+        if ((state & RWLOCK_WRITERS_WAITING) == 0) {
+            if (__bionic_cmpxchg(state, state | RWLOCK_WRITERS_WAITING, &rwlock->state) != 0)
+                continue;
+            state |= RWLOCK_WRITERS_WAITING;
+        }
+
+        ret = _pthread_rwlock_wait(rwlock, state, RWLOCK_WRITER_WAITER, abs_timeout);
+        if (ret == ETIMEDOUT || ret == EINVAL)
+            break;
     }
-    rwlock->numLocks ++;
-    rwlock->writerThreadId = tid;
-EXIT:
-    pthread_mutex_unlock(&rwlock->lock);
+
+    __bionic_atomic_dec(&rwlock->pendingWriters);
+
+    /* If we are giving up, we may have consumed a wake-up meant for another
+     * writer, or been the last writer holding back the readers.
+     */
+    if (ret != 0)
+        _pthread_rwlock_pulse(rwlock);
+
     return ret;
 }
 
 
 int pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
 {
-    int  ret = 0;
-
     if (rwlock == NULL)
         return EINVAL;
 
-    pthread_mutex_lock(&rwlock->lock);
+    int state = rwlock->state;
 
     /* The lock must be held */
-    if (rwlock->numLocks == 0) {
-        ret = EPERM;
-        goto EXIT;
-    }
+    if ((state & RWLOCK_COUNT_MASK) == 0)
+        return EPERM;
 
-    /* If it has only readers, writerThreadId is 0 */
-    if (rwlock->writerThreadId == 0) {
-        if (--rwlock->numLocks == 0)
-            _pthread_rwlock_pulse(rwlock);
-    }
-    /* Otherwise, it has only a single writer, which
-     * must be ourselves.
-     */
-    else {
-        if (rwlock->writerThreadId != __get_thread()->tid) {
-            ret = EPERM;
-            goto EXIT;
+    if (state & RWLOCK_WRITE_LOCKED) {
+        /* It has a single writer, which must be ourselves. Nobody
+         * else can change the count until we release it, only set the
+         * waiting bits.
+         */
+        if (rwlock->writerThreadId != __get_thread()->tid)
+            return EPERM;
+
+        ANDROID_MEMBAR_FULL();
+        if ((state & RWLOCK_COUNT_MASK) > 1) {
+            __bionic_atomic_dec(&rwlock->state);
+            return 0;
         }
-        if (--rwlock->numLocks == 0) {
-            rwlock->writerThreadId = 0;
-            _pthread_rwlock_pulse(rwlock);
+
+        rwlock->writerThreadId = 0;
+        ANDROID_MEMBAR_FULL();
+        while (__bionic_cmpxchg(state, state & ~RWLOCK_HELD_MASK, &rwlock->state) != 0)
+            state = rwlock->state;
+    } else {
+        /* It has only readers */
+        ANDROID_MEMBAR_FULL();
+        for (;;) {
+            if ((state & RWLOCK_COUNT_MASK) == 0 || (state & RWLOCK_WRITE_LOCKED))
+                return EPERM;
+            if (__bionic_cmpxchg(state, state - 1, &rwlock->state) == 0)
+                break;
+            state = rwlock->state;
         }
+        if ((state & RWLOCK_COUNT_MASK) != 1)
+            return 0;
     }
-EXIT:
-    pthread_mutex_unlock(&rwlock->lock);
-    return ret;
+
+    _pthread_rwlock_pulse(rwlock);
+    return 0;
 }
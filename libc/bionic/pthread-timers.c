@@ -30,7 +30,7 @@
 
 #include <errno.h>
 #include <linux/time.h>
-#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 extern int __pthread_cond_timedwait(pthread_cond_t*, pthread_mutex_t*, const struct timespec*,
@@ -50,15 +50,24 @@ extern int __pthread_cond_timedwait_relative(pthread_cond_t*, pthread_mutex_t*,
 // www.opengroup.org/onlinepubs/000095399/functions/xsh_chap02_04.html#tag_02_04_01
 //
 // The Linux kernel doesn't support these, so we need to implement them in the
-// C library. We use a very basic scheme where each timer is associated to a
-// thread that will loop, waiting for timeouts or messages from the program
-// corresponding to calls to timer_settime() and timer_delete().
+// C library. Timers are multiplexed onto "dispatchers": a dispatcher keeps its
+// armed timers in a binary min-heap ordered by CLOCK_MONOTONIC deadline, and a
+// small pool of threads waits for the earliest deadline and runs the callbacks.
+// Timers created without sigev_notify_attributes all share one dispatcher whose
+// pool grows on demand up to TIMER_DISPATCHER_MAX_THREADS threads. Timers with
+// their own thread attributes get a private dispatcher with a single thread
+// created with those attributes, as before.
+//
+// Deadlines are only hints: when one passes, the timer's expiration time is
+// checked again against the timer's own clock, which may not advance at the
+// same rate as CLOCK_MONOTONIC.
 //
 // Note also an important thing: Posix mandates that in the case of fork(),
 // the timers of the child process should be disarmed, but not deleted.
 // this is implemented by providing a fork() wrapper (see bionic/fork.c) which
 // stops all timers before the fork, and only re-start them in case of error
-// or in the parent process.
+// or in the parent process. The child then calls __timer_table_after_fork(),
+// which disarms all its timers since the dispatcher threads weren't copied.
 //
 // This stop/start is implemented by the __timer_table_start_stop() function
 // below.
@@ -76,8 +85,7 @@ extern int __pthread_cond_timedwait_relative(pthread_cond_t*, pthread_mutex_t*,
 
 /* this value is used internally to indicate a 'free' or 'zombie'
  * thr_timer structure. Here, 'zombie' means that timer_delete()
- * has been called, but that the corresponding thread hasn't
- * exited yet.
+ * has been called, but that its callback hasn't returned yet.
  */
 #define  TIMER_ID_NONE            ((timer_t)0xffffffff)
 
@@ -87,59 +95,91 @@ extern int __pthread_cond_timedwait_relative(pthread_cond_t*, pthread_mutex_t*,
 /* the maximum value of overrun counters */
 #define  DELAYTIMER_MAX    0x7fffffff
 
-typedef struct thr_timer          thr_timer_t;
-typedef struct thr_timer_table    thr_timer_table_t;
+/* the maximum number of threads running callbacks for the shared dispatcher */
+#define  TIMER_DISPATCHER_MAX_THREADS  4
+
+typedef struct thr_timer             thr_timer_t;
+typedef struct thr_timer_dispatcher  thr_timer_dispatcher_t;
+typedef struct thr_timer_table       thr_timer_table_t;
 
 /* The Posix spec says the function receives an unsigned parameter, but
  * it's really a 'union sigval' a.k.a. sigval_t */
 typedef void (*thr_timer_func_t)( sigval_t );
 
 struct thr_timer {
-    thr_timer_t*       next;     /* next in free list */
-    timer_t            id;       /* TIMER_ID_NONE iff free or dying */
-    clockid_t          clock;
-    pthread_t          thread;
-    pthread_attr_t     attributes;
-    thr_timer_func_t   callback;
-    sigval_t           value;
-
-    /* the following are used to communicate between
-     * the timer thread and the timer_XXX() functions
-     */
-    pthread_mutex_t           mutex;     /* lock */
-    pthread_cond_t            cond;      /* signal a state change to thread */
-    int volatile              done;      /* set by timer_delete */
-    int volatile              stopped;   /* set by _start_stop() */
-    struct timespec volatile  expires;   /* next expiration time, or 0 */
-    struct timespec volatile  period;    /* reload value, or 0 */
-    int volatile              overruns;  /* current number of overruns */
+    thr_timer_t*             next;        /* next in free list */
+    timer_t                  id;          /* TIMER_ID_NONE iff free or dying */
+    clockid_t                clock;
+    thr_timer_dispatcher_t*  dispatcher;
+    thr_timer_func_t         callback;
+    sigval_t                 value;
+
+    /* the following are protected by dispatcher->lock */
+    int              heap_index;  /* position in dispatcher->heap, or -1 */
+    int              running;     /* set while the callback runs */
+    int              deleted;     /* set by timer_delete while the callback runs */
+    struct timespec  deadline;    /* CLOCK_MONOTONIC time to look at 'expires' again */
+    struct timespec  expires;     /* next expiration time, or 0 */
+    struct timespec  period;      /* reload value, or 0 */
+    int              overruns;    /* current number of overruns */
+};
+
+struct thr_timer_dispatcher {
+    thr_timer_dispatcher_t*  next;        /* next in the table's list */
+    pthread_attr_t           attributes;  /* for the dispatcher threads */
+    int                      is_private;  /* only used by one timer, freed with it */
+    int                      max_threads;
+
+    pthread_mutex_t          lock;
+    pthread_cond_t           cond;        /* signal a state change to the threads */
+    thr_timer_t**            heap;        /* armed timers, earliest deadline first */
+    int                      heap_count;
+    int                      heap_capacity;
+    int                      timers;      /* number of timers using this dispatcher */
+    int                      threads;     /* number of threads */
+    int                      idle_threads;  /* threads not running a callback */
+    int                      stopped;     /* set by _start_stop() */
 };
 
-#define  MAX_THREAD_TIMERS  32
+#define  TIMER_CHUNK_SIZE   128
+#define  MAX_TIMER_CHUNKS   512
 
 struct thr_timer_table {
-    pthread_mutex_t  lock;
-    thr_timer_t*     free_timer;
-    thr_timer_t      timers[ MAX_THREAD_TIMERS ];
+    pthread_mutex_t          lock;
+    thr_timer_t*             free_timer;
+    int                      chunk_count;
+    thr_timer_t*             chunks[ MAX_TIMER_CHUNKS ];
+    thr_timer_dispatcher_t*  dispatchers;
+    thr_timer_dispatcher_t   shared_dispatcher;
 };
 
+static void thr_timer_dispatcher_init(thr_timer_dispatcher_t* d, const pthread_attr_t* attr) {
+  if (attr == NULL) {
+    pthread_attr_init(&d->attributes);
+  } else {
+    d->attributes = *attr;
+  }
+  // Posix says that the default is PTHREAD_CREATE_DETACHED and
+  // that PTHREAD_CREATE_JOINABLE has undefined behavior.
+  // So simply always use DETACHED :-)
+  pthread_attr_setdetachstate(&d->attributes, PTHREAD_CREATE_DETACHED);
+
+  pthread_mutex_init(&d->lock, NULL);
+  pthread_cond_init(&d->cond, NULL);
+}
+
 /** GLOBAL TABLE OF THREAD TIMERS
  **/
 
 static void
 thr_timer_table_init( thr_timer_table_t*  t )
 {
-    int  nn;
-
     memset(t, 0, sizeof *t);
     pthread_mutex_init( &t->lock, NULL );
 
-    for (nn = 0; nn < MAX_THREAD_TIMERS; nn++)
-        t->timers[nn].id = TIMER_ID_NONE;
-
-    t->free_timer = &t->timers[0];
-    for (nn = 1; nn < MAX_THREAD_TIMERS; nn++)
-        t->timers[nn-1].next = &t->timers[nn];
+    thr_timer_dispatcher_init(&t->shared_dispatcher, NULL);
+    t->shared_dispatcher.max_threads = TIMER_DISPATCHER_MAX_THREADS;
+    t->dispatchers = &t->shared_dispatcher;
 }
 
 
@@ -152,11 +192,32 @@ thr_timer_table_alloc( thr_timer_table_t*  t )
         return NULL;
 
     pthread_mutex_lock(&t->lock);
+
+    /* grow the table by one chunk when the free list is empty */
+    if (t->free_timer == NULL && t->chunk_count < MAX_TIMER_CHUNKS) {
+        thr_timer_t*  chunk = calloc(TIMER_CHUNK_SIZE, sizeof(thr_timer_t));
+        if (chunk != NULL) {
+            int  nn;
+            for (nn = 0; nn < TIMER_CHUNK_SIZE; nn++) {
+                chunk[nn].id   = TIMER_ID_NONE;
+                chunk[nn].next = (nn + 1 < TIMER_CHUNK_SIZE) ? &chunk[nn+1] : NULL;
+            }
+            t->chunks[t->chunk_count++] = chunk;
+            t->free_timer = chunk;
+        }
+    }
+
     timer = t->free_timer;
     if (timer != NULL) {
+        int  chunk = t->chunk_count - 1;
+
+        /* find which chunk the timer comes from to compute its index */
+        while (timer < t->chunks[chunk] || timer >= t->chunks[chunk] + TIMER_CHUNK_SIZE)
+            chunk--;
+
         t->free_timer = timer->next;
         timer->next   = NULL;
-        timer->id     = TIMER_ID_WRAP((timer - t->timers));
+        timer->id     = TIMER_ID_WRAP((chunk * TIMER_CHUNK_SIZE + (timer - t->chunks[chunk])));
     }
     pthread_mutex_unlock(&t->lock);
     return timer;
@@ -167,29 +228,61 @@ static void
 thr_timer_table_free( thr_timer_table_t*  t, thr_timer_t*  timer )
 {
     pthread_mutex_lock( &t->lock );
-    timer->id     = TIMER_ID_NONE;
-    timer->thread = 0;
-    timer->next   = t->free_timer;
-    t->free_timer = timer;
+    timer->id         = TIMER_ID_NONE;
+    timer->dispatcher = NULL;
+    timer->next       = t->free_timer;
+    t->free_timer     = timer;
     pthread_mutex_unlock( &t->lock );
 }
 
 
+static thr_timer_dispatcher_t* thr_timer_table_new_dispatcher(thr_timer_table_t* t,
+                                                              const pthread_attr_t* attr) {
+  thr_timer_dispatcher_t* d = calloc(1, sizeof(*d));
+  if (d == NULL) {
+    return NULL;
+  }
+  thr_timer_dispatcher_init(d, attr);
+  d->is_private = 1;
+  d->max_threads = 1;
+
+  pthread_mutex_lock(&t->lock);
+  d->next = t->dispatchers;
+  t->dispatchers = d;
+  pthread_mutex_unlock(&t->lock);
+  return d;
+}
+
+
+// Frees a private dispatcher once it has neither timers nor threads left.
+static void thr_timer_table_free_dispatcher(thr_timer_table_t* t, thr_timer_dispatcher_t* d) {
+  pthread_mutex_lock(&t->lock);
+  thr_timer_dispatcher_t** pnode = &t->dispatchers;
+  while (*pnode != d) {
+    pnode = &(*pnode)->next;
+  }
+  *pnode = d->next;
+  pthread_mutex_unlock(&t->lock);
+
+  pthread_cond_destroy(&d->cond);
+  pthread_mutex_destroy(&d->lock);
+  free(d->heap);
+  free(d);
+}
+
+
 static void thr_timer_table_start_stop(thr_timer_table_t* t, int stop) {
   if (t == NULL) {
     return;
   }
 
   pthread_mutex_lock(&t->lock);
-  for (int nn = 0; nn < MAX_THREAD_TIMERS; ++nn) {
-    thr_timer_t*  timer  = &t->timers[nn];
-    if (TIMER_ID_IS_VALID(timer->id)) {
-      // Tell the thread to start/stop.
-      pthread_mutex_lock(&timer->mutex);
-      timer->stopped = stop;
-      pthread_cond_signal( &timer->cond );
-      pthread_mutex_unlock(&timer->mutex);
-    }
+  for (thr_timer_dispatcher_t* d = t->dispatchers; d != NULL; d = d->next) {
+    // Tell the dispatcher threads to start/stop.
+    pthread_mutex_lock(&d->lock);
+    d->stopped = stop;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
   }
   pthread_mutex_unlock(&t->lock);
 }
@@ -210,21 +303,24 @@ thr_timer_table_from_id( thr_timer_table_t*  t,
         return NULL;
 
     index = (unsigned) TIMER_ID_UNWRAP(id);
-    if (index >= MAX_THREAD_TIMERS)
+    if (index >= TIMER_CHUNK_SIZE * MAX_TIMER_CHUNKS)
         return NULL;
 
     pthread_mutex_lock(&t->lock);
 
-    timer = &t->timers[index];
-
-    if (!TIMER_ID_IS_VALID(timer->id)) {
+    if (index / TIMER_CHUNK_SIZE >= (unsigned) t->chunk_count) {
         timer = NULL;
     } else {
-        /* if we're removing this timer, clear the id
-         * right now to prevent another thread to
-         * use the same id after the unlock */
-        if (remove)
-            timer->id = TIMER_ID_NONE;
+        timer = &t->chunks[index / TIMER_CHUNK_SIZE][index % TIMER_CHUNK_SIZE];
+        if (!TIMER_ID_IS_VALID(timer->id)) {
+            timer = NULL;
+        } else {
+            /* if we're removing this timer, clear the id
+             * right now to prevent another thread to
+             * use the same id after the unlock */
+            if (remove)
+                timer->id = TIMER_ID_NONE;
+        }
     }
     pthread_mutex_unlock(&t->lock);
 
@@ -276,13 +372,13 @@ thr_timer_from_id( timer_t   id )
 static __inline__ void
 thr_timer_lock( thr_timer_t*  t )
 {
-    pthread_mutex_lock(&t->mutex);
+    pthread_mutex_lock(&t->dispatcher->lock);
 }
 
 static __inline__ void
 thr_timer_unlock( thr_timer_t*  t )
 {
-    pthread_mutex_unlock(&t->mutex);
+    pthread_mutex_unlock(&t->dispatcher->lock);
 }
 
 
@@ -328,6 +424,279 @@ static __inline__ int timespec_cmp0(const struct timespec* a) {
   return 0;
 }
 
+/* Called in the fork child, which is single-threaded and has none of the
+ * dispatcher threads: reset the locks they may have held, and disarm all
+ * timers. The first timer armed again will start a new dispatcher thread.
+ */
+__LIBC_HIDDEN__ void __timer_table_after_fork(void) {
+  thr_timer_table_t* t = __timer_table;
+  if (t == NULL) {
+    return;
+  }
+
+  pthread_mutex_init(&t->lock, NULL);
+
+  for (thr_timer_dispatcher_t* d = t->dispatchers; d != NULL; d = d->next) {
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+    d->heap_count = 0;
+    d->threads = 0;
+    d->idle_threads = 0;
+    d->stopped = 0;
+  }
+
+  for (int chunk = 0; chunk < t->chunk_count; ++chunk) {
+    for (int nn = 0; nn < TIMER_CHUNK_SIZE; ++nn) {
+      thr_timer_t* timer = &t->chunks[chunk][nn];
+      if (TIMER_ID_IS_VALID(timer->id)) {
+        timer->heap_index = -1;
+        timer->running = 0;
+        timer->overruns = 0;
+        timespec_zero(&timer->expires);
+        timespec_zero(&timer->period);
+      } else if (timer->deleted) {
+        // The callback of this deleted timer was running in another thread, which
+        // would have freed it when done. Nobody will now, so do it here.
+        timer->deleted = 0;
+        timer->dispatcher = NULL;
+        timer->next = t->free_timer;
+        t->free_timer = timer;
+      }
+    }
+  }
+}
+
+/** DISPATCHER HEAP
+ **
+ ** all of the following must be called with the dispatcher's lock held
+ **/
+
+static __inline__ void thr_timer_heap_set(thr_timer_dispatcher_t* d, int index, thr_timer_t* timer) {
+  d->heap[index] = timer;
+  timer->heap_index = index;
+}
+
+static void thr_timer_heap_sift_up(thr_timer_dispatcher_t* d, int index) {
+  thr_timer_t* timer = d->heap[index];
+  while (index > 0) {
+    int parent = (index - 1) / 2;
+    if (timespec_cmp(&d->heap[parent]->deadline, &timer->deadline) <= 0) {
+      break;
+    }
+    thr_timer_heap_set(d, index, d->heap[parent]);
+    index = parent;
+  }
+  thr_timer_heap_set(d, index, timer);
+}
+
+static void thr_timer_heap_sift_down(thr_timer_dispatcher_t* d, int index) {
+  thr_timer_t* timer = d->heap[index];
+  for (;;) {
+    int child = 2 * index + 1;
+    if (child >= d->heap_count) {
+      break;
+    }
+    if (child + 1 < d->heap_count &&
+        timespec_cmp(&d->heap[child + 1]->deadline, &d->heap[child]->deadline) < 0) {
+      child++;
+    }
+    if (timespec_cmp(&timer->deadline, &d->heap[child]->deadline) <= 0) {
+      break;
+    }
+    thr_timer_heap_set(d, index, d->heap[child]);
+    index = child;
+  }
+  thr_timer_heap_set(d, index, timer);
+}
+
+// Makes room in the heap for all of the dispatcher's timers, so that
+// thr_timer_heap_insert() never needs to allocate memory.
+static int thr_timer_heap_reserve(thr_timer_dispatcher_t* d, int count) {
+  if (count <= d->heap_capacity) {
+    return 0;
+  }
+  int capacity = (d->heap_capacity == 0) ? 16 : d->heap_capacity * 2;
+  thr_timer_t** heap = realloc(d->heap, capacity * sizeof(thr_timer_t*));
+  if (heap == NULL) {
+    return ENOMEM;
+  }
+  d->heap = heap;
+  d->heap_capacity = capacity;
+  return 0;
+}
+
+static void thr_timer_heap_insert(thr_timer_dispatcher_t* d, thr_timer_t* timer) {
+  thr_timer_heap_set(d, d->heap_count++, timer);
+  thr_timer_heap_sift_up(d, timer->heap_index);
+}
+
+static void thr_timer_heap_remove(thr_timer_dispatcher_t* d, thr_timer_t* timer) {
+  int index = timer->heap_index;
+  timer->heap_index = -1;
+  if (--d->heap_count == index) {
+    return;
+  }
+  thr_timer_heap_set(d, index, d->heap[d->heap_count]);
+  thr_timer_heap_sift_up(d, index);
+  thr_timer_heap_sift_down(d, index);
+}
+
+/** DISPATCHER THREADS
+ **/
+
+// Computes the CLOCK_MONOTONIC deadline of an armed timer from its
+// expiration time and 'now', the current time on the timer's clock.
+static void thr_timer_set_deadline(thr_timer_t* timer, const struct timespec* now) {
+  clock_gettime(CLOCK_MONOTONIC, &timer->deadline);
+  if (timespec_cmp(&timer->expires, now) > 0) {
+    struct timespec diff = timer->expires;
+    timespec_sub(&diff, now);
+    timespec_add(&timer->deadline, &diff);
+  }
+}
+
+// Reloads or disarms a timer that just expired, counting the overruns
+// of periodic timers whose expirations we couldn't keep up with.
+static void thr_timer_reload(thr_timer_t* timer, const struct timespec* now) {
+  if (timespec_is_zero(&timer->period)) {
+    timespec_zero(&timer->expires);
+    return;
+  }
+
+  struct timespec expires = timer->expires;
+  for (;;) {
+    timespec_add(&expires, &timer->period);
+    if (timespec_cmp(&expires, now) > 0) {
+      break;
+    }
+    if (timer->overruns < DELAYTIMER_MAX) {
+      timer->overruns += 1;
+    }
+  }
+  timer->expires = expires;
+}
+
+static void* timer_dispatcher_start(void*);
+
+// Starts one more thread for the dispatcher. Called with d->lock held.
+static int thr_timer_dispatcher_spawn(thr_timer_dispatcher_t* d) {
+  // Count the new thread right away, so that nobody else starts one for the same reason.
+  d->threads++;
+  d->idle_threads++;
+
+  pthread_t thread;
+  int rc = pthread_create(&thread, &d->attributes, timer_dispatcher_start, d);
+  if (rc != 0) {
+    d->threads--;
+    d->idle_threads--;
+  }
+  return rc;
+}
+
+static void* timer_dispatcher_start(void* arg) {
+  thr_timer_dispatcher_t* d = arg;
+
+  // Give this thread a meaningful name.
+  pthread_setname_np(pthread_self(), "POSIX timers");
+
+  pthread_mutex_lock(&d->lock);
+
+  // We loop until the last timer using this dispatcher is deleted.
+  while (d->timers > 0) {
+    // If the dispatcher is stopped or no timer is armed, wait indefinitely
+    // for a state change from timer_settime/_delete/_start_stop.
+    if (d->stopped || d->heap_count == 0) {
+      pthread_cond_wait(&d->cond, &d->lock);
+      continue;
+    }
+
+    // Otherwise, do a timed wait until either a state change
+    // or the earliest deadline.
+    thr_timer_t* timer = d->heap[0];
+    struct timespec mono;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    if (timespec_cmp(&timer->deadline, &mono) > 0) {
+      struct timespec diff = timer->deadline;
+      timespec_sub(&diff, &mono);
+      __pthread_cond_timedwait_relative(&d->cond, &d->lock, &diff);
+      continue;
+    }
+
+    // The deadline has passed, but the timer's own clock has the last word.
+    struct timespec now;
+    clock_gettime(timer->clock, &now);
+    thr_timer_heap_remove(d, timer);
+    if (timespec_cmp(&timer->expires, &now) > 0) {
+      thr_timer_set_deadline(timer, &now);
+      thr_timer_heap_insert(d, timer);
+      continue;
+    }
+
+    // If the callback for a previous expiration is still running, leave the
+    // timer out of the heap: it's queued again when the callback returns.
+    if (timer->running) {
+      continue;
+    }
+
+    // First reload/disarm the timer as needed.
+    thr_timer_reload(timer, &now);
+    if (!timespec_is_zero(&timer->expires)) {
+      thr_timer_set_deadline(timer, &now);
+      thr_timer_heap_insert(d, timer);
+    }
+
+    // Make sure another thread is around to take care of the other timers
+    // while this one runs the callback.
+    timer->running = 1;
+    d->idle_threads--;
+    if (d->idle_threads == 0 && d->threads < d->max_threads) {
+      thr_timer_dispatcher_spawn(d);
+    }
+
+    // Now call the timer callback function. Release the
+    // lock to allow the function to modify the timer setting
+    // or call timer_getoverrun().
+    // NOTE: at this point we trust the callback not to be a
+    //      total moron and pthread_kill() the dispatcher thread
+    pthread_mutex_unlock(&d->lock);
+    timer->callback(timer->value);
+    pthread_mutex_lock(&d->lock);
+
+    d->idle_threads++;
+    timer->running = 0;
+
+    if (timer->deleted) {
+      // timer_delete() was called meanwhile, and left it to us to free the timer object.
+      timer->deleted = 0;
+      pthread_mutex_unlock(&d->lock);
+      thr_timer_table_free(__timer_table_get(), timer);
+      pthread_mutex_lock(&d->lock);
+      continue;
+    }
+
+    // Now clear the overruns counter. it only makes sense
+    // within the callback.
+    timer->overruns = 0;
+
+    // Queue the timer again if it expired while the callback was running.
+    if (!timespec_is_zero(&timer->expires) && timer->heap_index < 0) {
+      clock_gettime(timer->clock, &now);
+      thr_timer_set_deadline(timer, &now);
+      thr_timer_heap_insert(d, timer);
+    }
+  }
+
+  d->threads--;
+  d->idle_threads--;
+  int free_dispatcher = (d->is_private && d->threads == 0);
+  pthread_mutex_unlock(&d->lock);
+
+  if (free_dispatcher) {
+    thr_timer_table_free_dispatcher(__timer_table_get(), d);
+  }
+  return NULL;
+}
+
 /** POSIX TIMERS APIs */
 
 extern int __timer_create(clockid_t, struct sigevent*, timer_t*);
@@ -336,8 +705,6 @@ extern int __timer_gettime(timer_t, struct itimerspec*);
 extern int __timer_settime(timer_t, int, const struct itimerspec*, struct itimerspec*);
 extern int __timer_getoverrun(timer_t);
 
-static void* timer_thread_start(void*);
-
 int timer_create(clockid_t clock_id, struct sigevent* evp, timer_t* timer_id) {
   // If not a SIGEV_THREAD timer, the kernel can handle it without our help.
   if (__predict_true(evp == NULL || evp->sigev_notify != SIGEV_THREAD)) {
@@ -356,8 +723,7 @@ int timer_create(clockid_t clock_id, struct sigevent* evp, timer_t* timer_id) {
     return -1;
   }
 
-  // Create a new timer and its thread.
-  // TODO: use a single global thread for all timers.
+  // Create a new timer.
   thr_timer_table_t* table = __timer_table_get();
   thr_timer_t* timer = thr_timer_table_alloc(table);
   if (timer == NULL) {
@@ -365,34 +731,45 @@ int timer_create(clockid_t clock_id, struct sigevent* evp, timer_t* timer_id) {
     return -1;
   }
 
-  // Copy the thread attributes.
-  if (evp->sigev_notify_attributes == NULL) {
-    pthread_attr_init(&timer->attributes);
-  } else {
-    timer->attributes = ((pthread_attr_t*) evp->sigev_notify_attributes)[0];
+  // Timers with their own thread attributes need their own dispatcher.
+  thr_timer_dispatcher_t* d = &table->shared_dispatcher;
+  if (evp->sigev_notify_attributes != NULL) {
+    d = thr_timer_table_new_dispatcher(table, evp->sigev_notify_attributes);
+    if (d == NULL) {
+      thr_timer_table_free(table, timer);
+      errno = ENOMEM;
+      return -1;
+    }
   }
 
-  // Posix says that the default is PTHREAD_CREATE_DETACHED and
-  // that PTHREAD_CREATE_JOINABLE has undefined behavior.
-  // So simply always use DETACHED :-)
-  pthread_attr_setdetachstate(&timer->attributes, PTHREAD_CREATE_DETACHED);
-
+  timer->dispatcher = d;
   timer->callback = evp->sigev_notify_function;
   timer->value = evp->sigev_value;
   timer->clock = clock_id;
 
-  pthread_mutex_init(&timer->mutex, NULL);
-  pthread_cond_init(&timer->cond, NULL);
-
-  timer->done = 0;
-  timer->stopped = 0;
+  timer->heap_index = -1;
+  timer->running = 0;
+  timer->deleted = 0;
   timer->expires.tv_sec = timer->expires.tv_nsec = 0;
   timer->period.tv_sec = timer->period.tv_nsec  = 0;
   timer->overruns = 0;
 
-  // Create the thread.
-  int rc = pthread_create(&timer->thread, &timer->attributes, timer_thread_start, timer);
+  // Make room for the timer in the dispatcher, and start its first
+  // thread now so that failures are reported here.
+  pthread_mutex_lock(&d->lock);
+  int rc = thr_timer_heap_reserve(d, d->timers + 1);
+  if (rc == 0 && d->threads == 0) {
+    rc = thr_timer_dispatcher_spawn(d);
+  }
+  if (rc == 0) {
+    d->timers++;
+  }
+  pthread_mutex_unlock(&d->lock);
+
   if (rc != 0) {
+    if (d->is_private) {
+      thr_timer_table_free_dispatcher(table, d);
+    }
     thr_timer_table_free(table, timer);
     errno = rc;
     return -1;
@@ -410,25 +787,39 @@ timer_delete( timer_t  id )
         return __timer_delete( id );
     else
     {
-        thr_timer_table_t*  table = __timer_table_get();
-        thr_timer_t*        timer = thr_timer_table_from_id(table, id, 1);
+        thr_timer_table_t*       table = __timer_table_get();
+        thr_timer_t*             timer = thr_timer_table_from_id(table, id, 1);
+        thr_timer_dispatcher_t*  d;
+        int                      running, free_dispatcher;
 
         if (timer == NULL) {
             errno = EINVAL;
             return -1;
         }
 
-        /* tell the timer's thread to stop */
-        thr_timer_lock(timer);
-        timer->done = 1;
-        pthread_cond_signal( &timer->cond );
-        thr_timer_unlock(timer);
+        d = timer->dispatcher;
+        pthread_mutex_lock(&d->lock);
+        if (timer->heap_index >= 0)
+            thr_timer_heap_remove(d, timer);
 
-        /* NOTE: the thread will call __timer_table_free() to free the
-         * timer object. the '1' parameter to thr_timer_table_from_id
-         * above ensured that the object and its timer_id cannot be
-         * reused before that.
+        /* if the callback is running, the dispatcher thread will
+         * free the timer object when it returns. the '1' parameter to
+         * thr_timer_table_from_id above ensured that the object and
+         * its timer_id cannot be reused before that.
          */
+        running = timer->running;
+        timer->deleted = running;
+
+        /* the dispatcher threads exit with the last timer */
+        d->timers -= 1;
+        free_dispatcher = (d->is_private && d->timers == 0 && d->threads == 0);
+        pthread_cond_broadcast( &d->cond );
+        pthread_mutex_unlock(&d->lock);
+
+        if (!running)
+            thr_timer_table_free(table, timer);
+        if (free_dispatcher)
+            thr_timer_table_free_dispatcher(table, d);
         return 0;
     }
 }
@@ -499,13 +890,16 @@ timer_settime( timer_t                   id,
     if ( __predict_true(!TIMER_ID_IS_WRAPPED(id)) ) {
         return __timer_settime( id, flags, spec, ospec );
     } else {
-        thr_timer_t*        timer = thr_timer_from_id(id);
-        struct timespec     expires, now;
+        thr_timer_t*             timer = thr_timer_from_id(id);
+        thr_timer_dispatcher_t*  d;
+        struct timespec          expires, now;
+        int                      rc = 0;
 
         if (timer == NULL) {
             errno = EINVAL;
             return -1;
         }
+        d = timer->dispatcher;
         thr_timer_lock(timer);
 
         /* return current timer value if ospec isn't NULL */
@@ -514,7 +908,7 @@ timer_settime( timer_t                   id,
         }
 
         /* compute next expiration time. note that if the
-         * new it_interval is 0, we should disarm the timer
+         * new it_value is 0, we should disarm the timer
          */
         expires = spec->it_value;
         if (!timespec_is_zero(&expires)) {
@@ -528,10 +922,28 @@ timer_settime( timer_t                   id,
         }
         timer->expires = expires;
         timer->period  = spec->it_interval;
+
+        /* move the timer to its new place in the heap, and
+         * signal the change to a thread if it's the next one due */
+        if (timer->heap_index >= 0)
+            thr_timer_heap_remove(d, timer);
+
+        if (!timespec_is_zero(&expires)) {
+            thr_timer_set_deadline(timer, &now);
+            thr_timer_heap_insert(d, timer);
+            if (timer->heap_index == 0)
+                pthread_cond_signal( &d->cond );
+
+            /* the dispatcher has no thread left after a fork */
+            if (d->threads == 0)
+                rc = thr_timer_dispatcher_spawn(d);
+        }
         thr_timer_unlock( timer );
 
-        /* signal the change to the thread */
-        pthread_cond_signal( &timer->cond );
+        if (rc != 0) {
+            errno = rc;
+            return -1;
+        }
     }
     return 0;
 }
@@ -558,95 +970,3 @@ timer_getoverrun(timer_t  id)
         return result;
     }
 }
-
-
-static void* timer_thread_start(void* arg) {
-  thr_timer_t* timer = arg;
-
-  thr_timer_lock(timer);
-
-  // Give this thread a meaningful name.
-  char name[32];
-  snprintf(name, sizeof(name), "POSIX interval timer 0x%08x", timer->id);
-  pthread_setname_np(pthread_self(), name);
-
-  // We loop until timer->done is set in timer_delete().
-  while (!timer->done) {
-    struct timespec expires = timer->expires;
-    struct timespec period = timer->period;
-
-    // If the timer is stopped or disarmed, wait indefinitely
-    // for a state change from timer_settime/_delete/_start_stop.
-    if (timer->stopped || timespec_is_zero(&expires)) {
-      pthread_cond_wait(&timer->cond, &timer->mutex);
-      continue;
-    }
-
-    // Otherwise, we need to do a timed wait until either a
-    // state change of the timer expiration time.
-    struct timespec now;
-    clock_gettime(timer->clock, &now);
-
-    if (timespec_cmp(&expires, &now) > 0) {
-      // Cool, there was no overrun, so compute the
-      // relative timeout as 'expires - now', then wait.
-      struct timespec diff = expires;
-      timespec_sub(&diff, &now);
-
-      int ret = __pthread_cond_timedwait_relative(&timer->cond, &timer->mutex, &diff);
-
-      // If we didn't time out, it means that a state change
-      // occurred, so loop to take care of it.
-      if (ret != ETIMEDOUT) {
-        continue;
-      }
-    } else {
-      // Overrun was detected before we could wait!
-      if (!timespec_is_zero(&period)) {
-        // For periodic timers, compute total overrun count.
-        do {
-          timespec_add(&expires, &period);
-          if (timer->overruns < DELAYTIMER_MAX) {
-            timer->overruns += 1;
-          }
-        } while (timespec_cmp(&expires, &now) < 0);
-
-        // Backtrack the last one, because we're going to
-        // add the same value just a bit later.
-        timespec_sub(&expires, &period);
-      } else {
-        // For non-periodic timers, things are simple.
-        timer->overruns = 1;
-      }
-    }
-
-    // If we get here, a timeout was detected.
-    // First reload/disarm the timer as needed.
-    if (!timespec_is_zero(&period)) {
-      timespec_add(&expires, &period);
-    } else {
-      timespec_zero(&expires);
-    }
-    timer->expires = expires;
-
-    // Now call the timer callback function. Release the
-    // lock to allow the function to modify the timer setting
-    // or call timer_getoverrun().
-    // NOTE: at this point we trust the callback not to be a
-    //      total moron and pthread_kill() the timer thread
-    thr_timer_unlock(timer);
-    timer->callback(timer->value);
-    thr_timer_lock(timer);
-
-    // Now clear the overruns counter. it only makes sense
-    // within the callback.
-    timer->overruns = 0;
-  }
-
-  thr_timer_unlock(timer);
-
-  // Free the timer object.
-  thr_timer_table_free(__timer_table_get(), timer);
-
-  return NULL;
-}
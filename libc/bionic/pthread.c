@@ -48,6 +48,9 @@ extern void pthread_debug_mutex_unlock_check(pthread_mutex_t *mutex);
 extern void _exit_with_stack_teardown(void * stackBase, int stackSize, int status);
 extern void _exit_thread(int status);
 
+// Defined alongside malloc in dlmalloc.c, which libc_nomalloc.a leaves out.
+extern void __bionic_thread_cache_destroy(void) __attribute__((weak));
+
 int  __futex_wake_ex(volatile void *ftx, int pshared, int val)
 {
     return __futex_syscall3(ftx, pshared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, val);
@@ -88,7 +91,11 @@ void pthread_exit(void * retval)
     pthread_internal_t*  thread     = __get_thread();
     void*                stack_base = thread->attr.stack_base;
     int                  stack_size = thread->attr.stack_size;
+    size_t               guard_size = thread->attr.guard_size;
     int                  user_stack = (thread->attr.flags & PTHREAD_ATTR_FLAG_USER_STACK) != 0;
+    void*                signal_stack = thread->alternate_signal_stack;
+    /* The main thread's stack came from the kernel, not pthread_create. */
+    int                  cache_stack = !user_stack && thread->allocated_on_heap;
     sigset_t mask;
 
     // call the cleanup handlers first
@@ -104,24 +111,33 @@ void pthread_exit(void * retval)
     // space (see pthread_key_delete)
     pthread_key_clean_all();
 
-    if (thread->alternate_signal_stack != NULL) {
+    // Return this thread's cached malloc chunks now that the TLS destructors are done.
+    if (__bionic_thread_cache_destroy != NULL) {
+        __bionic_thread_cache_destroy();
+    }
+
+    if (signal_stack != NULL) {
       // Tell the kernel to stop using the alternate signal stack.
+      // We free it (or hand it on) below, once signals are blocked.
       stack_t ss;
       ss.ss_sp = NULL;
       ss.ss_flags = SS_DISABLE;
       sigaltstack(&ss, NULL);
-
-      // Free it.
-      munmap(thread->alternate_signal_stack, SIGSTKSZ);
       thread->alternate_signal_stack = NULL;
     }
 
     // if the thread is detached, destroy the pthread_internal_t
     // otherwise, keep it in memory and signal any joiners.
-    pthread_mutex_lock(&gThreadListLock);
+    pthread_mutex_t* thread_lock = _pthread_internal_lock((pthread_t) thread);
+    pthread_mutex_lock(thread_lock);
     if (thread->attr.flags & PTHREAD_ATTR_FLAG_DETACHED) {
         _pthread_internal_remove_locked(thread);
     } else {
+       /* pthread_key_delete walks gThreadList under gThreadListLock, and must
+        * not write to our TLS area once the stack is gone.
+        */
+        pthread_mutex_lock(&gThreadListLock);
+
        /* make sure that the thread struct doesn't have stale pointers to a stack that
         * will be unmapped after the exit call below.
         */
@@ -133,6 +149,7 @@ void pthread_exit(void * retval)
 
        /* Indicate that the thread has exited for joining threads. */
         thread->attr.flags |= PTHREAD_ATTR_FLAG_ZOMBIE;
+        pthread_mutex_unlock(&gThreadListLock);
         thread->return_value = retval;
 
        /* Signal the joining thread if present. */
@@ -140,12 +157,21 @@ void pthread_exit(void * retval)
             pthread_cond_signal(&thread->join_cond);
         }
     }
-    pthread_mutex_unlock(&gThreadListLock);
+    pthread_mutex_unlock(thread_lock);
 
     sigfillset(&mask);
     sigdelset(&mask, SIGSEGV);
     sigprocmask(SIG_SETMASK, &mask, NULL);
 
+    if (cache_stack) {
+        // Leave our stacks for a future thread, if there's room. This doesn't return if so.
+        __cache_thread_stack_and_exit(stack_base, stack_size, guard_size, signal_stack);
+    }
+
+    if (signal_stack != NULL) {
+        munmap(signal_stack, SIGSTKSZ);
+    }
+
     if (user_stack) {
         // Cleaning up this thread's stack is the creator's responsibility, not ours.
         _exit_thread(0);
@@ -204,6 +230,9 @@ void pthread_exit(void * retval)
 #define  MUTEX_STATE_BITS_LOCKED_UNCONTENDED  MUTEX_STATE_TO_BITS(MUTEX_STATE_LOCKED_UNCONTENDED)
 #define  MUTEX_STATE_BITS_LOCKED_CONTENDED    MUTEX_STATE_TO_BITS(MUTEX_STATE_LOCKED_CONTENDED)
 
+/* return true iff the mutex is unlocked */
+#define  MUTEX_STATE_BITS_IS_UNLOCKED(v)            (((v) & MUTEX_STATE_MASK) == MUTEX_STATE_BITS_UNLOCKED)
+
 /* return true iff the mutex if locked with no waiters */
 #define  MUTEX_STATE_BITS_IS_LOCKED_UNCONTENDED(v)  (((v) & MUTEX_STATE_MASK) == MUTEX_STATE_BITS_LOCKED_UNCONTENDED)
 
@@ -231,6 +260,26 @@ void pthread_exit(void * retval)
 /* Returns true iff the counter is 0 */
 #define  MUTEX_COUNTER_BITS_ARE_ZERO(v)  (((v) & MUTEX_COUNTER_MASK) == 0)
 
+/* Adaptive mutex spin estimate:
+ *
+ * Adaptive mutexes can't be locked recursively, so they reuse the counter
+ * field to hold a running average of how many times a contended lock had to
+ * spin before the owner released it. Only the owner of the mutex updates it.
+ */
+#define  MUTEX_SPINS_MASK            MUTEX_COUNTER_MASK
+#define  MUTEX_SPINS_FROM_BITS(v)    FIELD_FROM_BITS(v, MUTEX_COUNTER_SHIFT, MUTEX_COUNTER_LEN)
+#define  MUTEX_SPINS_TO_BITS(v)      FIELD_TO_BITS(v, MUTEX_COUNTER_SHIFT, MUTEX_COUNTER_LEN)
+
+/* Upper bound on the number of times we spin on a contended mutex before
+ * sleeping in the kernel. There is no point spinning on a uniprocessor: the
+ * owner can't release the mutex while we're running.
+ */
+#if ANDROID_SMP
+#define  MUTEX_SPINS_MAX             100
+#else
+#define  MUTEX_SPINS_MAX             0
+#endif
+
 /* Mutex shared bit flag
  *
  * This flag is set to indicate that the mutex is shared among processes.
@@ -242,7 +291,8 @@ void pthread_exit(void * retval)
 
 /* Mutex type:
  *
- * We support normal, recursive and errorcheck mutexes.
+ * We support normal, recursive, errorcheck and adaptive mutexes. Adaptive
+ * mutexes behave like normal ones, but spin for a while before sleeping.
  *
  * The constants defined here *cannot* be changed because they must match
  * the C library ABI which defines the following initialization values in
@@ -259,12 +309,14 @@ void pthread_exit(void * retval)
 #define  MUTEX_TYPE_NORMAL          0  /* Must be 0 to match __PTHREAD_MUTEX_INIT_VALUE */
 #define  MUTEX_TYPE_RECURSIVE       1
 #define  MUTEX_TYPE_ERRORCHECK      2
+#define  MUTEX_TYPE_ADAPTIVE        3
 
 #define  MUTEX_TYPE_TO_BITS(t)       FIELD_TO_BITS(t, MUTEX_TYPE_SHIFT, MUTEX_TYPE_LEN)
 
 #define  MUTEX_TYPE_BITS_NORMAL      MUTEX_TYPE_TO_BITS(MUTEX_TYPE_NORMAL)
 #define  MUTEX_TYPE_BITS_RECURSIVE   MUTEX_TYPE_TO_BITS(MUTEX_TYPE_RECURSIVE)
 #define  MUTEX_TYPE_BITS_ERRORCHECK  MUTEX_TYPE_TO_BITS(MUTEX_TYPE_ERRORCHECK)
+#define  MUTEX_TYPE_BITS_ADAPTIVE    MUTEX_TYPE_TO_BITS(MUTEX_TYPE_ADAPTIVE)
 
 /* Mutex owner field:
  *
@@ -300,6 +352,20 @@ void pthread_exit(void * retval)
 #define  MUTEX_OWNER_FROM_BITS(v)    FIELD_FROM_BITS(v,MUTEX_OWNER_SHIFT,MUTEX_OWNER_LEN)
 #define  MUTEX_OWNER_TO_BITS(v)      FIELD_TO_BITS(v,MUTEX_OWNER_SHIFT,MUTEX_OWNER_LEN)
 
+/* Priority-inheritance mutexes:
+ *
+ * The kernel's PI futex protocol needs the whole 32-bit futex word for the
+ * owner's tid and its own flags, which leaves no room for any of the fields
+ * above. So the futex word of a PI mutex lives in gPiMutexTable instead, and
+ * the mutex value itself never changes after initialization: it has the
+ * adaptive type (whose owner field is otherwise always 0) and the index of
+ * its table entry, plus one, in the owner field.
+ */
+#define  MUTEX_IS_PI(v)              (((v) & MUTEX_TYPE_MASK) == MUTEX_TYPE_BITS_ADAPTIVE && \
+                                      MUTEX_OWNER_FROM_BITS(v) != 0)
+#define  MUTEX_PI_INDEX_FROM_BITS(v) (MUTEX_OWNER_FROM_BITS(v) - 1)
+#define  MUTEX_PI_INDEX_TO_BITS(i)   MUTEX_OWNER_TO_BITS((i) + 1)
+
 /* Convenience macros.
  *
  * These are used to form or modify the bit pattern of a given mutex value
@@ -312,9 +378,11 @@ void pthread_exit(void * retval)
  * bits:     name       description
  * 0-3       type       type of mutex
  * 4         shared     process-shared flag
+ * 5         inherit    priority-inheritance protocol flag
  */
-#define  MUTEXATTR_TYPE_MASK   0x000f
-#define  MUTEXATTR_SHARED_MASK 0x0010
+#define  MUTEXATTR_TYPE_MASK    0x000f
+#define  MUTEXATTR_SHARED_MASK  0x0010
+#define  MUTEXATTR_INHERIT_MASK 0x0020
 
 
 int pthread_mutexattr_init(pthread_mutexattr_t *attr)
@@ -343,7 +411,7 @@ int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr, int *type)
         int  atype = (*attr & MUTEXATTR_TYPE_MASK);
 
          if (atype >= PTHREAD_MUTEX_NORMAL &&
-             atype <= PTHREAD_MUTEX_ERRORCHECK) {
+             atype <= PTHREAD_MUTEX_ADAPTIVE_NP) {
             *type = atype;
             return 0;
         }
@@ -354,7 +422,7 @@ int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr, int *type)
 int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type)
 {
     if (attr && type >= PTHREAD_MUTEX_NORMAL &&
-                type <= PTHREAD_MUTEX_ERRORCHECK ) {
+                type <= PTHREAD_MUTEX_ADAPTIVE_NP ) {
         *attr = (*attr & ~MUTEXATTR_TYPE_MASK) | type;
         return 0;
     }
@@ -395,6 +463,36 @@ int pthread_mutexattr_getpshared(pthread_mutexattr_t *attr, int *pshared)
     return 0;
 }
 
+int pthread_mutexattr_setprotocol(pthread_mutexattr_t *attr, int protocol)
+{
+    if (attr == NULL)
+        return EINVAL;
+
+    switch (protocol) {
+    case PTHREAD_PRIO_NONE:
+        *attr &= ~MUTEXATTR_INHERIT_MASK;
+        return 0;
+    case PTHREAD_PRIO_INHERIT:
+        *attr |= MUTEXATTR_INHERIT_MASK;
+        return 0;
+    case PTHREAD_PRIO_PROTECT:
+        return ENOTSUP;
+    }
+    return EINVAL;
+}
+
+int pthread_mutexattr_getprotocol(const pthread_mutexattr_t *attr, int *protocol)
+{
+    if (attr == NULL || protocol == NULL)
+        return EINVAL;
+
+    *protocol = (*attr & MUTEXATTR_INHERIT_MASK) ? PTHREAD_PRIO_INHERIT
+                                                 : PTHREAD_PRIO_NONE;
+    return 0;
+}
+
+static int _pi_mutex_alloc(int type);
+
 int pthread_mutex_init(pthread_mutex_t *mutex,
                        const pthread_mutexattr_t *attr)
 {
@@ -408,6 +506,21 @@ int pthread_mutex_init(pthread_mutex_t *mutex,
         return 0;
     }
 
+    if ((*attr & MUTEXATTR_INHERIT_MASK) != 0) {
+        int index;
+
+        /* gPiMutexTable is private to this process. */
+        if ((*attr & MUTEXATTR_SHARED_MASK) != 0)
+            return ENOTSUP;
+
+        index = _pi_mutex_alloc(*attr & MUTEXATTR_TYPE_MASK);
+        if (index < 0)
+            return (index == -EINVAL) ? EINVAL : EAGAIN;
+
+        mutex->value = MUTEX_TYPE_BITS_ADAPTIVE | MUTEX_PI_INDEX_TO_BITS(index);
+        return 0;
+    }
+
     if ((*attr & MUTEXATTR_SHARED_MASK) != 0)
         value |= MUTEX_SHARED_MASK;
 
@@ -421,6 +534,9 @@ int pthread_mutex_init(pthread_mutex_t *mutex,
     case PTHREAD_MUTEX_ERRORCHECK:
         value |= MUTEX_TYPE_BITS_ERRORCHECK;
         break;
+    case PTHREAD_MUTEX_ADAPTIVE_NP:
+        value |= MUTEX_TYPE_BITS_ADAPTIVE;
+        break;
     default:
         return EINVAL;
     }
@@ -478,6 +594,21 @@ _normal_lock(pthread_mutex_t*  mutex, int shared)
     ANDROID_MEMBAR_FULL();
 }
 
+/*
+ * Lock a private non-recursive mutex, leaving it in state 2 (CONTENDED).
+ * This is what a condition variable waiter uses to reacquire its mutex,
+ * because pthread_cond_broadcast() may have moved other waiters onto the
+ * mutex's futex, and only state 2 guarantees one of them is woken when we
+ * release it.
+ */
+static void
+_normal_lock_contended(pthread_mutex_t* mutex)
+{
+    while (__bionic_swap(MUTEX_STATE_BITS_LOCKED_CONTENDED, &mutex->value) != MUTEX_STATE_BITS_UNLOCKED)
+        __futex_wait_ex(&mutex->value, 0, MUTEX_STATE_BITS_LOCKED_CONTENDED, 0);
+    ANDROID_MEMBAR_FULL();
+}
+
 /*
  * Release a non-recursive mutex.  The caller is responsible for determining
  * that we are in fact the owner of this lock.
@@ -534,6 +665,289 @@ _normal_unlock(pthread_mutex_t*  mutex, int shared)
     }
 }
 
+static int __timespec_to_absolute(struct timespec* ts, const struct timespec* abstime, clockid_t clock);
+
+/*
+ * Lock an adaptive mutex, giving up with EBUSY at 'abstime' (measured
+ * against 'clock') if it is non-NULL.
+ *
+ * This uses the same states as a normal mutex, but when the mutex is held
+ * we first spin for a while, since a short critical section is likely to be
+ * over before a futex wait/wake round trip would be. How long we're willing
+ * to spin adapts to how long we had to spin in the past: we allow twice the
+ * running average (plus a bit, so that it can grow) up to MUTEX_SPINS_MAX.
+ *
+ * The spin estimate lives in the mutex value, so unlike _normal_lock() we
+ * must only ever change the state bits with a cmpxchg.
+ */
+static int
+_adaptive_lock(pthread_mutex_t* mutex, int shared,
+               const struct timespec* abstime, clockid_t clock)
+{
+    int mvalue, newval, spins, max_spins, average;
+    struct timespec ts;
+
+    mvalue = mutex->value;
+    if (MUTEX_STATE_BITS_IS_UNLOCKED(mvalue) &&
+        __bionic_cmpxchg(mvalue, mvalue | MUTEX_STATE_BITS_LOCKED_UNCONTENDED, &mutex->value) == 0) {
+        ANDROID_MEMBAR_FULL();
+        return 0;
+    }
+
+    average = MUTEX_SPINS_FROM_BITS(mvalue);
+    max_spins = average * 2 + 10;
+    if (max_spins > MUTEX_SPINS_MAX)
+        max_spins = MUTEX_SPINS_MAX;
+
+    for (spins = 0; spins < max_spins; spins++) {
+        __bionic_cpu_relax();
+        mvalue = mutex->value;
+        if (MUTEX_STATE_BITS_IS_UNLOCKED(mvalue) &&
+            __bionic_cmpxchg(mvalue, mvalue | MUTEX_STATE_BITS_LOCKED_UNCONTENDED, &mutex->value) == 0) {
+            goto acquired;
+        }
+    }
+
+    /* We've spun long enough, sleep until the mutex is released. Since we
+     * know there is contention, we take the mutex in state 2 to ensure that
+     * any other waiters get woken up when we release it.
+     */
+    for (;;) {
+        mvalue = mutex->value;
+        if (MUTEX_STATE_BITS_IS_UNLOCKED(mvalue)) {
+            if (__bionic_cmpxchg(mvalue, mvalue | MUTEX_STATE_BITS_LOCKED_CONTENDED, &mutex->value) == 0)
+                break;
+            continue;
+        }
+
+        if (MUTEX_STATE_BITS_IS_LOCKED_UNCONTENDED(mvalue)) {
+            newval = MUTEX_STATE_BITS_FLIP_CONTENTION(mvalue);
+            if (__bionic_cmpxchg(mvalue, newval, &mutex->value) != 0)
+                continue;
+            mvalue = newval;
+        }
+
+        if (abstime != NULL) {
+            if (__timespec_to_absolute(&ts, abstime, clock) < 0)
+                return EBUSY;
+            if (__futex_wait_ex(&mutex->value, shared, mvalue, &ts) == -ETIMEDOUT)
+                return EBUSY;
+        } else {
+            __futex_wait_ex(&mutex->value, shared, mvalue, NULL);
+        }
+    }
+
+acquired:
+    ANDROID_MEMBAR_FULL();
+
+    /* Update the running average. We own the mutex, so nobody else can
+     * change the estimate, but waiters can still change the state bits.
+     */
+    newval = average + (spins - average) / 8;
+    if (newval != average) {
+        do {
+            mvalue = mutex->value;
+        } while (__bionic_cmpxchg(mvalue, (mvalue & ~MUTEX_SPINS_MASK) | MUTEX_SPINS_TO_BITS(newval),
+                                  &mutex->value) != 0);
+    }
+    return 0;
+}
+
+/*
+ * Release an adaptive mutex. This is _normal_unlock(), except that we
+ * preserve the spin estimate when releasing a contended mutex.
+ */
+static __inline__ void
+_adaptive_unlock(pthread_mutex_t* mutex, int shared)
+{
+    int mvalue;
+
+    ANDROID_MEMBAR_FULL();
+
+    /* The state bits are 1 or 2, so the decrement can't borrow from the others. */
+    if (!MUTEX_STATE_BITS_IS_LOCKED_UNCONTENDED(__bionic_atomic_dec(&mutex->value))) {
+        /* The mutex was contended and is now in state 1, so we still hold
+         * it. Release it for real, then wake one of the waiters.
+         */
+        do {
+            mvalue = mutex->value;
+        } while (__bionic_cmpxchg(mvalue, mvalue & ~MUTEX_STATE_MASK, &mutex->value) != 0);
+
+        __futex_wake_ex(&mutex->value, shared, 1);
+    }
+}
+
+/*
+ * The futex words of priority-inheritance mutexes (see MUTEX_IS_PI).
+ *
+ * The table is made of pages that we map as needed. Free entries are kept
+ * on a list linked through their 'count' field.
+ */
+typedef struct {
+    int volatile  futex;  /* tid of the owner | FUTEX_WAITERS, or 0 if unlocked */
+    int           type;   /* PTHREAD_MUTEX_NORMAL etc., or -1 if free */
+    int           count;  /* recursive locks beyond the first; next free entry if free */
+} pi_mutex_t;
+
+#define PI_MUTEX_TABLE_PAGES  64
+#define PI_MUTEXES_PER_PAGE   (PAGE_SIZE / sizeof(pi_mutex_t))
+
+static pi_mutex_t*      gPiMutexTable[PI_MUTEX_TABLE_PAGES];
+static int              gPiMutexFreeList = -1;
+static pthread_mutex_t  gPiMutexTableLock = PTHREAD_MUTEX_INITIALIZER;
+
+static __inline__ pi_mutex_t*
+_pi_mutex_get(int mvalue)
+{
+    int index = MUTEX_PI_INDEX_FROM_BITS(mvalue);
+    return &gPiMutexTable[index / PI_MUTEXES_PER_PAGE][index % PI_MUTEXES_PER_PAGE];
+}
+
+/* Returns the index of a new unlocked table entry, or a negative errno. */
+static int
+_pi_mutex_alloc(int type)
+{
+    int index = -EAGAIN;
+
+    if (type < PTHREAD_MUTEX_NORMAL || type > PTHREAD_MUTEX_ADAPTIVE_NP)
+        return -EINVAL;
+    /* Spinning doesn't make sense when the kernel hands the lock over. */
+    if (type == PTHREAD_MUTEX_ADAPTIVE_NP)
+        type = PTHREAD_MUTEX_NORMAL;
+
+    _normal_lock(&gPiMutexTableLock, 0);
+    if (gPiMutexFreeList < 0) {
+        /* Find the first page we haven't mapped yet, and put its entries on the free list. */
+        size_t page;
+        for (page = 0; page < PI_MUTEX_TABLE_PAGES && gPiMutexTable[page] != NULL; ++page) {
+        }
+        if (page < PI_MUTEX_TABLE_PAGES) {
+            void* p = mmap(NULL, PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                size_t i = PI_MUTEXES_PER_PAGE;
+                gPiMutexTable[page] = p;
+                while (i-- > 0) {
+                    gPiMutexTable[page][i].type = -1;
+                    gPiMutexTable[page][i].count = gPiMutexFreeList;
+                    gPiMutexFreeList = page * PI_MUTEXES_PER_PAGE + i;
+                }
+            }
+        }
+    }
+    if (gPiMutexFreeList >= 0) {
+        pi_mutex_t* pi;
+        index = gPiMutexFreeList;
+        pi = &gPiMutexTable[index / PI_MUTEXES_PER_PAGE][index % PI_MUTEXES_PER_PAGE];
+        gPiMutexFreeList = pi->count;
+        pi->futex = 0;
+        pi->type = type;
+        pi->count = 0;
+    }
+    _normal_unlock(&gPiMutexTableLock, 0);
+    return index;
+}
+
+static void
+_pi_mutex_free(int mvalue)
+{
+    pi_mutex_t* pi = _pi_mutex_get(mvalue);
+
+    _normal_lock(&gPiMutexTableLock, 0);
+    pi->type = -1;
+    pi->count = gPiMutexFreeList;
+    gPiMutexFreeList = MUTEX_PI_INDEX_FROM_BITS(mvalue);
+    _normal_unlock(&gPiMutexTableLock, 0);
+}
+
+/*
+ * Lock a priority-inheritance mutex, giving up with EBUSY at 'abstime' (a
+ * CLOCK_REALTIME time, which is what FUTEX_LOCK_PI wants) if it is non-NULL.
+ *
+ * An uncontended lock is a 0 -> tid cmpxchg, just like in the kernel. If
+ * that fails we let the kernel queue us in priority order and boost the
+ * owner's priority to ours until it releases the mutex.
+ */
+static int
+_pi_lock(pthread_mutex_t* mutex, const struct timespec* abstime)
+{
+    pi_mutex_t* pi = _pi_mutex_get(mutex->value);
+    int tid = __get_thread()->tid;
+
+    if (__bionic_cmpxchg(0, tid, &pi->futex) == 0) {
+        ANDROID_MEMBAR_FULL();
+        return 0;
+    }
+
+    if ((pi->futex & FUTEX_TID_MASK) == tid) {
+        if (pi->type == PTHREAD_MUTEX_RECURSIVE) {
+            pi->count++;
+            return 0;
+        }
+        /* A normal mutex would deadlock here, which isn't very useful. */
+        return EDEADLK;
+    }
+
+    for (;;) {
+        int saved_errno = errno;
+        int ret = futex(&pi->futex, FUTEX_LOCK_PI_PRIVATE, 0, (void*) abstime, NULL, 0);
+        int err = errno;
+        errno = saved_errno;
+        if (ret == 0)
+            break;
+        if (err == ETIMEDOUT)
+            return EBUSY;
+        if (err != EINTR)
+            return err;
+    }
+    ANDROID_MEMBAR_FULL();
+    return 0;
+}
+
+static int
+_pi_trylock(pthread_mutex_t* mutex)
+{
+    pi_mutex_t* pi = _pi_mutex_get(mutex->value);
+    int tid = __get_thread()->tid;
+
+    if (__bionic_cmpxchg(0, tid, &pi->futex) == 0) {
+        ANDROID_MEMBAR_FULL();
+        return 0;
+    }
+    if ((pi->futex & FUTEX_TID_MASK) == tid && pi->type == PTHREAD_MUTEX_RECURSIVE) {
+        pi->count++;
+        return 0;
+    }
+    return EBUSY;
+}
+
+/*
+ * Release a priority-inheritance mutex. If there are waiters, the kernel
+ * has set FUTEX_WAITERS, our cmpxchg fails, and the kernel has to hand the
+ * mutex over to the highest-priority waiter.
+ */
+static int
+_pi_unlock(pthread_mutex_t* mutex)
+{
+    pi_mutex_t* pi = _pi_mutex_get(mutex->value);
+    int tid = __get_thread()->tid;
+
+    if ((pi->futex & FUTEX_TID_MASK) != tid)
+        return EPERM;
+
+    if (pi->count > 0) {
+        pi->count--;
+        return 0;
+    }
+
+    ANDROID_MEMBAR_FULL();
+    if (__bionic_cmpxchg(tid, 0, &pi->futex) != 0) {
+        int saved_errno = errno;
+        futex(&pi->futex, FUTEX_UNLOCK_PI_PRIVATE, 0, NULL, NULL, 0);
+        errno = saved_errno;
+    }
+    return 0;
+}
+
 /* This common inlined function is used to increment the counter of an
  * errorcheck or recursive mutex.
  *
@@ -584,7 +998,7 @@ _recursive_increment(pthread_mutex_t* mutex, int mvalue, int mtype)
 __LIBC_HIDDEN__
 int pthread_mutex_lock_impl(pthread_mutex_t *mutex)
 {
-    int mvalue, mtype, tid, shared;
+    int mvalue, mtype, tid, shared, spins;
 
     if (__predict_false(mutex == NULL))
         return EINVAL;
@@ -599,6 +1013,12 @@ int pthread_mutex_lock_impl(pthread_mutex_t *mutex)
         return 0;
     }
 
+    if (mtype == MUTEX_TYPE_BITS_ADAPTIVE) {
+        if (MUTEX_IS_PI(mvalue))
+            return _pi_lock(mutex, NULL);
+        return _adaptive_lock(mutex, shared, NULL, 0);
+    }
+
     /* Do we already own this recursive or error-check mutex ? */
     tid = __get_thread()->tid;
     if ( tid == MUTEX_OWNER_FROM_BITS(mvalue) )
@@ -620,6 +1040,22 @@ int pthread_mutex_lock_impl(pthread_mutex_t *mutex)
         mvalue = mutex->value;
     }
 
+    /* The mutex is held by another thread. Spin for a little while in case
+     * it is released soon, which is cheaper than sleeping in the kernel.
+     */
+    for (spins = 0; spins < MUTEX_SPINS_MAX / 2; spins++) {
+        __bionic_cpu_relax();
+        mvalue = mutex->value;
+        if (mvalue == mtype) {
+            int newval = MUTEX_OWNER_TO_BITS(tid) | mtype | MUTEX_STATE_BITS_LOCKED_UNCONTENDED;
+            if (__bionic_cmpxchg(mvalue, newval, &mutex->value) == 0) {
+                ANDROID_MEMBAR_FULL();
+                return 0;
+            }
+        }
+    }
+    mvalue = mutex->value;
+
     for (;;) {
         int newval;
 
@@ -693,6 +1129,13 @@ int pthread_mutex_unlock_impl(pthread_mutex_t *mutex)
         return 0;
     }
 
+    if (mtype == MUTEX_TYPE_BITS_ADAPTIVE) {
+        if (MUTEX_IS_PI(mvalue))
+            return _pi_unlock(mutex);
+        _adaptive_unlock(mutex, shared);
+        return 0;
+    }
+
     /* Do we already own this recursive or error-check mutex ? */
     tid = __get_thread()->tid;
     if ( tid != MUTEX_OWNER_FROM_BITS(mvalue) )
@@ -767,6 +1210,18 @@ int pthread_mutex_trylock_impl(pthread_mutex_t *mutex)
         return EBUSY;
     }
 
+    if (mtype == MUTEX_TYPE_BITS_ADAPTIVE) {
+        if (MUTEX_IS_PI(mvalue))
+            return _pi_trylock(mutex);
+        if (MUTEX_STATE_BITS_IS_UNLOCKED(mvalue) &&
+            __bionic_cmpxchg(mvalue, mvalue | MUTEX_STATE_BITS_LOCKED_UNCONTENDED, &mutex->value) == 0) {
+            ANDROID_MEMBAR_FULL();
+            return 0;
+        }
+
+        return EBUSY;
+    }
+
     /* Do we already own this recursive or error-check mutex ? */
     tid = __get_thread()->tid;
     if ( tid == MUTEX_OWNER_FROM_BITS(mvalue) )
@@ -876,6 +1331,15 @@ int pthread_mutex_lock_timeout_np_impl(pthread_mutex_t *mutex, unsigned msecs)
         return 0;
     }
 
+    if (mtype == MUTEX_TYPE_BITS_ADAPTIVE) {
+        if (MUTEX_IS_PI(mvalue)) {
+            /* FUTEX_LOCK_PI only understands CLOCK_REALTIME. */
+            __timespec_to_relative_msec(&abstime, msecs, CLOCK_REALTIME);
+            return _pi_lock(mutex, &abstime);
+        }
+        return _adaptive_lock(mutex, shared, &abstime, clock);
+    }
+
     /* Do we already own this recursive or error-check mutex ? */
     tid = __get_thread()->tid;
     if ( tid == MUTEX_OWNER_FROM_BITS(mvalue) )
@@ -972,6 +1436,9 @@ int pthread_mutex_destroy(pthread_mutex_t *mutex)
     if (ret != 0)
         return ret;
 
+    if (MUTEX_IS_PI(mutex->value))
+        _pi_mutex_free(mutex->value);
+
     mutex->value = 0xdead10cc;
     return 0;
 }
@@ -1035,6 +1502,109 @@ int pthread_condattr_destroy(pthread_condattr_t *attr)
  * XXX then the signal will be lost.
  */
 
+/* A pthread_cond_t has no room to remember its mutex, which
+ * pthread_cond_broadcast needs to requeue the waiters onto it. Waiters
+ * publish their mutex in this small table, hashed by condition variable,
+ * while they're blocked. A slot only describes one condition variable at
+ * a time, so waiters on a colliding condition variable just don't publish,
+ * and a broadcast to them falls back to waking everybody.
+ *
+ * Only private condition variables waited on with a private normal mutex
+ * are published, since that's the only kind of mutex that we know how to
+ * reacquire in the state requeueing needs (see _normal_lock_contended).
+ * A waiter that couldn't publish because of a collision may still be
+ * requeued by a later waiter's broadcast, so every waiter that could have
+ * been reacquires its mutex that way too.
+ */
+#define COND_MUTEX_TABLE_SIZE  64
+
+typedef struct {
+    pthread_mutex_t   lock;
+    pthread_cond_t*   cond;
+    pthread_mutex_t*  mutex;
+    int               waiters;
+} cond_mutex_slot_t;
+
+static cond_mutex_slot_t gCondMutexTable[COND_MUTEX_TABLE_SIZE];
+
+static cond_mutex_slot_t*
+__cond_mutex_slot(pthread_cond_t* cond)
+{
+    return &gCondMutexTable[((uintptr_t) cond / sizeof(*cond)) % COND_MUTEX_TABLE_SIZE];
+}
+
+/* Returns 1 if a broadcast could requeue a waiter on 'cond' onto 'mutex', in
+ * which case the waiter must reacquire 'mutex' with _normal_lock_contended.
+ */
+static int
+__cond_can_requeue(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    return !COND_IS_SHARED(cond) && mutex != NULL &&
+        (mutex->value & (MUTEX_TYPE_MASK|MUTEX_SHARED_MASK)) == MUTEX_TYPE_BITS_NORMAL;
+}
+
+/* Returns 1 if the waiter's mutex was published, in which case the caller
+ * must call __cond_unpublish_mutex after waiting.
+ */
+static int
+__cond_publish_mutex(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    cond_mutex_slot_t* slot;
+    int published = 0;
+
+    slot = __cond_mutex_slot(cond);
+    _normal_lock(&slot->lock, 0);
+    if (slot->waiters == 0) {
+        slot->cond = cond;
+        slot->mutex = mutex;
+    }
+    if (slot->cond == cond && slot->mutex == mutex) {
+        slot->waiters++;
+        published = 1;
+    }
+    _normal_unlock(&slot->lock, 0);
+    return published;
+}
+
+static void
+__cond_unpublish_mutex(pthread_cond_t* cond)
+{
+    cond_mutex_slot_t* slot = __cond_mutex_slot(cond);
+
+    _normal_lock(&slot->lock, 0);
+    slot->waiters--;
+    _normal_unlock(&slot->lock, 0);
+}
+
+/* Wake one waiter on 'cond' and move the others onto the futex of their
+ * mutex, so that they're woken one at a time as it gets unlocked instead of
+ * all fighting for it at once. 'value' is what we just set cond->value to;
+ * if it has changed since, the kernel refuses and we return 0 so that the
+ * caller can wake everybody instead. The slot stays locked during the
+ * requeue so that the published waiters, and hence their mutex, can't go
+ * away under us.
+ */
+static int
+__cond_requeue(pthread_cond_t* cond, int value)
+{
+    cond_mutex_slot_t* slot;
+    int requeued = 0;
+
+    if (COND_IS_SHARED(cond))
+        return 0;
+
+    slot = __cond_mutex_slot(cond);
+    _normal_lock(&slot->lock, 0);
+    if (slot->waiters > 0 && slot->cond == cond) {
+        int saved_errno = errno;
+        requeued = (futex(&cond->value, FUTEX_CMP_REQUEUE_PRIVATE, 1, (void*) INT_MAX,
+                          &slot->mutex->value, value) != -1);
+        errno = saved_errno;
+    }
+    _normal_unlock(&slot->lock, 0);
+    return requeued;
+}
+
 int pthread_cond_init(pthread_cond_t *cond,
                       const pthread_condattr_t *attr)
 {
@@ -1066,6 +1636,7 @@ static int
 __pthread_cond_pulse(pthread_cond_t *cond, int  counter)
 {
     long flags;
+    long newval;
 
     if (__predict_false(cond == NULL))
         return EINVAL;
@@ -1073,8 +1644,8 @@ __pthread_cond_pulse(pthread_cond_t *cond, int  counter)
     flags = (cond->value & ~COND_COUNTER_MASK);
     for (;;) {
         long oldval = cond->value;
-        long newval = ((oldval - COND_COUNTER_INCREMENT) & COND_COUNTER_MASK)
-                      | flags;
+        newval = ((oldval - COND_COUNTER_INCREMENT) & COND_COUNTER_MASK)
+                 | flags;
         if (__bionic_cmpxchg(oldval, newval, &cond->value) == 0)
             break;
     }
@@ -1091,6 +1662,9 @@ __pthread_cond_pulse(pthread_cond_t *cond, int  counter)
      */
     ANDROID_MEMBAR_FULL();
 
+    if (counter == INT_MAX && __cond_requeue(cond, newval))
+        return 0;
+
     __futex_wake_ex(&cond->value, COND_IS_SHARED(cond), counter);
     return 0;
 }
@@ -1116,10 +1690,23 @@ int __pthread_cond_timedwait_relative(pthread_cond_t *cond,
 {
     int  status;
     int  oldvalue = cond->value;
+    int  requeueable = __cond_can_requeue(cond, mutex);
+    int  published = requeueable && __cond_publish_mutex(cond, mutex);
 
     pthread_mutex_unlock(mutex);
     status = __futex_wait_ex(&cond->value, COND_IS_SHARED(cond), oldvalue, reltime);
-    pthread_mutex_lock(mutex);
+    if (published)
+        __cond_unpublish_mutex(cond);
+    if (requeueable) {
+        _normal_lock_contended(mutex);
+#ifdef PTHREAD_DEBUG
+        if (PTHREAD_DEBUG_ENABLED) {
+            pthread_debug_mutex_lock_check(mutex);
+        }
+#endif
+    } else {
+        pthread_mutex_lock(mutex);
+    }
 
     if (status == (-ETIMEDOUT)) return ETIMEDOUT;
     return 0;
@@ -21,15 +21,14 @@
 
 #include "pthread_internal.h"
 
+// Looks up a pthread_t, and keeps the thread from going away (and its state
+// from changing) until Unlock or destruction. See _pthread_internal_lock.
 class pthread_accessor {
  public:
   explicit pthread_accessor(pthread_t desired_thread) {
+    mutex_ = _pthread_internal_lock(desired_thread);
     Lock();
-    for (thread_ = gThreadList; thread_ != NULL; thread_ = thread_->next) {
-      if (thread_ == reinterpret_cast<pthread_internal_t*>(desired_thread)) {
-        break;
-      }
-    }
+    thread_ = _pthread_internal_find_locked(desired_thread);
   }
 
   ~pthread_accessor() {
@@ -40,7 +39,7 @@ class pthread_accessor {
     if (is_locked_) {
       is_locked_ = false;
       thread_ = NULL;
-      pthread_mutex_unlock(&gThreadListLock);
+      pthread_mutex_unlock(mutex_);
     }
   }
 
@@ -48,12 +47,16 @@ class pthread_accessor {
   pthread_internal_t* operator->() const { return thread_; }
   pthread_internal_t* get() const { return thread_; }
 
+  // The lock held while the accessor is locked, for waiting on the thread's join_cond.
+  pthread_mutex_t* mutex() const { return mutex_; }
+
  private:
   pthread_internal_t* thread_;
+  pthread_mutex_t* mutex_;
   bool is_locked_;
 
   void Lock() {
-    pthread_mutex_lock(&gThreadListLock);
+    pthread_mutex_lock(mutex_);
     is_locked_ = true;
   }
 
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+
+#include <errno.h>
+#include <limits.h>
+
+#include "private/bionic_atomic_inline.h"
+#include "private/bionic_futex.h"
+
+// A sense-reversing barrier. 'sequence' plays the part of the sense flag:
+// each thread notes it on arrival, and the last thread to arrive resets
+// 'arrived' for the next phase and then bumps 'sequence', releasing every
+// waiter with a single futex wake. Waiters sleep on 'sequence' itself, so a
+// thread that arrives just as the barrier opens doesn't sleep at all.
+//
+// The thread told it was last may destroy (and free) the barrier straight
+// away, while the others are still on their way out. So it adds them to
+// 'leaving' before opening the barrier, each of them drops out of 'leaving'
+// as its last touch of the barrier, and pthread_barrier_destroy waits for
+// 'leaving' to reach zero.
+
+// Set in 'leaving' while pthread_barrier_destroy waits for it to drain.
+#define BARRIER_DESTROY_WAITING 0x40000000
+
+int pthread_barrierattr_init(pthread_barrierattr_t* attr) {
+  *attr = PTHREAD_PROCESS_PRIVATE;
+  return 0;
+}
+
+int pthread_barrierattr_destroy(pthread_barrierattr_t* attr) {
+  *attr = -1;
+  return 0;
+}
+
+int pthread_barrierattr_setpshared(pthread_barrierattr_t* attr, int pshared) {
+  if (pshared != PTHREAD_PROCESS_PRIVATE && pshared != PTHREAD_PROCESS_SHARED) {
+    return EINVAL;
+  }
+  *attr = pshared;
+  return 0;
+}
+
+int pthread_barrierattr_getpshared(const pthread_barrierattr_t* attr, int* pshared) {
+  *pshared = *attr;
+  return 0;
+}
+
+int pthread_barrier_init(pthread_barrier_t* barrier, const pthread_barrierattr_t* attr,
+                         unsigned count) {
+  if (count == 0 || count > INT_MAX) {
+    return EINVAL;
+  }
+  barrier->sequence = 0;
+  barrier->arrived = 0;
+  barrier->leaving = 0;
+  barrier->count = count;
+  barrier->attr = (attr != NULL) ? *attr : PTHREAD_PROCESS_PRIVATE;
+  return 0;
+}
+
+int pthread_barrier_destroy(pthread_barrier_t* barrier) {
+  if (barrier->arrived != 0) {
+    return EBUSY;
+  }
+
+  int shared = (barrier->attr == PTHREAD_PROCESS_SHARED);
+  for (;;) {
+    int leaving = barrier->leaving;
+    if ((leaving & ~BARRIER_DESTROY_WAITING) == 0) {
+      break;
+    }
+    if ((leaving & BARRIER_DESTROY_WAITING) == 0 &&
+        __bionic_cmpxchg(leaving, leaving | BARRIER_DESTROY_WAITING, &barrier->leaving) != 0) {
+      continue;
+    }
+    __futex_wait_ex(&barrier->leaving, shared, leaving | BARRIER_DESTROY_WAITING, NULL);
+  }
+  barrier->leaving = 0;
+  barrier->count = 0;
+  return 0;
+}
+
+int pthread_barrier_wait(pthread_barrier_t* barrier) {
+  int shared = (barrier->attr == PTHREAD_PROCESS_SHARED);
+
+  // Note the phase before arriving: it can't end without us.
+  int sequence = barrier->sequence;
+  ANDROID_MEMBAR_FULL();
+
+  if (static_cast<unsigned>(__bionic_atomic_inc(&barrier->arrived)) + 1 == barrier->count) {
+    // Everyone else is waiting for 'sequence' to change, so nobody
+    // can touch 'arrived' until we open the barrier.
+    barrier->arrived = 0;
+    // Waiters from the previous phase may still be leaving, so add to 'leaving' atomically.
+    int others = barrier->count - 1;
+    if (others != 0) {
+      int leaving;
+      do {
+        leaving = barrier->leaving;
+      } while (__bionic_cmpxchg(leaving, leaving + others, &barrier->leaving) != 0);
+    }
+    ANDROID_MEMBAR_FULL();
+    __bionic_atomic_inc(&barrier->sequence);
+    __futex_wake_ex(&barrier->sequence, shared, INT_MAX);
+    return PTHREAD_BARRIER_SERIAL_THREAD;
+  }
+
+  while (barrier->sequence == sequence) {
+    __futex_wait_ex(&barrier->sequence, shared, sequence, NULL);
+  }
+  ANDROID_MEMBAR_FULL();
+  // The barrier may be destroyed as soon as we've left, so this is our last look at it.
+  // A wake on memory that's been freed meanwhile is harmless.
+  if (__bionic_atomic_dec(&barrier->leaving) == (BARRIER_DESTROY_WAITING | 1)) {
+    __futex_wake_ex(&barrier->leaving, shared, 1);
+  }
+  return 0;
+}
@@ -30,6 +30,7 @@
 
 #include <errno.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include "pthread_internal.h"
 
@@ -51,9 +52,35 @@ extern "C" int __pthread_clone(void* (*fn)(void*), void* child_stack, int flags,
 extern "C" void ATTRIBUTES _thread_created_hook(pid_t thread_id);
 
 extern "C" int __set_tls(void* ptr);
+extern "C" int __set_tid_address(volatile int* tid_address);
+extern "C" void _exit_thread(int status);
 
 static pthread_mutex_t gPthreadStackCreationLock = PTHREAD_MUTEX_INITIALIZER;
 
+// The stacks (with their guard regions) and signal stacks of exited threads,
+// kept for reuse so that programs that create lots of short-lived threads
+// don't pay for an mmap, an mprotect, and another mmap per thread, plus the
+// munmaps and TLB shootdowns when each one exits.
+//
+// A thread can't unmap the stack it's running on, and neither can it hand
+// that stack to another thread before it has stopped using it. So an exiting
+// thread files its stacks here with 'exiting_tid' set to its tid, and asks the
+// kernel to clear that word once it's gone (which is what set_tid_address
+// does). Only entries with a zero 'exiting_tid' may be reused.
+//
+// Protected by gPthreadStackCreationLock.
+#define THREAD_STACK_CACHE_SIZE 16
+
+struct thread_stack_cache_entry {
+  void* stack_base; // NULL if the entry is unused.
+  size_t stack_size;
+  size_t guard_size;
+  void* signal_stack;
+  volatile int exiting_tid;
+};
+
+static thread_stack_cache_entry gThreadStackCache[THREAD_STACK_CACHE_SIZE];
+
 static pthread_mutex_t gDebuggerNotificationLock = PTHREAD_MUTEX_INITIALIZER;
 
 void  __init_tls(pthread_internal_t* thread) {
@@ -70,10 +97,13 @@ void  __init_tls(pthread_internal_t* thread) {
 
   __set_tls(thread->tls);
 
-  // Create and set an alternate signal stack.
+  // Create and set an alternate signal stack, unless pthread_create found one in the cache.
   // This must happen after __set_tls, in case a system call fails and tries to set errno.
   stack_t ss;
-  ss.ss_sp = mmap(NULL, SIGSTKSZ, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+  ss.ss_sp = thread->alternate_signal_stack;
+  if (ss.ss_sp == NULL) {
+    ss.ss_sp = mmap(NULL, SIGSTKSZ, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, 0, 0);
+  }
   if (ss.ss_sp != MAP_FAILED) {
     ss.ss_size = SIGSTKSZ;
     ss.ss_flags = 0;
@@ -111,6 +141,19 @@ int _init_thread(pthread_internal_t* thread, bool add_to_thread_list) {
 static void* __create_thread_stack(pthread_internal_t* thread) {
   ScopedPthreadMutexLocker lock(&gPthreadStackCreationLock);
 
+  // Reuse the stack of an exited thread if we have one of the right shape.
+  for (size_t i = 0; i < THREAD_STACK_CACHE_SIZE; ++i) {
+    thread_stack_cache_entry* entry = &gThreadStackCache[i];
+    if (entry->stack_base != NULL && entry->exiting_tid == 0 &&
+        entry->stack_size == thread->attr.stack_size &&
+        entry->guard_size == thread->attr.guard_size) {
+      void* stack = entry->stack_base;
+      thread->alternate_signal_stack = entry->signal_stack;
+      entry->stack_base = NULL;
+      return stack;
+    }
+  }
+
   // Create a new private anonymous map.
   int prot = PROT_READ | PROT_WRITE;
   int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
@@ -135,6 +178,58 @@ static void* __create_thread_stack(pthread_internal_t* thread) {
   return stack;
 }
 
+// Called by pthread_exit, with all signals blocked, once the thread is done with
+// its signal stack and pthread_internal_t. Files the thread's stacks in the cache
+// and exits. Returns if the cache has no room, leaving the caller to unmap them.
+void __cache_thread_stack_and_exit(void* stack_base, size_t stack_size, size_t guard_size,
+                                   void* signal_stack) {
+  thread_stack_cache_entry* entry = NULL;
+  thread_stack_cache_entry evicted;
+  evicted.stack_base = NULL;
+  {
+    ScopedPthreadMutexLocker lock(&gPthreadStackCreationLock);
+    // Prefer an unused entry, then the first reusable one, whose stacks we free instead.
+    for (size_t i = 0; i < THREAD_STACK_CACHE_SIZE; ++i) {
+      thread_stack_cache_entry* e = &gThreadStackCache[i];
+      if (e->stack_base == NULL) {
+        entry = e;
+        break;
+      }
+      if (entry == NULL && e->exiting_tid == 0) {
+        entry = e;
+      }
+    }
+    if (entry == NULL) {
+      return;
+    }
+    if (entry->stack_base != NULL) {
+      evicted = *entry;
+    }
+    entry->stack_base = stack_base;
+    entry->stack_size = stack_size;
+    entry->guard_size = guard_size;
+    entry->signal_stack = signal_stack;
+    entry->exiting_tid = gettid();
+  }
+
+  if (evicted.stack_base != NULL) {
+    munmap(evicted.stack_base, evicted.stack_size);
+    if (evicted.signal_stack != NULL) {
+      munmap(evicted.signal_stack, SIGSTKSZ);
+    }
+  }
+
+  __set_tid_address(&entry->exiting_tid);
+  _exit_thread(0);
+}
+
+// In a fork child, the threads whose stacks were still being given up are gone.
+void __thread_stack_cache_after_fork() {
+  for (size_t i = 0; i < THREAD_STACK_CACHE_SIZE; ++i) {
+    gThreadStackCache[i].exiting_tid = 0;
+  }
+}
+
 int pthread_create(pthread_t* thread_out, pthread_attr_t const* attr,
                    void* (*start_routine)(void*), void* arg) {
   ErrnoRestorer errno_restorer;
@@ -203,6 +298,9 @@ int pthread_create(pthread_t* thread_out, pthread_attr_t const* attr,
     if ((thread->attr.flags & PTHREAD_ATTR_FLAG_USER_STACK) == 0) {
       munmap(thread->attr.stack_base, thread->attr.stack_size);
     }
+    if (thread->alternate_signal_stack != NULL) {
+      munmap(thread->alternate_signal_stack, SIGSTKSZ);
+    }
     free(thread);
     __libc_format_log(ANDROID_LOG_WARN, "libc", "pthread_create failed: clone failed: %s", strerror(errno));
     return clone_errno;
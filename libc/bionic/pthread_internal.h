@@ -30,14 +30,18 @@
 
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/cdefs.h>
 
+#include "private/bionic_tls.h"
+
 __BEGIN_DECLS
 
 typedef struct pthread_internal_t
 {
     struct pthread_internal_t*  next;
     struct pthread_internal_t*  prev;
+    struct pthread_internal_t*  hash_next;   /* next in the same gThreadTable bucket */
     pthread_attr_t              attr;
     pid_t                       tid;
     bool                        allocated_on_heap;
@@ -47,8 +51,20 @@ typedef struct pthread_internal_t
     __pthread_cleanup_t*        cleanup_stack;
     void**                      tls;         /* thread-local storage area */
 
+    /* Values of the keys beyond BIONIC_TLS_SLOTS, allocated on demand (see pthread_key.cpp). */
+    void**                      tls_dynamic[BIONIC_TLS_DYNAMIC_KEYS / BIONIC_TLS_DYNAMIC_BLOCK_SIZE];
+
+    /* Keys given a value with a destructor by pthread_setspecific (see pthread_key.cpp). */
+    uint32_t tls_key_dirty[(BIONIC_TLS_KEYS + 31) / 32];
+
     void* alternate_signal_stack;
 
+    /* How many times this thread holds the dynamic linker's read lock (see linker/linker.cpp). */
+    int dl_read_lock_count;
+
+    /* Small chunks this thread has freed, for malloc to reuse (see bionic/dlmalloc.c). */
+    void* malloc_thread_cache;
+
     /*
      * The dynamic linker implements dlerror(3), which makes it hard for us to implement this
      * per-thread buffer by simply using malloc(3) and free(3).
@@ -63,6 +79,16 @@ void _pthread_internal_add(pthread_internal_t* thread);
 pthread_internal_t* __get_thread(void);
 
 __LIBC_HIDDEN__ void pthread_key_clean_all(void);
+
+/*
+ * Live threads are also kept in a hash table, so that a pthread_t can be
+ * validated without walking gThreadList. Each bucket has its own lock, which
+ * also protects the state (flags, join_cond...) of the threads hashed to it.
+ */
+__LIBC_HIDDEN__ pthread_mutex_t* _pthread_internal_lock(pthread_t thread);
+/* The caller must hold _pthread_internal_lock(thread). Returns NULL if 'thread' isn't live. */
+__LIBC_HIDDEN__ pthread_internal_t* _pthread_internal_find_locked(pthread_t thread);
+/* The caller must hold _pthread_internal_lock(thread), but not gThreadListLock. */
 __LIBC_HIDDEN__ void _pthread_internal_remove_locked(pthread_internal_t* thread);
 
 /* Has the thread been detached by a pthread_join or pthread_detach call? */
@@ -91,8 +117,14 @@ __LIBC_HIDDEN__ void _pthread_internal_remove_locked(pthread_internal_t* thread)
 __LIBC_HIDDEN__ extern pthread_internal_t* gThreadList;
 __LIBC_HIDDEN__ extern pthread_mutex_t gThreadListLock;
 
+/* Reuse of exited threads' stacks (see pthread_create.cpp) */
+__LIBC_HIDDEN__ void __cache_thread_stack_and_exit(void* stack_base, size_t stack_size,
+                                                   size_t guard_size, void* signal_stack);
+__LIBC_HIDDEN__ void __thread_stack_cache_after_fork(void);
+
 /* needed by fork.c */
 extern void __timer_table_start_stop(int  stop);
+extern void __timer_table_after_fork(void);
 extern void __bionic_atfork_run_prepare();
 extern void __bionic_atfork_run_child();
 extern void __bionic_atfork_run_parent();
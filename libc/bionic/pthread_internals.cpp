@@ -34,14 +34,55 @@
 __LIBC_HIDDEN__ pthread_internal_t* gThreadList = NULL;
 __LIBC_HIDDEN__ pthread_mutex_t gThreadListLock = PTHREAD_MUTEX_INITIALIZER;
 
+// gThreadList is only walked by the few functions that really need every
+// thread. Looking up a single pthread_t goes through this table instead,
+// and only locks the bucket it hashes to.
+#define THREAD_TABLE_BITS 8
+#define THREAD_TABLE_SIZE (1 << THREAD_TABLE_BITS)
+
+struct thread_table_bucket {
+  pthread_mutex_t lock;
+  pthread_internal_t* head;
+};
+
+// All zeroes, which is PTHREAD_MUTEX_INITIALIZER for the locks.
+static thread_table_bucket gThreadTable[THREAD_TABLE_SIZE];
+
+static thread_table_bucket* __thread_table_bucket(pthread_t thread) {
+  // Fibonacci hashing, since the low bits of heap pointers are all alike.
+  uint32_t h = static_cast<uint32_t>(thread) * 2654435769U;
+  return &gThreadTable[h >> (32 - THREAD_TABLE_BITS)];
+}
+
+pthread_mutex_t* _pthread_internal_lock(pthread_t thread) {
+  return &__thread_table_bucket(thread)->lock;
+}
+
+pthread_internal_t* _pthread_internal_find_locked(pthread_t thread) {
+  pthread_internal_t* t = __thread_table_bucket(thread)->head;
+  while (t != NULL && t != reinterpret_cast<pthread_internal_t*>(thread)) {
+    t = t->hash_next;
+  }
+  return t;
+}
+
 void _pthread_internal_remove_locked(pthread_internal_t* thread) {
-  if (thread->next != NULL) {
-    thread->next->prev = thread->prev;
+  pthread_internal_t** p = &__thread_table_bucket(reinterpret_cast<pthread_t>(thread))->head;
+  while (*p != thread) {
+    p = &(*p)->hash_next;
   }
-  if (thread->prev != NULL) {
-    thread->prev->next = thread->next;
-  } else {
-    gThreadList = thread->next;
+  *p = thread->hash_next;
+
+  {
+    ScopedPthreadMutexLocker locker(&gThreadListLock);
+    if (thread->next != NULL) {
+      thread->next->prev = thread->prev;
+    }
+    if (thread->prev != NULL) {
+      thread->prev->next = thread->next;
+    } else {
+      gThreadList = thread->next;
+    }
   }
 
   // The main thread is not heap-allocated. See __libc_init_tls for the declaration,
@@ -52,6 +93,12 @@ void _pthread_internal_remove_locked(pthread_internal_t* thread) {
 }
 
 __LIBC_ABI_PRIVATE__ void _pthread_internal_add(pthread_internal_t* thread) {
+  pthread_t t = reinterpret_cast<pthread_t>(thread);
+  ScopedPthreadMutexLocker bucket_locker(_pthread_internal_lock(t));
+  thread_table_bucket* bucket = __thread_table_bucket(t);
+  thread->hash_next = bucket->head;
+  bucket->head = thread;
+
   ScopedPthreadMutexLocker locker(&gThreadListLock);
 
   // We insert at the head.
@@ -51,7 +51,7 @@ int pthread_join(pthread_t t, void** ret_val) {
   // Signal our intention to join, and wait for the thread to exit.
   thread->attr.flags |= PTHREAD_ATTR_FLAG_JOINED;
   while ((thread->attr.flags & PTHREAD_ATTR_FLAG_ZOMBIE) == 0) {
-    pthread_cond_wait(&thread->join_cond, &gThreadListLock);
+    pthread_cond_wait(&thread->join_cond, thread.mutex());
   }
   if (ret_val) {
     *ret_val = thread->return_value;
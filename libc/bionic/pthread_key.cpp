@@ -27,13 +27,16 @@
  */
 
 #include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "private/bionic_atomic_inline.h"
 #include "private/bionic_tls.h"
 #include "pthread_internal.h"
 
 /* A technical note regarding our thread-local-storage (TLS) implementation:
  *
- * There can be up to BIONIC_TLS_SLOTS independent TLS keys in a given process,
+ * There can be up to BIONIC_TLS_KEYS independent TLS keys in a given process,
  * The keys below TLS_SLOT_FIRST_USER_SLOT are reserved for Bionic to hold
  * special thread-specific variables like errno or a pointer to
  * the current thread's descriptor. These entries cannot be accessed through
@@ -43,28 +46,55 @@
  * currently created/allocated TLS keys and the destructors associated
  * with them.
  *
- * The global TLS map simply contains a bitmap of allocated keys, and
- * an array of destructors.
+ * The global TLS map contains a sequence number for each key, which is odd
+ * iff the key is allocated, an array of destructors, and a list of free keys.
  *
  * Each thread has a TLS area that is a simple array of BIONIC_TLS_SLOTS void*
  * pointers. the TLS area of the main thread is stack-allocated in
  * __libc_init_common, while the TLS area of other threads is placed at
  * the top of their stack in pthread_create.
  *
- * When pthread_key_delete() is called it will erase the key's bitmap bit
- * and its destructor, and will also clear the key data in the TLS area of
+ * The values of the keys beyond BIONIC_TLS_SLOTS ("dynamic" keys) are kept in
+ * blocks of BIONIC_TLS_DYNAMIC_BLOCK_SIZE pointers, which a thread allocates
+ * the first time it sets one of their keys (pthread_internal_t::tls_dynamic),
+ * and frees when it exits. Keys are handed out from the TLS area first, so
+ * that most programs only ever use the single-load pthread_getspecific path.
+ *
+ * Each thread also has a bitmap of the keys it gave a non-NULL value with a
+ * destructor (pthread_internal_t::tls_key_dirty), so that it only needs to
+ * look at those when it exits.
+ *
+ * When pthread_key_delete() is called it will free the key and erase
+ * its destructor, and will also clear the key data in the TLS area of
  * all created threads. As mandated by Posix, it is the responsibility of
  * the caller of pthread_key_delete() to properly reclaim the objects that
  * were pointed to by these data fields (either before or after the call).
  */
 
 #define TLSMAP_BITS       32
-#define TLSMAP_WORDS      ((BIONIC_TLS_SLOTS+TLSMAP_BITS-1)/TLSMAP_BITS)
-#define TLSMAP_WORD(m,k)  (m).map[(k)/TLSMAP_BITS]
+#define TLSMAP_WORDS      ((BIONIC_TLS_KEYS+TLSMAP_BITS-1)/TLSMAP_BITS)
+#define TLSMAP_WORD(m,k)  (m)[(k)/TLSMAP_BITS]
 #define TLSMAP_MASK(k)    (1U << ((k)&(TLSMAP_BITS-1)))
 
 static inline bool IsValidUserKey(pthread_key_t key) {
-  return (key >= TLS_SLOT_FIRST_USER_SLOT && key < BIONIC_TLS_SLOTS);
+  return (key >= TLS_SLOT_FIRST_USER_SLOT && key < BIONIC_TLS_KEYS);
+}
+
+static inline bool IsDynamicKey(pthread_key_t key) {
+  return (key >= BIONIC_TLS_SLOTS);
+}
+
+#define DYNAMIC_KEY_BLOCK(k)  (((k) - BIONIC_TLS_SLOTS) / BIONIC_TLS_DYNAMIC_BLOCK_SIZE)
+#define DYNAMIC_KEY_INDEX(k)  (((k) - BIONIC_TLS_SLOTS) % BIONIC_TLS_DYNAMIC_BLOCK_SIZE)
+
+// Returns where 'thread' keeps the value of 'key', or NULL for a
+// dynamic key whose block the thread hasn't allocated.
+static inline void** GetValueSlot(pthread_internal_t* thread, pthread_key_t key) {
+  if (!IsDynamicKey(key)) {
+    return &thread->tls[key];
+  }
+  void** block = thread->tls_dynamic[DYNAMIC_KEY_BLOCK(key)];
+  return (block != NULL) ? &block[DYNAMIC_KEY_INDEX(key)] : NULL;
 }
 
 typedef void (*key_destructor_t)(void*);
@@ -72,10 +102,18 @@ typedef void (*key_destructor_t)(void*);
 struct tls_map_t {
   bool is_initialized;
 
-  /* bitmap of allocated keys */
-  uint32_t map[TLSMAP_WORDS];
+  /* odd iff the key is allocated, incremented by each create/delete */
+  uint32_t volatile key_sequence[BIONIC_TLS_KEYS];
+
+  key_destructor_t volatile key_destructors[BIONIC_TLS_KEYS];
 
-  key_destructor_t key_destructors[BIONIC_TLS_SLOTS];
+  /* keys above this one have never been allocated */
+  int next_unused_key;
+
+  /* deleted keys, most recent first, linked through 'next_free_key':
+   * one list for the TLS area, one for dynamic keys */
+  int first_free_key[2];
+  int next_free_key[BIONIC_TLS_KEYS];
 };
 
 class ScopedTlsMapAccess {
@@ -85,14 +123,12 @@ class ScopedTlsMapAccess {
 
     // If this is the first time the TLS map has been accessed,
     // mark the slots belonging to well-known keys as being in use.
-    // This isn't currently necessary because the well-known keys
-    // can only be accessed directly by bionic itself, do not have
-    // destructors, and all the functions that touch the TLS map
-    // start after the maximum well-known slot.
     if (!s_tls_map_.is_initialized) {
       for (pthread_key_t key = 0; key < TLS_SLOT_FIRST_USER_SLOT; ++key) {
         SetInUse(key, NULL);
       }
+      s_tls_map_.next_unused_key = TLS_SLOT_FIRST_USER_SLOT;
+      s_tls_map_.first_free_key[0] = s_tls_map_.first_free_key[1] = -1;
       s_tls_map_.is_initialized = true;
     }
   }
@@ -102,49 +138,94 @@ class ScopedTlsMapAccess {
   }
 
   int CreateKey(pthread_key_t* result, void (*key_destructor)(void*)) {
-    // Take the first unallocated key.
-    for (int key = 0; key < BIONIC_TLS_SLOTS; ++key) {
-      if (!IsInUse(key)) {
-        SetInUse(key, key_destructor);
-        *result = key;
-        return 0;
-      }
+    // Prefer a slot in the TLS area, then a dynamic key.
+    int key;
+    if (s_tls_map_.first_free_key[0] != -1) {
+      key = PopFreeKey(0);
+    } else if (s_tls_map_.next_unused_key < BIONIC_TLS_SLOTS) {
+      key = s_tls_map_.next_unused_key++;
+    } else if (s_tls_map_.first_free_key[1] != -1) {
+      key = PopFreeKey(1);
+    } else if (s_tls_map_.next_unused_key < BIONIC_TLS_KEYS) {
+      key = s_tls_map_.next_unused_key++;
+    } else {
+      // We hit PTHREAD_KEYS_MAX. POSIX says EAGAIN for this case.
+      return EAGAIN;
     }
 
-    // We hit PTHREAD_KEYS_MAX. POSIX says EAGAIN for this case.
-    return EAGAIN;
+    SetInUse(key, key_destructor);
+    *result = key;
+    return 0;
   }
 
   void DeleteKey(pthread_key_t key) {
-    TLSMAP_WORD(s_tls_map_, key) &= ~TLSMAP_MASK(key);
+    s_tls_map_.key_sequence[key]++;
+    ANDROID_MEMBAR_FULL();
     s_tls_map_.key_destructors[key] = NULL;
+
+    int list = IsDynamicKey(key) ? 1 : 0;
+    s_tls_map_.next_free_key[key] = s_tls_map_.first_free_key[list];
+    s_tls_map_.first_free_key[list] = key;
   }
 
   bool IsInUse(pthread_key_t key) {
-    return (TLSMAP_WORD(s_tls_map_, key) & TLSMAP_MASK(key)) != 0;
+    return (s_tls_map_.key_sequence[key] & 1) != 0;
+  }
+
+  key_destructor_t GetDestructor(pthread_key_t key) {
+    return s_tls_map_.key_destructors[key];
   }
 
   void SetInUse(pthread_key_t key, void (*key_destructor)(void*)) {
-    TLSMAP_WORD(s_tls_map_, key) |= TLSMAP_MASK(key);
     s_tls_map_.key_destructors[key] = key_destructor;
+    ANDROID_MEMBAR_FULL();
+    s_tls_map_.key_sequence[key]++;
   }
 
   // Called from pthread_exit() to remove all TLS key data
   // from this thread's TLS area. This must call the destructor of all keys
   // that have a non-NULL data value and a non-NULL destructor.
-  void CleanAll() {
-    void** tls = __get_tls();
+  //
+  // This doesn't take the TLS map lock: only the keys marked in the
+  // thread's bitmap are looked at, and the sequence number of each of
+  // these keys tells whether its value and destructor were read while the
+  // key was being deleted (or deleted and created again).
+  static void CleanAll() {
+    pthread_internal_t* thread = __get_thread();
+    uint32_t* dirty_map = thread->tls_key_dirty;
 
     // Because destructors can do funky things like deleting/creating other
     // keys, we need to implement this in a loop.
     for (int rounds = PTHREAD_DESTRUCTOR_ITERATIONS; rounds > 0; --rounds) {
       size_t called_destructor_count = 0;
-      for (int key = 0; key < BIONIC_TLS_SLOTS; ++key) {
-        if (IsInUse(key)) {
-          void* data = tls[key];
+      for (int word = 0; word < TLSMAP_WORDS; ++word) {
+        // Destructors that call pthread_setspecific will mark their keys
+        // again, for the next round.
+        uint32_t dirty = dirty_map[word];
+        dirty_map[word] = 0;
+
+        while (dirty != 0) {
+          int key = word * TLSMAP_BITS + __builtin_ctz(dirty);
+          dirty &= dirty - 1;
+
+          // Read the sequence number before the value: if the key is deleted and
+          // created again meanwhile, the value may belong to the old key, and the
+          // changed sequence number tells us not to hand it to the new destructor.
+          uint32_t sequence = s_tls_map_.key_sequence[key];
+          ANDROID_MEMBAR_FULL();
+          void** slot = GetValueSlot(thread, key);
+          void* data = *slot;
           void (*key_destructor)(void*) = s_tls_map_.key_destructors[key];
+          ANDROID_MEMBAR_FULL();
+          if ((sequence & 1) == 0 || sequence != s_tls_map_.key_sequence[key]) {
+            // The key was deleted, and pthread_key_delete is clearing its data.
+            continue;
+          }
+          if (data == NULL) {
+            continue;
+          }
 
-          if (data != NULL && key_destructor != NULL) {
+          if (key_destructor != NULL) {
             // we need to clear the key data now, this will prevent the
             // destructor (or a later one) from seeing the old value if
             // it calls pthread_getspecific() for some odd reason
@@ -152,14 +233,9 @@ class ScopedTlsMapAccess {
             // we do not do this if 'key_destructor == NULL' just in case another
             // destructor function might be responsible for manually
             // releasing the corresponding data.
-            tls[key] = NULL;
+            *slot = NULL;
 
-            // because the destructor is free to call pthread_key_create
-            // and/or pthread_key_delete, we need to temporarily unlock
-            // the TLS map
-            Unlock();
             (*key_destructor)(data);
-            Lock();
             ++called_destructor_count;
           }
         }
@@ -170,10 +246,26 @@ class ScopedTlsMapAccess {
         break;
       }
     }
+
+    // Free the dynamic key blocks. pthread_key_delete may be writing to them.
+    void** blocks[BIONIC_TLS_DYNAMIC_KEYS / BIONIC_TLS_DYNAMIC_BLOCK_SIZE];
+    pthread_mutex_lock(&gThreadListLock);
+    memcpy(blocks, thread->tls_dynamic, sizeof(blocks));
+    memset(thread->tls_dynamic, 0, sizeof(thread->tls_dynamic));
+    pthread_mutex_unlock(&gThreadListLock);
+    for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); ++i) {
+      free(blocks[i]);
+    }
   }
 
  private:
   static tls_map_t s_tls_map_;
+
+  int PopFreeKey(int list) {
+    int key = s_tls_map_.first_free_key[list];
+    s_tls_map_.first_free_key[list] = s_tls_map_.next_free_key[key];
+    return key;
+  }
   static pthread_mutex_t s_tls_map_lock_;
 
   void Lock() {
@@ -189,8 +281,7 @@ __LIBC_HIDDEN__ tls_map_t ScopedTlsMapAccess::s_tls_map_;
 __LIBC_HIDDEN__ pthread_mutex_t ScopedTlsMapAccess::s_tls_map_lock_;
 
 __LIBC_HIDDEN__ void pthread_key_clean_all() {
-  ScopedTlsMapAccess tls_map;
-  tls_map.CleanAll();
+  ScopedTlsMapAccess::CleanAll();
 }
 
 int pthread_key_create(pthread_key_t* key, void (*key_destructor)(void*)) {
@@ -222,7 +313,10 @@ int pthread_key_delete(pthread_key_t key) {
       continue;
     }
 
-    t->tls[key] = NULL;
+    void** slot = GetValueSlot(t, key);
+    if (slot != NULL) {
+      *slot = NULL;
+    }
   }
   tls_map.DeleteKey(key);
 
@@ -239,7 +333,11 @@ void* pthread_getspecific(pthread_key_t key) {
   // to check that the key is properly allocated. If the key was not
   // allocated, the value read from the TLS should always be NULL
   // due to pthread_key_delete() clearing the values for all threads.
-  return __get_tls()[key];
+  if (__predict_true(!IsDynamicKey(key))) {
+    return __get_tls()[key];
+  }
+  void** slot = GetValueSlot(__get_thread(), key);
+  return (slot != NULL) ? *slot : NULL;
 }
 
 int pthread_setspecific(pthread_key_t key, const void* ptr) {
@@ -249,6 +347,24 @@ int pthread_setspecific(pthread_key_t key, const void* ptr) {
     return EINVAL;
   }
 
-  __get_tls()[key] = const_cast<void*>(ptr);
+  pthread_internal_t* thread = __get_thread();
+  void** slot = GetValueSlot(thread, key);
+  if (slot == NULL) {
+    if (ptr == NULL) {
+      return 0;
+    }
+    void** block = reinterpret_cast<void**>(calloc(BIONIC_TLS_DYNAMIC_BLOCK_SIZE, sizeof(void*)));
+    if (block == NULL) {
+      return ENOMEM;
+    }
+    thread->tls_dynamic[DYNAMIC_KEY_BLOCK(key)] = block;
+    slot = &block[DYNAMIC_KEY_INDEX(key)];
+  }
+  *slot = const_cast<void*>(ptr);
+
+  // Remember to call the destructor when this thread exits.
+  if (ptr != NULL && tls_map.GetDestructor(key) != NULL) {
+    TLSMAP_WORD(thread->tls_key_dirty, key) |= TLSMAP_MASK(key);
+  }
   return 0;
 }
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+
+#include <errno.h>
+#include <sched.h>
+
+#include "private/bionic_atomic_inline.h"
+
+// A test-and-test-and-set lock: waiters spin reading the lock word, which
+// stays in their own cache, and only retry the atomic swap once it looks
+// free. Between attempts they back off exponentially so that a released
+// lock isn't hammered by every waiter at once, and past the longest delay
+// they yield, in case the owner was preempted (or shares our only cpu).
+
+#define SPIN_BACKOFF_MAX 1024
+
+int pthread_spin_init(pthread_spinlock_t* lock, int pshared) {
+  if (pshared != PTHREAD_PROCESS_PRIVATE && pshared != PTHREAD_PROCESS_SHARED) {
+    return EINVAL;
+  }
+  // A plain word works the same in shared memory, so 'pshared' needs no state.
+  *lock = 0;
+  return 0;
+}
+
+int pthread_spin_destroy(pthread_spinlock_t* lock) {
+  return (*lock != 0) ? EBUSY : 0;
+}
+
+int pthread_spin_trylock(pthread_spinlock_t* lock) {
+  if (*lock != 0 || __bionic_swap(1, lock) != 0) {
+    return EBUSY;
+  }
+  ANDROID_MEMBAR_FULL();
+  return 0;
+}
+
+int pthread_spin_lock(pthread_spinlock_t* lock) {
+  int backoff = 1;
+  while (__bionic_swap(1, lock) != 0) {
+    do {
+      if (backoff < SPIN_BACKOFF_MAX) {
+        for (int i = 0; i < backoff; ++i) {
+          __bionic_cpu_relax();
+        }
+        backoff <<= 1;
+      } else {
+        sched_yield();
+      }
+    } while (*lock != 0);
+  }
+  ANDROID_MEMBAR_FULL();
+  return 0;
+}
+
+int pthread_spin_unlock(pthread_spinlock_t* lock) {
+  ANDROID_MEMBAR_FULL();
+  *lock = 0;
+  return 0;
+}
@@ -33,6 +33,7 @@
 #include <errno.h>
 #include <poll.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
 
@@ -52,6 +53,7 @@
 #include <sys/atomics.h>
 
 #include "private/bionic_atomic_inline.h"
+#include "private/bionic_futex.h"
 
 #define ALIGN(x, a) (((x) + (a - 1)) & ~(a - 1))
 
@@ -60,7 +62,10 @@ struct prop_area {
     unsigned volatile serial;
     unsigned magic;
     unsigned version;
-    unsigned reserved[28];
+    unsigned size;          /* of the area; of the file before PROP_AREA_VERSION */
+    unsigned area;          /* index of a prefix area, 0 for the root area */
+    unsigned areas;         /* number of prefix areas, in the root area */
+    unsigned reserved[25];
     char data[0];
 };
 
@@ -94,7 +99,8 @@ typedef struct prop_info prop_info;
 typedef volatile uint32_t prop_off_t;
 struct prop_bt {
     uint8_t namelen;
-    uint8_t reserved[3];
+    uint8_t volatile area;  /* if non-zero, the children live in this prefix area */
+    uint8_t reserved[2];
 
     prop_off_t prop;
 
@@ -108,7 +114,45 @@ struct prop_bt {
 
 typedef struct prop_bt prop_bt;
 
-static const char property_service_socket[] = "/dev/socket/" PROP_SERVICE_NAME;
+/*
+ * So that processes only map the parts of the trie they use, and so that the
+ * number of properties isn't capped by the size of a single area, the children
+ * of each top-level node ("ro", "sys", "persist"...) are kept in an area of
+ * their own. Prefix area <n> lives at offset <n> * PA_MAX_SIZE of the property
+ * file, after the root area, so that a process that only has a descriptor for
+ * the file (from ANDROID_PROPERTY_WORKSPACE) can map them too. The root area
+ * only holds the top-level nodes, the properties without a '.' in their name,
+ * and the serial number of the whole property space.
+ *
+ * The root node of a prefix area stands in for its top-level node, and the
+ * areas are mapped the first time a name under their prefix is looked up.
+ * The writer grows each of them PA_SIZE bytes at a time, and every process
+ * maps PA_MAX_SIZE bytes of each so that their mapping covers the growth.
+ * If all the PROP_AREAS_MAX - 1 prefix areas are used, later prefixes are
+ * kept in the root area, as all properties were before.
+ */
+#define PROP_AREAS_MAX 64
+
+static prop_area *volatile prop_areas[PROP_AREAS_MAX];
+static prop_area *prop_areas_root;
+static bool prop_areas_writable;
+/* the writer's descriptor for the file, or a reader's from the environment */
+static int prop_areas_fd = -1;
+static pthread_mutex_t prop_areas_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Properties are never moved or removed once added, so __system_property_find
+ * remembers where it found each property in a small direct-mapped cache indexed
+ * by a hash of the name. Each hit is checked against the name being looked up,
+ * so the cache can be read and updated without locking. Lookups that fail
+ * aren't cached, since the property may be added later.
+ */
+#define PROP_CACHE_SIZE 128
+
+static const prop_info *volatile prop_cache[PROP_CACHE_SIZE];
+static prop_area *volatile prop_cache_area;
+
+static char property_service_socket[UNIX_PATH_MAX] = "/dev/socket/" PROP_SERVICE_NAME;
 static char property_filename[PATH_MAX] = PROP_FILENAME;
 static bool compat_mode = false;
 
@@ -128,6 +172,24 @@ static int get_fd_from_env(void)
     return atoi(env);
 }
 
+/*
+ * Forgets the prefix areas of the previous root area, which are left mapped
+ * since other threads may still be using them. 'fd' is kept for mapping (or,
+ * if 'writable', growing) the prefix areas of 'root', or is -1 if they should
+ * be opened by name.
+ */
+static void reset_prop_areas(prop_area *root, bool writable, int fd)
+{
+    pthread_mutex_lock(&prop_areas_lock);
+    if (prop_areas_writable && prop_areas_fd >= 0)
+        close(prop_areas_fd);
+    memset((void *)prop_areas, 0, sizeof(prop_areas));
+    prop_areas_root = root;
+    prop_areas_writable = writable;
+    prop_areas_fd = fd;
+    pthread_mutex_unlock(&prop_areas_lock);
+}
+
 static int map_prop_area_rw()
 {
     prop_area *pa;
@@ -167,13 +229,14 @@ static int map_prop_area_rw()
     memset(pa, 0, pa_size);
     pa->magic = PROP_AREA_MAGIC;
     pa->version = PROP_AREA_VERSION;
+    pa->size = pa_size;
     /* reserve root node */
     pa->bytes_used = sizeof(prop_bt);
 
     /* plug into the lib property services */
     __system_property_area__ = pa;
+    reset_prop_areas(pa, true, fd);
 
-    close(fd);
     return 0;
 
 out:
@@ -242,6 +305,16 @@ static int map_prop_area()
     }
 
     pa_size = fd_stat.st_size;
+
+    /* the prefix areas follow the root area, which records its own size */
+    prop_area header;
+    if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+            header.magic == PROP_AREA_MAGIC && header.version == PROP_AREA_VERSION) {
+        if (header.size < sizeof(prop_area) || header.size > pa_size)
+            goto cleanup;
+        pa_size = header.size;
+    }
+
     pa_data_size = pa_size - sizeof(prop_area);
     prop_area *pa = mmap(NULL, pa_size, PROT_READ, MAP_SHARED, fd, 0);
 
@@ -250,6 +323,7 @@ static int map_prop_area()
     }
 
     if((pa->magic != PROP_AREA_MAGIC) || (pa->version != PROP_AREA_VERSION &&
+                pa->version != PROP_AREA_VERSION_SINGLE &&
                 pa->version != PROP_AREA_VERSION_COMPAT)) {
         munmap(pa, pa_size);
         goto cleanup;
@@ -262,6 +336,7 @@ static int map_prop_area()
     result = 0;
 
     __system_property_area__ = pa;
+    reset_prop_areas(pa, false, fromFile ? -1 : fd);
 
 cleanup:
     if (fromFile) {
@@ -276,23 +351,129 @@ int __system_properties_init()
     return map_prop_area();
 }
 
-static void *new_prop_obj(size_t size, prop_off_t *off)
+static off_t prop_area_offset(unsigned area)
+{
+    return (off_t)area * PA_MAX_SIZE;
+}
+
+static prop_area *map_prefix_area_ro(unsigned area)
+{
+    struct stat fd_stat;
+    prop_area *pa = NULL;
+    int fd = prop_areas_fd;
+
+    if (fd < 0) {
+        fd = open(property_filename, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0)
+            return NULL;
+    }
+
+    /* the same checks as for the root area in map_prop_area */
+    if (fstat(fd, &fd_stat) < 0 || fd_stat.st_uid != 0 || fd_stat.st_gid != 0 ||
+            (fd_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+            fd_stat.st_size < prop_area_offset(area) + (off_t)sizeof(prop_area)) {
+        goto out;
+    }
+
+    pa = mmap(NULL, PA_MAX_SIZE, PROT_READ, MAP_SHARED, fd, prop_area_offset(area));
+    if (pa == MAP_FAILED) {
+        pa = NULL;
+        goto out;
+    }
+
+    if (pa->magic != PROP_AREA_MAGIC || pa->version != PROP_AREA_VERSION ||
+            pa->area != area) {
+        munmap(pa, PA_MAX_SIZE);
+        pa = NULL;
+    }
+
+out:
+    if (fd != prop_areas_fd)
+        close(fd);
+    return pa;
+}
+
+/* Returns prefix area number 'area', mapping it if this is its first use. */
+static prop_area *get_prop_area(unsigned area)
+{
+    prop_area *pa;
+
+    if (__predict_false(prop_areas_root != __system_property_area__)) {
+        /* a different root area was mapped (only tests do this) */
+        reset_prop_areas(__system_property_area__, false, -1);
+    }
+
+    if (area >= PROP_AREAS_MAX)
+        return NULL;
+
+    pa = prop_areas[area];
+    if (__predict_true(pa != NULL))
+        return pa;
+
+    pthread_mutex_lock(&prop_areas_lock);
+    pa = prop_areas[area];
+    if (!pa && !prop_areas_writable) {
+        pa = map_prefix_area_ro(area);
+        ANDROID_MEMBAR_FULL();
+        prop_areas[area] = pa;
+    }
+    pthread_mutex_unlock(&prop_areas_lock);
+
+    return pa;
+}
+
+static size_t prop_area_data_size(prop_area *pa)
+{
+    if (pa->area)
+        return PA_MAX_SIZE - sizeof(prop_area);
+    return pa_data_size;
+}
+
+/* Makes room for 'size' more bytes at the end of a prefix area. */
+static int grow_prop_area(prop_area *pa, size_t size)
+{
+    size_t new_size = pa->size;
+    struct stat fd_stat;
+    off_t end;
+
+    /* readers map the root area at its initial size */
+    if (!pa->area)
+        return -1;
+
+    while (pa->bytes_used + size > new_size - sizeof(prop_area))
+        new_size += PA_SIZE;
+    if (new_size > PA_MAX_SIZE)
+        return -1;
+
+    /* a later prefix area may already have extended the file past this one */
+    end = prop_area_offset(pa->area) + new_size;
+    if (fstat(prop_areas_fd, &fd_stat) < 0)
+        return -1;
+    if (fd_stat.st_size < end && ftruncate(prop_areas_fd, end) < 0)
+        return -1;
+
+    pa->size = new_size;
+    return 0;
+}
+
+static void *new_prop_obj(prop_area *pa, size_t size, prop_off_t *off)
 {
-    prop_area *pa = __system_property_area__;
     size = ALIGN(size, sizeof(uint32_t));
 
-    if (pa->bytes_used + size > pa_data_size)
+    if (pa->bytes_used + size > pa->size - sizeof(prop_area) &&
+            grow_prop_area(pa, size) < 0)
         return NULL;
 
     *off = pa->bytes_used;
-    __system_property_area__->bytes_used += size;
-    return __system_property_area__->data + *off;
+    pa->bytes_used += size;
+    return pa->data + *off;
 }
 
-static prop_bt *new_prop_bt(const char *name, uint8_t namelen, prop_off_t *off)
+static prop_bt *new_prop_bt(prop_area *pa, const char *name, uint8_t namelen,
+        prop_off_t *off)
 {
     prop_off_t off_tmp;
-    prop_bt *bt = new_prop_obj(sizeof(prop_bt) + namelen + 1, &off_tmp);
+    prop_bt *bt = new_prop_obj(pa, sizeof(prop_bt) + namelen + 1, &off_tmp);
     if (bt) {
         memcpy(bt->name, name, namelen);
         bt->name[namelen] = '\0';
@@ -304,11 +485,11 @@ static prop_bt *new_prop_bt(const char *name, uint8_t namelen, prop_off_t *off)
     return bt;
 }
 
-static prop_info *new_prop_info(const char *name, uint8_t namelen,
+static prop_info *new_prop_info(prop_area *pa, const char *name, uint8_t namelen,
         const char *value, uint8_t valuelen, prop_off_t *off)
 {
     prop_off_t off_tmp;
-    prop_info *info = new_prop_obj(sizeof(prop_info) + namelen + 1, &off_tmp);
+    prop_info *info = new_prop_obj(pa, sizeof(prop_info) + namelen + 1, &off_tmp);
     if (info) {
         memcpy(info->name, name, namelen);
         info->name[namelen] = '\0';
@@ -322,19 +503,69 @@ static prop_info *new_prop_info(const char *name, uint8_t namelen,
     return info;
 }
 
-static void *to_prop_obj(prop_off_t off)
+/* Creates the prefix area of the top-level node 'trie', which has no children yet. */
+static int new_prefix_area(prop_bt *trie)
 {
-    if (off > pa_data_size)
+    prop_area *root = __system_property_area__;
+    unsigned area = root->areas + 1;
+    prop_area *pa;
+
+    if (area >= PROP_AREAS_MAX || prop_areas_fd < 0)
+        return -1;
+
+    /* the new area is the last one, so this always extends the file */
+    if (ftruncate(prop_areas_fd, prop_area_offset(area) + PA_SIZE) < 0)
+        return -1;
+
+    pa = mmap(NULL, PA_MAX_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, prop_areas_fd,
+            prop_area_offset(area));
+    if (pa == MAP_FAILED)
+        return -1;
+
+    pa->magic = PROP_AREA_MAGIC;
+    pa->version = PROP_AREA_VERSION;
+    pa->size = PA_SIZE;
+    pa->area = area;
+    /* reserve root node */
+    pa->bytes_used = sizeof(prop_bt);
+
+    prop_areas[area] = pa;
+    root->areas = area;
+    ANDROID_MEMBAR_FULL();
+    trie->area = area;
+
+    return 0;
+}
+
+static void *to_prop_obj(prop_area *pa, prop_off_t off)
+{
+    if (!pa)
         return NULL;
-    if (!__system_property_area__)
+    if (off > prop_area_data_size(pa))
         return NULL;
 
-    return __system_property_area__->data + off;
+    return pa->data + off;
 }
 
 static prop_bt *root_node()
 {
-    return to_prop_obj(0);
+    return to_prop_obj(__system_property_area__, 0);
+}
+
+/*
+ * Returns the binary tree of the children of 'trie', a node of the area *pa,
+ * which becomes the prefix area of 'trie' if it has one.
+ */
+static prop_bt *prop_bt_children(prop_area **pa, prop_bt *trie)
+{
+    if (trie->area) {
+        *pa = get_prop_area(trie->area);
+        trie = to_prop_obj(*pa, 0);
+        if (!trie)
+            return NULL;
+    }
+
+    return trie->children ? to_prop_obj(*pa, trie->children) : NULL;
 }
 
 static int cmp_prop_name(const char *one, uint8_t one_len, const char *two,
@@ -348,8 +579,8 @@ static int cmp_prop_name(const char *one, uint8_t one_len, const char *two,
         return strncmp(one, two, one_len);
 }
 
-static prop_bt *find_prop_bt(prop_bt *bt, const char *name, uint8_t namelen,
-        bool alloc_if_needed)
+static prop_bt *find_prop_bt(prop_area *pa, prop_bt *bt, const char *name,
+        uint8_t namelen, bool alloc_if_needed)
 {
     while (true) {
         int ret;
@@ -361,21 +592,21 @@ static prop_bt *find_prop_bt(prop_bt *bt, const char *name, uint8_t namelen,
             return bt;
         } else if (ret < 0) {
             if (bt->left) {
-                bt = to_prop_obj(bt->left);
+                bt = to_prop_obj(pa, bt->left);
             } else {
                 if (!alloc_if_needed)
                    return NULL;
 
-                bt = new_prop_bt(name, namelen, &bt->left);
+                bt = new_prop_bt(pa, name, namelen, &bt->left);
             }
         } else {
             if (bt->right) {
-                bt = to_prop_obj(bt->right);
+                bt = to_prop_obj(pa, bt->right);
             } else {
                 if (!alloc_if_needed)
                    return NULL;
 
-                bt = new_prop_bt(name, namelen, &bt->right);
+                bt = new_prop_bt(pa, name, namelen, &bt->right);
             }
         }
     }
@@ -385,7 +616,9 @@ static const prop_info *find_property(prop_bt *trie, const char *name,
         uint8_t namelen, const char *value, uint8_t valuelen,
         bool alloc_if_needed)
 {
+    prop_area *pa = __system_property_area__;
     const char *remaining_name = name;
+    unsigned level = 0;
 
     if (!trie) return NULL;
 
@@ -405,20 +638,26 @@ static const prop_info *find_property(prop_bt *trie, const char *name,
         if (!substr_size)
             return NULL;
 
-        if (trie->children) {
-            root = to_prop_obj(trie->children);
-        } else if (alloc_if_needed) {
-            root = new_prop_bt(remaining_name, substr_size, &trie->children);
-        } else {
-            root = NULL;
+        /* the first child of a top-level node goes in a new prefix area */
+        if (alloc_if_needed && level == 1 && !trie->area && !trie->children)
+            new_prefix_area(trie);
+
+        root = prop_bt_children(&pa, trie);
+        if (!root && alloc_if_needed) {
+            if (trie->area)
+                trie = to_prop_obj(pa, 0);
+            if (!trie)
+                return NULL;
+            root = new_prop_bt(pa, remaining_name, substr_size, &trie->children);
         }
 
         if (!root)
             return NULL;
 
-        trie = find_prop_bt(root, remaining_name, substr_size, alloc_if_needed);
+        trie = find_prop_bt(pa, root, remaining_name, substr_size, alloc_if_needed);
         if (!trie)
             return NULL;
+        level++;
 
         if (!want_subtree)
             break;
@@ -427,20 +666,63 @@ static const prop_info *find_property(prop_bt *trie, const char *name,
     }
 
     if (trie->prop) {
-        return to_prop_obj(trie->prop);
+        return to_prop_obj(pa, trie->prop);
     } else if (alloc_if_needed) {
-        return new_prop_info(name, namelen, value, valuelen, &trie->prop);
+        return new_prop_info(pa, name, namelen, value, valuelen, &trie->prop);
     } else {
         return NULL;
     }
 }
 
+/* FNV-1a, which also computes the length of the name */
+static uint32_t prop_name_hash(const char *name, size_t *namelen)
+{
+    const char *p = name;
+    uint32_t hash = 2166136261U;
+
+    while (*p) {
+        hash = (hash ^ (uint8_t)*p++) * 16777619U;
+    }
+    *namelen = p - name;
+    return hash;
+}
+
+static const prop_info *prop_cache_lookup(const prop_info *pi, const char *name)
+{
+    /* strcmp rather than memcmp: a short name can end near the end of the mapping */
+    if (!pi || strcmp(pi->name, name) != 0)
+        return NULL;
+
+    return pi;
+}
+
 const prop_info *__system_property_find(const char *name)
 {
+    prop_area *pa = __system_property_area__;
+    const prop_info *pi;
+    size_t namelen;
+    uint32_t slot;
+
     if (__predict_false(compat_mode)) {
         return __system_property_find_compat(name);
     }
-    return find_property(root_node(), name, strlen(name), NULL, 0, false);
+
+    slot = prop_name_hash(name, &namelen) & (PROP_CACHE_SIZE - 1);
+
+    if (__predict_true(pa == prop_cache_area)) {
+        pi = prop_cache_lookup(prop_cache[slot], name);
+        if (pi)
+            return pi;
+    } else {
+        /* a different area was mapped (only tests do this) */
+        memset((void *)prop_cache, 0, sizeof(prop_cache));
+        prop_cache_area = pa;
+    }
+
+    pi = find_property(root_node(), name, namelen, NULL, 0, false);
+    if (pi)
+        prop_cache[slot] = pi;
+    return pi;
 }
 
 int __system_property_read(const prop_info *pi, char *name, char *value)
@@ -482,9 +764,170 @@ int __system_property_get(const char *name, char *value)
 }
 
 
-static int send_prop_msg(prop_msg *msg)
+struct prop_name_ref {
+    const char *name;
+    unsigned index;
+};
+
+static int cmp_prop_name_ref(const void *one, const void *two)
+{
+    return strcmp(((const struct prop_name_ref *)one)->name,
+            ((const struct prop_name_ref *)two)->name);
+}
+
+unsigned int __system_property_find_all(const char *const *names,
+        const prop_info **pis, unsigned int count)
+{
+    struct prop_name_ref *refs;
+    /* path[i] is the trie node of the i+1th component of 'prev', in path_pa[i] */
+    prop_bt *path[PROP_NAME_MAX];
+    prop_area *path_pa[PROP_NAME_MAX];
+    unsigned depth = 0;
+    const char *prev = "";
+    unsigned found = 0;
+    unsigned n;
+
+    if (__predict_false(compat_mode) || !root_node()) {
+        for (n = 0; n < count; n++) {
+            pis[n] = __system_property_find(names[n]);
+            found += (pis[n] != NULL);
+        }
+        return found;
+    }
+
+    /* Sort the names, so that those sharing leading components
+     * follow each other and reuse each other's trie nodes. If we
+     * can't, the lookups are still correct, just slower. */
+    refs = malloc(count * sizeof(*refs));
+    for (n = 0; refs && n < count; n++) {
+        refs[n].name = names[n];
+        refs[n].index = n;
+    }
+    if (refs)
+        qsort(refs, count, sizeof(*refs), cmp_prop_name_ref);
+
+    for (n = 0; n < count; n++) {
+        const char *name = refs ? refs[n].name : names[n];
+        const char *remaining_name = name;
+        prop_area *pa = __system_property_area__;
+        prop_bt *trie = root_node();
+        unsigned level = 0;
+        const prop_info *pi = NULL;
+
+        /* can't have been added, and would overflow path[] */
+        if (strlen(name) >= PROP_NAME_MAX) {
+            pis[refs ? refs[n].index : n] = NULL;
+            continue;
+        }
+
+        while (true) {
+            char *sep = strchr(remaining_name, '.');
+            size_t substr_size = sep ? (size_t)(sep - remaining_name) : strlen(remaining_name);
+            size_t end = remaining_name + substr_size - name;
+
+            if (!substr_size || substr_size > UINT8_MAX) {
+                trie = NULL;
+                break;
+            }
+
+            if (level < depth && strncmp(name, prev, end) == 0 &&
+                    (prev[end] == '.' || prev[end] == '\0')) {
+                /* same leading components as the previous name */
+                trie = path[level];
+                pa = path_pa[level];
+            } else {
+                prop_bt *root = prop_bt_children(&pa, trie);
+                depth = level;
+                trie = root ? find_prop_bt(pa, root, remaining_name, substr_size, false) : NULL;
+                if (!trie)
+                    break;
+                path[level] = trie;
+                path_pa[level] = pa;
+            }
+            level++;
+
+            if (!sep)
+                break;
+            remaining_name = sep + 1;
+        }
+
+        depth = level;
+        prev = name;
+
+        if (trie && trie->prop) {
+            pi = to_prop_obj(pa, trie->prop);
+            found += (pi != NULL);
+        }
+        pis[refs ? refs[n].index : n] = pi;
+    }
+
+    free(refs);
+    return found;
+}
+
+unsigned int __system_property_read_all(const prop_info *const *pis,
+        char values[][PROP_VALUE_MAX], unsigned int count)
+{
+    prop_area *pa = __system_property_area__;
+    unsigned serial;
+    unsigned n;
+
+    /* Every update bumps the area serial once the new value is in place,
+     * so the values were all current together if it didn't change while
+     * we read them. */
+    do {
+        serial = pa->serial;
+        ANDROID_MEMBAR_FULL();
+        for (n = 0; n < count; n++) {
+            if (pis[n])
+                __system_property_read(pis[n], NULL, values[n]);
+            else
+                values[n][0] = '\0';
+        }
+        ANDROID_MEMBAR_FULL();
+    } while (serial != pa->serial);
+
+    return serial;
+}
+
+int __system_property_get_all(const char *const *names,
+        char values[][PROP_VALUE_MAX], unsigned int count)
+{
+    prop_area *pa = __system_property_area__;
+    const prop_info **pis;
+    unsigned serial;
+    unsigned found;
+
+    if (!pa)
+        return -1;
+
+    pis = malloc(count * sizeof(*pis));
+    if (!pis && count)
+        return -1;
+
+    /* A property may also have been added since we looked it up. */
+    do {
+        serial = pa->serial;
+        ANDROID_MEMBAR_FULL();
+        found = __system_property_find_all(names, pis, count);
+    } while (__system_property_read_all(pis, values, count) != serial);
+
+    free(pis);
+    return found;
+}
+
+int __system_property_set_service_socket(const char *filename)
+{
+    size_t len = strlen(filename);
+    if (len >= sizeof(property_service_socket))
+        return -1;
+
+    strcpy(property_service_socket, filename);
+    return 0;
+}
+
+static int connect_prop_service(void)
 {
-    struct pollfd pollfds[1];
     union {
         struct sockaddr_un addr;
         struct sockaddr addr_g;
@@ -492,12 +935,10 @@ static int send_prop_msg(prop_msg *msg)
     socklen_t alen;
     size_t namelen;
     int s;
-    int r;
-    int result = -1;
 
     s = socket(AF_LOCAL, SOCK_STREAM, 0);
     if(s < 0) {
-        return result;
+        return -1;
     }
 
     memset(&addr, 0, sizeof(addr));
@@ -508,6 +949,21 @@ static int send_prop_msg(prop_msg *msg)
 
     if(TEMP_FAILURE_RETRY(connect(s, &addr.addr_g, alen) < 0)) {
         close(s);
+        return -1;
+    }
+
+    return s;
+}
+
+static int send_prop_msg(prop_msg *msg)
+{
+    struct pollfd pollfds[1];
+    int s;
+    int r;
+    int result = -1;
+
+    s = connect_prop_service();
+    if(s < 0) {
         return result;
     }
 
@@ -568,6 +1024,98 @@ int __system_property_set(const char *key, const char *value)
     return 0;
 }
 
+/*
+ * Sends all the messages over a single connection, then waits for the property
+ * service to say how many of them it handled. Returns that number, 0 if the
+ * property service doesn't support batches, or -1 on error.
+ */
+static int send_prop_msgs(prop_msg *msgs, unsigned count)
+{
+    struct pollfd pollfds[1];
+    const char *data = (const char *)msgs;
+    size_t size = count * sizeof(prop_msg);
+    uint32_t handled;
+    int s;
+    int r;
+    int result = 0;
+
+    s = connect_prop_service();
+    if(s < 0) {
+        return -1;
+    }
+
+    // A property service that doesn't know about batches closes the
+    // socket as soon as it has read the first message, which then
+    // makes our sends fail: we'll then see it close without an ack.
+    while (size > 0) {
+        r = TEMP_FAILURE_RETRY(send(s, data, size, MSG_NOSIGNAL));
+        if (r <= 0)
+            break;
+        data += r;
+        size -= r;
+    }
+    shutdown(s, SHUT_WR);
+
+    // The same 250 ms cap as in send_prop_msg, but for the whole batch.
+    // Unlike there, a timeout counts as nothing handled: we can't tell a
+    // busy property service from one that read the first message and
+    // dropped the rest, so the caller sends them all again one at a time.
+    // Setting a property twice to the same value is harmless.
+    pollfds[0].fd = s;
+    pollfds[0].events = POLLIN;
+    r = TEMP_FAILURE_RETRY(poll(pollfds, 1, 250 /* ms */));
+    if (r == 1) {
+        r = TEMP_FAILURE_RETRY(recv(s, &handled, sizeof(handled), MSG_WAITALL));
+        if (r == sizeof(handled))
+            result = (handled < count) ? handled : count;
+    }
+
+    close(s);
+    return result;
+}
+
+int __system_property_set_all(const char *const *keys,
+        const char *const *values, unsigned int count)
+{
+    prop_msg *msgs;
+    unsigned n;
+    int sent;
+    int err = 0;
+
+    for (n = 0; n < count; n++) {
+        if(keys[n] == 0) return -1;
+        if(strlen(keys[n]) >= PROP_NAME_MAX) return -1;
+        if(values[n] && strlen(values[n]) >= PROP_VALUE_MAX) return -1;
+    }
+
+    msgs = calloc(count, sizeof(prop_msg));
+    if (!msgs && count)
+        return -1;
+
+    for (n = 0; n < count; n++) {
+        msgs[n].cmd = PROP_MSG_SETPROP_BATCH;
+        strlcpy(msgs[n].name, keys[n], sizeof msgs[n].name);
+        strlcpy(msgs[n].value, values[n] ? values[n] : "", sizeof msgs[n].value);
+    }
+
+    // A single property is quicker to set the usual way.
+    sent = (count > 1) ? send_prop_msgs(msgs, count) : 0;
+    if (sent < 0) {
+        free(msgs);
+        return -1;
+    }
+
+    // Set whatever the property service didn't handle one at a time.
+    for (n = sent; n < count; n++) {
+        msgs[n].cmd = PROP_MSG_SETPROP;
+        if (send_prop_msg(&msgs[n]) < 0)
+            err = -1;
+    }
+
+    free(msgs);
+    return err;
+}
+
 int __system_property_wait(const prop_info *pi)
 {
     unsigned n;
@@ -586,6 +1134,44 @@ int __system_property_wait(const prop_info *pi)
     return 0;
 }
 
+/*
+ * Besides the plain FUTEX_WAIT of __system_property_wait_any, pa->serial is
+ * waited on with FUTEX_WAIT_BITSET by waiters only interested in some
+ * properties. Each change wakes the waiters of two of its 32 bits: one
+ * picked by the property's name, one by the first component of its name.
+ * Plain waiters match all the bits, so they are woken by every change.
+ */
+#define PROP_WAKE_PROP_BIT_SHIFT    0
+#define PROP_WAKE_PREFIX_BIT_SHIFT  16
+
+static uint32_t prop_wake_prop_bit(const prop_info *pi)
+{
+    size_t namelen;
+    return 1U << (PROP_WAKE_PROP_BIT_SHIFT + (prop_name_hash(pi->name, &namelen) & 15));
+}
+
+static uint32_t prop_wake_prefix_bit(const char *name)
+{
+    uint32_t hash = 2166136261U;
+    while (*name && *name != '.')
+        hash = (hash ^ (unsigned char)*name++) * 16777619U;
+    return 1U << (PROP_WAKE_PREFIX_BIT_SHIFT + (hash & 15));
+}
+
+static void prop_area_wake(prop_area *pa, uint32_t bits)
+{
+    int saved_errno = errno;
+    futex(&pa->serial, FUTEX_WAKE_BITSET, INT32_MAX, NULL, NULL, bits);
+    errno = saved_errno;
+}
+
+static void prop_area_wait(prop_area *pa, unsigned serial, uint32_t bits)
+{
+    int saved_errno = errno;
+    futex(&pa->serial, FUTEX_WAIT_BITSET, serial, NULL, NULL, bits);
+    errno = saved_errno;
+}
+
 int __system_property_update(prop_info *pi, const char *value, unsigned int len)
 {
     prop_area *pa = __system_property_area__;
@@ -601,7 +1187,7 @@ int __system_property_update(prop_info *pi, const char *value, unsigned int len)
     __futex_wake(&pi->serial, INT32_MAX);
 
     pa->serial++;
-    __futex_wake(&pa->serial, INT32_MAX);
+    prop_area_wake(pa, prop_wake_prop_bit(pi) | prop_wake_prefix_bit(pi->name));
 
     return 0;
 }
@@ -624,7 +1210,8 @@ int __system_property_add(const char *name, unsigned int namelen,
         return -1;
 
     pa->serial++;
-    __futex_wake(&pa->serial, INT32_MAX);
+    /* nobody can be waiting on the new property itself yet */
+    prop_area_wake(pa, prop_wake_prefix_bit(name));
     return 0;
 }
 
@@ -644,6 +1231,49 @@ unsigned int __system_property_wait_any(unsigned int serial)
     return pa->serial;
 }
 
+unsigned int __system_property_wait_set(const prop_info *const *pis,
+        unsigned int *serials, unsigned int count)
+{
+    prop_area *pa = __system_property_area__;
+    uint32_t bits = 0;
+    unsigned changed;
+    unsigned n;
+
+    for (n = 0; n < count; n++)
+        bits |= prop_wake_prop_bit(pis[n]);
+
+    while (true) {
+        /* An update completing after this is seen to bump pa->serial. */
+        unsigned serial = pa->serial;
+        ANDROID_MEMBAR_FULL();
+
+        changed = 0;
+        for (n = 0; n < count; n++) {
+            unsigned pi_serial = pis[n]->serial;
+            /* a dirty serial will be followed by an update of pa->serial */
+            if (pi_serial != serials[n] && !SERIAL_DIRTY(pi_serial)) {
+                serials[n] = pi_serial;
+                changed++;
+            }
+        }
+        if (changed)
+            return changed;
+
+        prop_area_wait(pa, serial, bits);
+    }
+}
+
+unsigned int __system_property_wait_prefix(const char *prefix, unsigned int serial)
+{
+    prop_area *pa = __system_property_area__;
+    uint32_t bits = prop_wake_prefix_bit(prefix);
+
+    while (pa->serial == serial)
+        prop_area_wait(pa, serial, bits);
+
+    return pa->serial;
+}
+
 struct find_nth_cookie {
     unsigned count;
     unsigned n;
@@ -675,31 +1305,41 @@ const prop_info *__system_property_find_nth(unsigned n)
     return cookie.pi;
 }
 
-static int foreach_property(prop_off_t off,
+static int foreach_property(prop_area *pa, prop_off_t off,
         void (*propfn)(const prop_info *pi, void *cookie), void *cookie)
 {
-    prop_bt *trie = to_prop_obj(off);
+    prop_bt *trie = to_prop_obj(pa, off);
     if (!trie)
         return -1;
 
     if (trie->left) {
-        int err = foreach_property(trie->left, propfn, cookie);
+        int err = foreach_property(pa, trie->left, propfn, cookie);
         if (err < 0)
             return -1;
     }
     if (trie->prop) {
-        prop_info *info = to_prop_obj(trie->prop);
+        prop_info *info = to_prop_obj(pa, trie->prop);
         if (!info)
             return -1;
         propfn(info, cookie);
     }
-    if (trie->children) {
-        int err = foreach_property(trie->children, propfn, cookie);
+    if (trie->area) {
+        prop_area *area_pa = get_prop_area(trie->area);
+        prop_bt *area_root = to_prop_obj(area_pa, 0);
+        if (!area_root)
+            return -1;
+        if (area_root->children) {
+            int err = foreach_property(area_pa, area_root->children, propfn, cookie);
+            if (err < 0)
+                return -1;
+        }
+    } else if (trie->children) {
+        int err = foreach_property(pa, trie->children, propfn, cookie);
         if (err < 0)
             return -1;
     }
     if (trie->right) {
-        int err = foreach_property(trie->right, propfn, cookie);
+        int err = foreach_property(pa, trie->right, propfn, cookie);
         if (err < 0)
             return -1;
     }
@@ -713,5 +1353,5 @@ int __system_property_foreach(void (*propfn)(const prop_info *pi, void *cookie),
     if (__predict_false(compat_mode)) {
         return __system_property_foreach_compat(propfn, cookie);
 	}
-    return foreach_property(0, propfn, cookie);
+    return foreach_property(__system_property_area__, 0, propfn, cookie);
 }
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <elf.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <sys/cdefs.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "libc_init_common.h"
+
+// The system call stubs, which we use if the kernel doesn't give us a vDSO
+// or the vDSO doesn't have the function we're after.
+extern "C" int __clock_gettime(int, timespec*);
+extern "C" int __gettimeofday(timeval*, struct timezone*);
+
+typedef int (*vdso_clock_gettime_t)(int, timespec*);
+typedef int (*vdso_gettimeofday_t)(timeval*, struct timezone*);
+typedef time_t (*vdso_time_t)(time_t*);
+
+// Set up by __libc_init_vdso before there are any other threads, and never changed after that.
+static vdso_clock_gettime_t gVdsoClockGettime = NULL;
+static vdso_gettimeofday_t gVdsoGettimeofday = NULL;
+static vdso_time_t gVdsoTime = NULL;
+
+// The vDSO functions fall back to the system call themselves for the cases they
+// can't handle, and pass a failure straight back to us as a negative errno.
+static int vdso_result(int result) {
+  if (result < 0) {
+    errno = -result;
+    return -1;
+  }
+  return result;
+}
+
+int clock_gettime(int clock_id, timespec* tp) {
+  if (gVdsoClockGettime != NULL) {
+    return vdso_result(gVdsoClockGettime(clock_id, tp));
+  }
+  return __clock_gettime(clock_id, tp);
+}
+
+int gettimeofday(timeval* tv, struct timezone* tz) {
+  if (gVdsoGettimeofday != NULL) {
+    return vdso_result(gVdsoGettimeofday(tv, tz));
+  }
+  return __gettimeofday(tv, tz);
+}
+
+time_t time(time_t* t) {
+  if (gVdsoTime != NULL) {
+    return gVdsoTime(t);
+  }
+
+  timeval tv;
+  time_t result = (gettimeofday(&tv, NULL) == -1) ? -1 : tv.tv_sec;
+  if (t != NULL) {
+    *t = result;
+  }
+  return result;
+}
+
+// Monotonically increasing time in clock ticks, relative to an unspecified epoch.
+static clock_t clock_now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * CLOCKS_PER_SEC + ts.tv_nsec / (1000000000 / CLOCKS_PER_SEC);
+}
+
+// Initialized by the constructor below.
+static clock_t gClockStart;
+
+// Called by dlopen when the library is loaded.
+__attribute__((constructor)) static void clock_crt0() {
+  gClockStart = clock_now();
+}
+
+// Returns the time elapsed in clock ticks since the program started. The epoch is
+// unspecified, but glibc also uses process start time. If we're on a different thread
+// from the one that ran the constructor, pthread_create was a memory barrier.
+clock_t clock() {
+  return clock_now() - gClockStart;
+}
+
+static void* vdso_lookup(Elf_Addr load_bias, const Elf_Sym* symtab, size_t symbol_count,
+                         const char* strtab, const char* name) {
+  for (size_t i = 0; i < symbol_count; ++i) {
+    const Elf_Sym* sym = &symtab[i];
+    if (sym->st_shndx != SHN_UNDEF && ELF_ST_TYPE(sym->st_info) == STT_FUNC &&
+        strcmp(strtab + sym->st_name, name) == 0) {
+      return reinterpret_cast<void*>(load_bias + sym->st_value);
+    }
+  }
+  return NULL;
+}
+
+void __libc_init_vdso() {
+  Elf_Addr vdso_base = getauxval(AT_SYSINFO_EHDR);
+  if (vdso_base == 0) {
+    return;
+  }
+
+  // The vDSO is a prelinked shared library, so find where it was actually mapped and where its
+  // dynamic section is from the program headers.
+  const Elf_Ehdr* ehdr = reinterpret_cast<const Elf_Ehdr*>(vdso_base);
+  const Elf_Phdr* phdr = reinterpret_cast<const Elf_Phdr*>(vdso_base + ehdr->e_phoff);
+  Elf_Addr load_bias = 0;
+  bool found_load = false;
+  const Elf_Dyn* dynamic = NULL;
+  for (size_t i = 0; i < ehdr->e_phnum; ++i) {
+    if (phdr[i].p_type == PT_LOAD && !found_load) {
+      load_bias = vdso_base + phdr[i].p_offset - phdr[i].p_vaddr;
+      found_load = true;
+    } else if (phdr[i].p_type == PT_DYNAMIC) {
+      dynamic = reinterpret_cast<const Elf_Dyn*>(vdso_base + phdr[i].p_offset);
+    }
+  }
+  if (!found_load || dynamic == NULL) {
+    return;
+  }
+
+  // The kernel always links the vDSO with a SysV hash table, which gives us the symbol count.
+  const Elf_Sym* symtab = NULL;
+  const char* strtab = NULL;
+  const Elf_Word* hash = NULL;
+  for (const Elf_Dyn* d = dynamic; d->d_tag != DT_NULL; ++d) {
+    if (d->d_tag == DT_SYMTAB) {
+      symtab = reinterpret_cast<const Elf_Sym*>(load_bias + d->d_un.d_ptr);
+    } else if (d->d_tag == DT_STRTAB) {
+      strtab = reinterpret_cast<const char*>(load_bias + d->d_un.d_ptr);
+    } else if (d->d_tag == DT_HASH) {
+      hash = reinterpret_cast<const Elf_Word*>(load_bias + d->d_un.d_ptr);
+    }
+  }
+  if (symtab == NULL || strtab == NULL || hash == NULL) {
+    return;
+  }
+  size_t symbol_count = hash[1];
+
+  gVdsoClockGettime = reinterpret_cast<vdso_clock_gettime_t>(
+      vdso_lookup(load_bias, symtab, symbol_count, strtab, "__vdso_clock_gettime"));
+  gVdsoGettimeofday = reinterpret_cast<vdso_gettimeofday_t>(
+      vdso_lookup(load_bias, symtab, symbol_count, strtab, "__vdso_gettimeofday"));
+  gVdsoTime = reinterpret_cast<vdso_time_t>(
+      vdso_lookup(load_bias, symtab, symbol_count, strtab, "__vdso_time"));
+}
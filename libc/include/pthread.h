@@ -45,15 +45,19 @@ typedef struct
 #define  __PTHREAD_MUTEX_INIT_VALUE            0
 #define  __PTHREAD_RECURSIVE_MUTEX_INIT_VALUE  0x4000
 #define  __PTHREAD_ERRORCHECK_MUTEX_INIT_VALUE 0x8000
+#define  __PTHREAD_ADAPTIVE_MUTEX_INIT_VALUE   0xc000
 
 #define  PTHREAD_MUTEX_INITIALIZER             {__PTHREAD_MUTEX_INIT_VALUE}
 #define  PTHREAD_RECURSIVE_MUTEX_INITIALIZER   {__PTHREAD_RECURSIVE_MUTEX_INIT_VALUE}
 #define  PTHREAD_ERRORCHECK_MUTEX_INITIALIZER  {__PTHREAD_ERRORCHECK_MUTEX_INIT_VALUE}
+#define  PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP {__PTHREAD_ADAPTIVE_MUTEX_INIT_VALUE}
 
 enum {
     PTHREAD_MUTEX_NORMAL = 0,
     PTHREAD_MUTEX_RECURSIVE = 1,
     PTHREAD_MUTEX_ERRORCHECK = 2,
+    /* Like PTHREAD_MUTEX_NORMAL, but spins for a while before sleeping. */
+    PTHREAD_MUTEX_ADAPTIVE_NP = 3,
 
     PTHREAD_MUTEX_ERRORCHECK_NP = PTHREAD_MUTEX_ERRORCHECK,
     PTHREAD_MUTEX_RECURSIVE_NP  = PTHREAD_MUTEX_RECURSIVE,
@@ -61,6 +65,12 @@ enum {
     PTHREAD_MUTEX_DEFAULT = PTHREAD_MUTEX_NORMAL
 };
 
+enum {
+    PTHREAD_PRIO_NONE = 0,
+    PTHREAD_PRIO_INHERIT = 1,
+    PTHREAD_PRIO_PROTECT = 2,
+};
+
 
 
 typedef struct
@@ -161,6 +171,8 @@ int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr, int *type);
 int pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type);
 int pthread_mutexattr_setpshared(pthread_mutexattr_t *attr, int  pshared);
 int pthread_mutexattr_getpshared(pthread_mutexattr_t *attr, int *pshared);
+int pthread_mutexattr_setprotocol(pthread_mutexattr_t *attr, int protocol);
+int pthread_mutexattr_getprotocol(const pthread_mutexattr_t *attr, int *protocol);
 
 int pthread_mutex_init(pthread_mutex_t *mutex,
                        const pthread_mutexattr_t *attr);
@@ -229,16 +241,15 @@ int pthread_mutex_lock_timeout_np(pthread_mutex_t *mutex, unsigned msecs);
 typedef int pthread_rwlockattr_t;
 
 typedef struct {
-    pthread_mutex_t  lock;
-    pthread_cond_t   cond;
-    int              numLocks;
+    int volatile     state;           /* lock word, see libc/bionic/pthread-rwlocks.c */
+    int              attr;            /* PTHREAD_PROCESS_PRIVATE or PTHREAD_PROCESS_SHARED */
     int              writerThreadId;
-    int              pendingReaders;
-    int              pendingWriters;
+    int volatile     pendingWriters;
+    int              __reserved_pad[2];
     void*            reserved[4];  /* for future extensibility */
 } pthread_rwlock_t;
 
-#define PTHREAD_RWLOCK_INITIALIZER  { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, 0, { NULL, NULL, NULL, NULL } }
+#define PTHREAD_RWLOCK_INITIALIZER  { 0, PTHREAD_PROCESS_PRIVATE, 0, 0, { 0, 0 }, { NULL, NULL, NULL, NULL } }
 
 int pthread_rwlockattr_init(pthread_rwlockattr_t *attr);
 int pthread_rwlockattr_destroy(pthread_rwlockattr_t *attr);
@@ -258,6 +269,39 @@ int pthread_rwlock_timedwrlock(pthread_rwlock_t *rwlock, const struct timespec *
 
 int pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
 
+/* spin lock support */
+
+typedef int volatile pthread_spinlock_t;
+
+int pthread_spin_init(pthread_spinlock_t *lock, int pshared);
+int pthread_spin_destroy(pthread_spinlock_t *lock);
+int pthread_spin_lock(pthread_spinlock_t *lock);
+int pthread_spin_trylock(pthread_spinlock_t *lock);
+int pthread_spin_unlock(pthread_spinlock_t *lock);
+
+/* barrier support */
+
+typedef int pthread_barrierattr_t;
+
+typedef struct {
+    int volatile     sequence;        /* bumped each time the barrier opens; the futex word */
+    int volatile     arrived;
+    int volatile     leaving;         /* woken waiters that haven't returned yet */
+    unsigned         count;
+    int              attr;            /* PTHREAD_PROCESS_PRIVATE or PTHREAD_PROCESS_SHARED */
+} pthread_barrier_t;
+
+#define PTHREAD_BARRIER_SERIAL_THREAD  -1
+
+int pthread_barrierattr_init(pthread_barrierattr_t *attr);
+int pthread_barrierattr_destroy(pthread_barrierattr_t *attr);
+int pthread_barrierattr_setpshared(pthread_barrierattr_t *attr, int pshared);
+int pthread_barrierattr_getpshared(const pthread_barrierattr_t *attr, int *pshared);
+
+int pthread_barrier_init(pthread_barrier_t *barrier, const pthread_barrierattr_t *attr, unsigned count);
+int pthread_barrier_destroy(pthread_barrier_t *barrier);
+int pthread_barrier_wait(pthread_barrier_t *barrier);
+
 
 int pthread_key_create(pthread_key_t *key, void (*destructor_function)(void *));
 int pthread_key_delete (pthread_key_t);
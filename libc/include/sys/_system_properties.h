@@ -37,13 +37,16 @@
 typedef struct prop_msg prop_msg;
 
 #define PROP_AREA_MAGIC   0x504f5250
-#define PROP_AREA_VERSION 0xfc6ed0ab
+#define PROP_AREA_VERSION 0xfc6ed0ac
+/* the whole trie in one area, without prefix areas */
+#define PROP_AREA_VERSION_SINGLE 0xfc6ed0ab
 #define PROP_AREA_VERSION_COMPAT 0x45434f76
 
 #define PROP_SERVICE_NAME "property_service"
 #define PROP_FILENAME "/dev/__properties__"
 
 #define PA_SIZE         (128 * 1024)
+#define PA_MAX_SIZE     (1024 * 1024)
 
 #define SERIAL_VALUE_LEN(serial) ((serial) >> 24)
 #define SERIAL_DIRTY(serial) ((serial) & 1)
@@ -58,6 +61,17 @@ struct prop_msg
 };
 
 #define PROP_MSG_SETPROP 1
+#define PROP_MSG_SETPROP_BATCH 2
+
+/*
+** A PROP_MSG_SETPROP message is sent alone on its connection, which
+** the property service closes once it has set the property.
+**
+** PROP_MSG_SETPROP_BATCH messages are sent back to back on a single
+** connection, whose writing side the client then shuts down.  Once
+** it has handled them all, the property service writes the number
+** of messages it handled, as a uint32_t, and closes the connection.
+*/
     
 /*
 ** Rules:
@@ -90,6 +104,12 @@ struct prop_msg
 */
 int __system_property_set_filename(const char *filename);
 
+/*
+** Use the specified socket to talk to the property service.  This
+** method is for testing only.
+*/
+int __system_property_set_service_socket(const char *filename);
+
 /*
 ** Initialize the area to be used to store properties.  Can
 ** only be done by a single process that has write access to
@@ -130,6 +150,53 @@ unsigned int __system_property_serial(const prop_info *pi);
 ** successive call. */
 unsigned int __system_property_wait_any(unsigned int serial);
 
+/* Wait for any of count system properties to be updated, without
+** being woken by updates of other properties.  serials holds the
+** serial number of each property as last seen by the caller (see
+** __system_property_serial), and is updated with the new ones.
+**
+** Returns the number of properties whose serial number changed.
+*/
+unsigned int __system_property_wait_set(const prop_info *const *pis,
+        unsigned int *serials, unsigned int count);
+
+/* Wait for a system property whose name starts with the same first
+** component as prefix (e.g. "sys" for "sys.usb.config") to be added
+** or updated.  Updates of some other properties may also end the
+** wait, so callers should check what changed.  serial is used as in
+** __system_property_wait_any, with which it can be interchanged.
+*/
+unsigned int __system_property_wait_prefix(const char *prefix, unsigned int serial);
+
+/* Look up count system properties by name, storing a prop_info
+** pointer for each (NULL if it doesn't exist) in pis.  Names sharing
+** leading components are looked up together, in a single pass over
+** the property trie.
+**
+** Returns the number of properties found.
+*/
+unsigned int __system_property_find_all(const char *const *names,
+        const prop_info **pis, unsigned int count);
+
+/* Read the values of count system properties into values, all as
+** of the same moment: no property is updated between the reads.
+** A NULL entry in pis reads as an empty value.
+**
+** Returns the serial number of the snapshot, which can be passed
+** to __system_property_wait_any to wait for a change.
+*/
+unsigned int __system_property_read_all(const prop_info *const *pis,
+        char values[][PROP_VALUE_MAX], unsigned int count);
+
+/* Look up and read count system properties as one snapshot, like
+** __system_property_find_all followed by __system_property_read_all.
+** A property that doesn't exist reads as an empty value.
+**
+** Returns the number of properties found, -1 on error.
+*/
+int __system_property_get_all(const char *const *names,
+        char values[][PROP_VALUE_MAX], unsigned int count);
+
 /*  Compatibility functions to support using an old init with a new libc,
  ** mostly for the OTA updater binary.  These can be deleted once OTAs from
  ** a pre-K release no longer needed to be supported. */
@@ -50,6 +50,12 @@ int __system_property_get(const char *name, char *value);
 **/
 int __system_property_set(const char *key, const char *value);
 
+/* Set count system properties by name, sending them all to the
+** property service at once.  A NULL value sets an empty value.
+**/
+int __system_property_set_all(const char *const *keys,
+        const char *const *values, unsigned int count);
+
 /* Return a pointer to the system property named name, if it
 ** exists, or NULL if there is no such property.  Use 
 ** __system_property_read() to obtain the string value from
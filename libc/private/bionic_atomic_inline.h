@@ -33,6 +33,10 @@
  * void ANDROID_MEMBAR_FULL(void)
  *   Full memory barrier.  Provides a compiler reordering barrier, and
  *   on SMP systems emits an appropriate instruction.
+ *
+ * void __bionic_cpu_relax(void)
+ *   Hint to the CPU that we are in a spin-wait loop.  Also acts as a
+ *   compiler barrier, so the loop re-reads whatever it is waiting on.
  */
 
 #if !defined(ANDROID_SMP)
@@ -61,6 +65,18 @@ extern "C" {
 
 #define ANDROID_MEMBAR_FULL  __bionic_memory_barrier
 
+__ATOMIC_INLINE__ void
+__bionic_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__ ( "pause" : : : "memory" );
+#elif defined(__arm__) && __ARM_ARCH__ >= 7
+    __asm__ __volatile__ ( "yield" : : : "memory" );
+#else
+    __asm__ __volatile__ ( "" : : : "memory" );
+#endif
+}
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -85,6 +85,15 @@ enum {
 #define BIONIC_ALIGN(x, a) (((x) + (a - 1)) & ~(a - 1))
 #define BIONIC_TLS_SLOTS BIONIC_ALIGN(128 + TLS_SLOT_FIRST_USER_SLOT + GLOBAL_INIT_THREAD_LOCAL_BUFFER_COUNT, 4)
 
+/*
+ * pthread keys beyond BIONIC_TLS_SLOTS have no slot in the TLS array. Their values live in
+ * per-thread blocks of BIONIC_TLS_DYNAMIC_BLOCK_SIZE values, allocated the first time the
+ * thread sets one of them (see pthread_key.cpp).
+ */
+#define BIONIC_TLS_DYNAMIC_KEYS 4096
+#define BIONIC_TLS_DYNAMIC_BLOCK_SIZE 256
+#define BIONIC_TLS_KEYS (BIONIC_TLS_SLOTS + BIONIC_TLS_DYNAMIC_KEYS)
+
 __END_DECLS
 
 #if defined(__cplusplus)
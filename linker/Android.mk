@@ -16,6 +16,11 @@ LOCAL_SRC_FILES:= \
     linker_phdr.cpp \
     rt.cpp \
 
+# Lazy binding trampolines. MIPS doesn't support lazy binding.
+ifneq ($(filter arm x86 x86_64,$(TARGET_ARCH)),)
+    LOCAL_SRC_FILES += arch/$(TARGET_ARCH)/lazy_bind.S
+endif
+
 LOCAL_LDFLAGS := -shared -Wl,--exclude-libs,ALL
 
 LOCAL_CFLAGS += -fno-stack-protector \
@@ -17,6 +17,7 @@
 #include "linker.h"
 
 #include <dlfcn.h>
+#include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -59,7 +60,20 @@ void android_update_LD_LIBRARY_PATH(const char* ld_library_path) {
   do_android_update_LD_LIBRARY_PATH(ld_library_path);
 }
 
+// gDlMutex is taken before the write lock, so a thread holding the read lock mustn't wait
+// for it. That only happens if an ifunc resolver run by dlsym or dladdr calls dlopen or dlclose.
+static bool check_not_read_locked(const char* msg) {
+  if (solist_is_read_locked()) {
+    __bionic_format_dlerror(msg, "called with the library list locked");
+    return false;
+  }
+  return true;
+}
+
 void* dlopen(const char* filename, int flags) {
+  if (!check_not_read_locked("dlopen failed")) {
+    return NULL;
+  }
   ScopedPthreadMutexLocker locker(&gDlMutex);
   soinfo* result = do_dlopen(filename, flags);
   if (result == NULL) {
@@ -70,7 +84,7 @@ void* dlopen(const char* filename, int flags) {
 }
 
 void* dlsym(void* handle, const char* symbol) {
-  ScopedPthreadMutexLocker locker(&gDlMutex);
+  ScopedSoListReadLocker locker;
 
   if (handle == NULL) {
     __bionic_format_dlerror("dlsym library handle is null", NULL);
@@ -102,7 +116,7 @@ void* dlsym(void* handle, const char* symbol) {
     unsigned bind = ELF_ST_BIND(sym->st_info);
 
     if (bind == STB_GLOBAL && sym->st_shndx != 0) {
-      return reinterpret_cast<void*>(sym->st_value + found->load_bias);
+      return reinterpret_cast<void*>(soinfo_symbol_address(found, sym));
     }
 
     __bionic_format_dlerror("symbol found but not global", symbol);
@@ -114,7 +128,15 @@ void* dlsym(void* handle, const char* symbol) {
 }
 
 int dladdr(const void* addr, Dl_info* info) {
-  ScopedPthreadMutexLocker locker(&gDlMutex);
+  // The first dladdr in a library builds an index of its symbols. That's a write, so do it
+  // before taking the read lock. If this thread already holds it, and so can't take
+  // gDlMutex, dladdr_find_symbol falls back to searching the symbol table instead.
+  if (!solist_is_read_locked() && dladdr_needs_address_index(addr)) {
+    ScopedPthreadMutexLocker locker(&gDlMutex);
+    do_dladdr_build_address_index(addr);
+  }
+
+  ScopedSoListReadLocker locker;
 
   // Determine if this address can be found in any library currently mapped.
   soinfo* si = find_containing_library(addr);
@@ -129,20 +151,50 @@ int dladdr(const void* addr, Dl_info* info) {
   info->dli_fbase = (void*) si->base;
 
   // Determine if any symbol in the library contains the specified address.
-  Elf_Sym *sym = dladdr_find_symbol(si, addr);
+  Elf_Addr sym_addr;
+  Elf_Sym *sym = dladdr_find_symbol(si, addr, &sym_addr);
   if (sym != NULL) {
     info->dli_sname = si->strtab + sym->st_name;
-    info->dli_saddr = (void*)(si->load_bias + sym->st_value);
+    info->dli_saddr = reinterpret_cast<void*>(sym_addr);
   }
 
   return 1;
 }
 
 int dlclose(void* handle) {
+  if (!check_not_read_locked("dlclose failed")) {
+    return -1;
+  }
   ScopedPthreadMutexLocker locker(&gDlMutex);
   return do_dlclose(reinterpret_cast<soinfo*>(handle));
 }
 
+int dl_iterate_phdr(int (*cb)(dl_phdr_info* info, size_t size, void* data), void* data) {
+  int result = do_dl_iterate_phdr(cb, data);
+  // Unmap any library that was dlclose(3)d while a callback was looking at it.
+  if (!solist_is_read_locked() && dl_has_unloaded_libraries()) {
+    ScopedPthreadMutexLocker locker(&gDlMutex);
+    do_dl_release_unloaded_libraries();
+  }
+  return result;
+}
+
+#if !defined(ANDROID_MIPS_LINKER)
+// Called by the architecture-specific __linker_lazy_bind_trampoline the first
+// time a lazily bound PLT entry is used. Returns the address to jump to.
+extern "C" __LIBC_HIDDEN__ Elf_Addr __linker_lazy_bind(soinfo* si, size_t plt_reloc_index) {
+  // The caller doesn't expect a function call to clobber errno before it's even been made.
+  int saved_errno = errno;
+  Elf_Addr result;
+  {
+    ScopedSoListReadLocker locker;
+    result = do_lazy_bind(si, plt_reloc_index);
+  }
+  errno = saved_errno;
+  return result;
+}
+#endif
+
 #if defined(ANDROID_ARM_LINKER)
 //   0000000 00011111 111112 22222222 2333333 3333444444444455555555556666666 6667777777777888 8888888
 //   0123456 78901234 567890 12345678 9012345 6789012345678901234567890123456 7890123456789012 3456789
@@ -258,6 +310,7 @@ soinfo libdl_info = {
     .chain = gLibDlChains,
 
 #if defined(ANDROID_X86_64_LINKER)
+    .plt_got = 0,
     .plt_rela = 0,
     .plt_rela_count = 0,
     .rela = 0,
@@ -297,4 +350,13 @@ soinfo libdl_info = {
     .load_bias = 0,
     .has_text_relocations = false,
     .has_DT_SYMBOLIC = true,
+    .gnu_nbucket = 0,
+    .gnu_bucket = 0,
+    .gnu_chain = 0,
+    .gnu_maskwords = 0,
+    .gnu_shift2 = 0,
+    .gnu_bloom_filter = 0,
+    .name_hash_next = 0,
+    .symbol_address_index = 0,
+    .symbol_address_index_count = 0,
 };
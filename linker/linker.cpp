@@ -40,6 +40,7 @@
 #include <unistd.h>
 
 // Private C library headers.
+#include "bionic/pthread_internal.h"
 #include "private/bionic_tls.h"
 #include "private/KernelArgumentBlock.h"
 #include "private/ScopedPthreadMutexLocker.h"
@@ -73,6 +74,7 @@
  */
 
 static bool soinfo_link_image(soinfo* si);
+static void soinfo_free_address_index(soinfo* si);
 
 // We can't use malloc(3) in the dynamic linker. We use a linked list of anonymous
 // maps, each a single page in size. The pages are broken up into as many struct soinfo
@@ -89,6 +91,97 @@ static soinfo* solist = &libdl_info;
 static soinfo* sonext = &libdl_info;
 static soinfo* somain; /* main process, always the one after libdl_info */
 
+// The last soinfo::list_serial handed out, and a count of the changes to solist.
+static size_t gSoListSerial = 0;
+static size_t gSoListGeneration = 0;
+
+// Guards solist, the library indexes and the soinfo of every linked library. See linker.h.
+static pthread_rwlock_t gSoListLock = PTHREAD_RWLOCK_INITIALIZER;
+
+void solist_read_lock() {
+  // pthread rwlocks prefer writers, so taking the read lock again while a writer
+  // is waiting would deadlock. Count nested acquisitions per thread instead.
+  if (__get_thread()->dl_read_lock_count++ == 0) {
+    pthread_rwlock_rdlock(&gSoListLock);
+  }
+}
+
+void solist_read_unlock() {
+  if (--__get_thread()->dl_read_lock_count == 0) {
+    pthread_rwlock_unlock(&gSoListLock);
+  }
+}
+
+bool solist_is_read_locked() {
+  return __get_thread()->dl_read_lock_count != 0;
+}
+
+static void solist_write_lock() {
+  pthread_rwlock_wrlock(&gSoListLock);
+}
+
+static void solist_write_unlock() {
+  pthread_rwlock_unlock(&gSoListLock);
+}
+
+class ScopedSoListWriteLocker {
+ public:
+  ScopedSoListWriteLocker() {
+    solist_write_lock();
+  }
+
+  ~ScopedSoListWriteLocker() {
+    solist_write_unlock();
+  }
+
+ private:
+  // Disallow copy and assignment.
+  ScopedSoListWriteLocker(const ScopedSoListWriteLocker&);
+  void operator=(const ScopedSoListWriteLocker&);
+};
+
+// dl_iterate_phdr pins the library its callback is looking at, so that a dlclose(3)
+// meanwhile (from any thread, the callback's included) leaves it mapped until the
+// callback returns. Each pin lives on the stack of the dl_iterate_phdr that made it.
+struct soinfo_pin_t {
+  const soinfo* si;
+  soinfo_pin_t* next;
+};
+static soinfo_pin_t* gSoInfoPins = NULL;
+static pthread_mutex_t gSoInfoPinsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Libraries that were unloaded while pinned. They're out of solist and the lookup
+// tables, but stay mapped (and their soinfo allocated) until nothing pins them.
+static soinfo* gSoInfoUnloaded = NULL;
+
+static void soinfo_pin(soinfo_pin_t* pin, const soinfo* si) {
+  pthread_mutex_lock(&gSoInfoPinsLock);
+  pin->si = si;
+  pin->next = gSoInfoPins;
+  gSoInfoPins = pin;
+  pthread_mutex_unlock(&gSoInfoPinsLock);
+}
+
+static void soinfo_unpin(soinfo_pin_t* pin) {
+  pthread_mutex_lock(&gSoInfoPinsLock);
+  soinfo_pin_t** p = &gSoInfoPins;
+  while (*p != pin) {
+    p = &(*p)->next;
+  }
+  *p = pin->next;
+  pthread_mutex_unlock(&gSoInfoPinsLock);
+}
+
+static bool soinfo_is_pinned(const soinfo* si) {
+  pthread_mutex_lock(&gSoInfoPinsLock);
+  soinfo_pin_t* pin = gSoInfoPins;
+  while (pin != NULL && pin->si != si) {
+    pin = pin->next;
+  }
+  pthread_mutex_unlock(&gSoInfoPinsLock);
+  return pin != NULL;
+}
+
 static const char* const gSoPaths[] = {
 #if __LP64__
   "/vendor/lib64",
@@ -110,6 +203,18 @@ static soinfo* gLdPreloads[LDPRELOAD_MAX + 1];
 
 __LIBC_HIDDEN__ int gLdDebugVerbosity;
 
+// Lazy binding defers resolving JUMP_SLOT relocations until the first call through
+// the PLT. It's enabled for the whole process by LD_BIND_LAZY, or for the libraries
+// loaded by a single dlopen(3) call by RTLD_LAZY. MIPS doesn't use JUMP_SLOT relocations.
+#if defined(ANDROID_ARM_LINKER) || defined(ANDROID_X86_LINKER) || defined(ANDROID_X86_64_LINKER)
+#define LAZY_BINDING_SUPPORTED 1
+extern "C" void __linker_lazy_bind_trampoline();
+#else
+#define LAZY_BINDING_SUPPORTED 0
+#endif
+
+static bool gBindLazily = false;
+
 __LIBC_HIDDEN__ abort_msg_t* gAbortMessage = NULL; // For debuggerd.
 
 enum RelocationKind {
@@ -117,6 +222,7 @@ enum RelocationKind {
     kRelocRelative,
     kRelocCopy,
     kRelocSymbol,
+    kRelocSymbolCached,
     kRelocMax
 };
 
@@ -263,6 +369,117 @@ void notify_gdb_of_libraries() {
     rtld_db_dlactivity();
 }
 
+// Loaded libraries are also indexed by name, so that find_loaded_library doesn't
+// have to strcmp(3) its way along the whole solist. Entries are appended to the
+// end of their bucket's chain, so a lookup still finds the earliest-loaded match.
+#define SOINFO_NAME_HASH_SIZE 256
+
+static soinfo* gSoInfoNameHash[SOINFO_NAME_HASH_SIZE];
+
+static size_t soinfo_name_hash(const char* name) {
+  uint32_t h = 5381;
+  for (const unsigned char* p = reinterpret_cast<const unsigned char*>(name); *p != 0; ++p) {
+    h += (h << 5) + *p;
+  }
+  return h & (SOINFO_NAME_HASH_SIZE - 1);
+}
+
+static void soinfo_name_hash_insert(soinfo* si) {
+  soinfo** p = &gSoInfoNameHash[soinfo_name_hash(si->name)];
+  while (*p != NULL) {
+    p = &(*p)->name_hash_next;
+  }
+  si->name_hash_next = NULL;
+  *p = si;
+}
+
+static void soinfo_name_hash_remove(soinfo* si) {
+  for (soinfo** p = &gSoInfoNameHash[soinfo_name_hash(si->name)]; *p != NULL; p = &(*p)->name_hash_next) {
+    if (*p == si) {
+      *p = si->name_hash_next;
+      si->name_hash_next = NULL;
+      return;
+    }
+  }
+}
+
+static soinfo* soinfo_name_hash_find(const char* name) {
+  for (soinfo* si = gSoInfoNameHash[soinfo_name_hash(name)]; si != NULL; si = si->name_hash_next) {
+    if (!strcmp(name, si->name)) {
+      return si;
+    }
+  }
+  return NULL;
+}
+
+// Linked libraries are also kept in an array sorted by base address, so that
+// find_containing_library (used by dladdr(3) and the unwinder) can binary search.
+// We can't use malloc(3), so the array lives in its own anonymous mapping, which
+// we double in size whenever it fills up.
+static soinfo** gSoInfoByAddress = NULL;
+static size_t gSoInfoByAddressCount = 0;
+static size_t gSoInfoByAddressCapacity = 0;
+
+// Returns the index of the first entry whose base is greater than 'address'.
+static size_t soinfo_address_index_upper_bound(Elf_Addr address) {
+  size_t lo = 0;
+  size_t hi = gSoInfoByAddressCount;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (gSoInfoByAddress[mid]->base <= address) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static bool soinfo_address_index_insert(soinfo* si) {
+  if (si->size == 0) {
+    return true; // Nothing to find.
+  }
+
+  if (gSoInfoByAddressCount == gSoInfoByAddressCapacity) {
+    size_t new_capacity = (gSoInfoByAddressCapacity == 0) ? PAGE_SIZE / sizeof(soinfo*)
+                                                          : gSoInfoByAddressCapacity * 2;
+    size_t new_size = new_capacity * sizeof(soinfo*);
+    void* map = mmap(NULL, new_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      DL_ERR("out of memory when indexing \"%s\"", si->name);
+      return false;
+    }
+    soinfo** new_index = reinterpret_cast<soinfo**>(map);
+    if (gSoInfoByAddress != NULL) {
+      memcpy(new_index, gSoInfoByAddress, gSoInfoByAddressCount * sizeof(soinfo*));
+      munmap(gSoInfoByAddress, gSoInfoByAddressCapacity * sizeof(soinfo*));
+    }
+    gSoInfoByAddress = new_index;
+    gSoInfoByAddressCapacity = new_capacity;
+  }
+
+  size_t i = soinfo_address_index_upper_bound(si->base);
+  memmove(&gSoInfoByAddress[i + 1], &gSoInfoByAddress[i],
+          (gSoInfoByAddressCount - i) * sizeof(soinfo*));
+  gSoInfoByAddress[i] = si;
+  ++gSoInfoByAddressCount;
+  return true;
+}
+
+static void soinfo_address_index_remove(soinfo* si) {
+  for (size_t i = soinfo_address_index_upper_bound(si->base); i > 0; --i) {
+    if (gSoInfoByAddress[i - 1]->base != si->base) {
+      break;
+    }
+    if (gSoInfoByAddress[i - 1] == si) {
+      memmove(&gSoInfoByAddress[i - 1], &gSoInfoByAddress[i],
+              (gSoInfoByAddressCount - i) * sizeof(soinfo*));
+      --gSoInfoByAddressCount;
+      return;
+    }
+  }
+}
+
 static bool ensure_free_list_non_empty() {
   if (gSoInfoFreeList != NULL) {
     return true;
@@ -299,6 +516,23 @@ static void set_soinfo_pool_protection(int protection) {
   }
 }
 
+// The soinfo pools are writable while any dlopen(3), dlclose(3) or dladdr(3) index build
+// needs them to be. These nest (a constructor can call dlopen, say), so only the outermost
+// call makes the pools read-only again. Callers hold gDlMutex.
+static size_t gSoInfoPoolWriters = 0;
+
+static void soinfo_pools_unprotect() {
+  if (gSoInfoPoolWriters++ == 0) {
+    set_soinfo_pool_protection(PROT_READ | PROT_WRITE);
+  }
+}
+
+static void soinfo_pools_protect() {
+  if (--gSoInfoPoolWriters == 0) {
+    set_soinfo_pool_protection(PROT_READ);
+  }
+}
+
 static soinfo* soinfo_alloc(const char* name) {
   if (strlen(name) >= SOINFO_NAME_LEN) {
     DL_ERR("library name \"%s\" too long", name);
@@ -317,23 +551,21 @@ static soinfo* soinfo_alloc(const char* name) {
   // Initialize the new element.
   memset(si, 0, sizeof(soinfo));
   strlcpy(si->name, name, sizeof(si->name));
+  si->list_serial = ++gSoListSerial;
   sonext->next = si;
   sonext = si;
+  ++gSoListGeneration;
+  soinfo_name_hash_insert(si);
 
   TRACE("name %s: allocated soinfo @ %p", name, si);
   return si;
 }
 
-static void soinfo_free(soinfo* si)
+// Takes 'si' out of solist and the lookup tables, so readers can no longer find it.
+static bool soinfo_unlink(soinfo* si)
 {
-    if (si == NULL) {
-        return;
-    }
-
     soinfo *prev = NULL, *trav;
 
-    TRACE("name %s: freeing soinfo @ %p", si->name, si);
-
     for (trav = solist; trav != NULL; trav = trav->next) {
         if (trav == si)
             break;
@@ -342,7 +574,7 @@ static void soinfo_free(soinfo* si)
     if (trav == NULL) {
         /* si was not in solist */
         DL_ERR("name \"%s\" is not in solist!", si->name);
-        return;
+        return false;
     }
 
     /* prev will never be NULL, because the first entry in solist is
@@ -352,10 +584,50 @@ static void soinfo_free(soinfo* si)
     if (si == sonext) {
         sonext = prev;
     }
+    ++gSoListGeneration;
+    soinfo_name_hash_remove(si);
+    soinfo_address_index_remove(si);
+    return true;
+}
+
+// Returns an unlinked soinfo to the free list.
+static void soinfo_release(soinfo* si)
+{
+    soinfo_free_address_index(si);
     si->next = gSoInfoFreeList;
     gSoInfoFreeList = si;
 }
 
+static void soinfo_free(soinfo* si)
+{
+    if (si == NULL) {
+        return;
+    }
+
+    TRACE("name %s: freeing soinfo @ %p", si->name, si);
+
+    if (soinfo_unlink(si)) {
+        soinfo_release(si);
+    }
+}
+
+// Unmaps and frees the libraries in gSoInfoUnloaded that are no longer pinned. The
+// caller holds the write lock and has made the soinfo pools writable.
+static void soinfo_release_unloaded() {
+  soinfo** p = &gSoInfoUnloaded;
+  while (*p != NULL) {
+    soinfo* si = *p;
+    if (soinfo_is_pinned(si)) {
+      p = &si->next;
+      continue;
+    }
+    *p = si->next;
+    TRACE("name %s: freeing unpinned soinfo @ %p", si->name, si);
+    munmap(reinterpret_cast<void*>(si->base), si->size);
+    soinfo_release(si);
+  }
+}
+
 
 static void parse_path(const char* path, const char* delimiters,
                        const char** array, char* buf, size_t buf_size, size_t max_count) {
@@ -406,16 +678,13 @@ static void parse_LD_PRELOAD(const char* path) {
  */
 _Unwind_Ptr dl_unwind_find_exidx(_Unwind_Ptr pc, int *pcount)
 {
-    soinfo *si;
-    unsigned addr = (unsigned)pc;
-
-    for (si = solist; si != 0; si = si->next) {
-        if ((addr >= si->base) && (addr < (si->base + si->size))) {
-            *pcount = si->ARM_exidx_count;
-            return (_Unwind_Ptr)si->ARM_exidx;
-        }
+    ScopedSoListReadLocker locker;
+    soinfo* si = find_containing_library(reinterpret_cast<void*>(pc));
+    if (si != NULL) {
+        *pcount = si->ARM_exidx_count;
+        return (_Unwind_Ptr)si->ARM_exidx;
     }
-   *pcount = 0;
+    *pcount = 0;
     return NULL;
 }
 
@@ -424,27 +693,173 @@ _Unwind_Ptr dl_unwind_find_exidx(_Unwind_Ptr pc, int *pcount)
 /* Here, we only have to provide a callback to iterate across all the
  * loaded libraries. gcc_eh does the rest. */
 int
-dl_iterate_phdr(int (*cb)(dl_phdr_info *info, size_t size, void *data),
-                void *data)
+do_dl_iterate_phdr(int (*cb)(dl_phdr_info *info, size_t size, void *data),
+                   void *data)
 {
+    ScopedSoListReadLocker locker;
     int rv = 0;
-    for (soinfo* si = solist; si != NULL; si = si->next) {
+    soinfo* si = solist;
+    while (si != NULL) {
+        if ((si->flags & FLAG_LOADING) != 0) {
+            si = si->next;
+            continue;
+        }
         dl_phdr_info dl_info;
         dl_info.dlpi_addr = si->link_map.l_addr;
         dl_info.dlpi_name = si->link_map.l_name;
         dl_info.dlpi_phdr = si->phdr;
         dl_info.dlpi_phnum = si->phnum;
+
+        // The callback runs without the read lock, so that it can call dlopen(3) and
+        // dlclose(3); the pin keeps what dl_info points to mapped until it returns. If
+        // solist changed meanwhile, 'si' may have been unloaded, so pick up from the
+        // first library loaded after it instead.
+        size_t serial = si->list_serial;
+        size_t generation = gSoListGeneration;
+        soinfo_pin_t pin;
+        soinfo_pin(&pin, si);
+        solist_read_unlock();
         rv = cb(&dl_info, sizeof(dl_phdr_info), data);
+        soinfo_unpin(&pin);
+        solist_read_lock();
         if (rv != 0) {
             break;
         }
+        if (gSoListGeneration == generation) {
+            si = si->next;
+        } else {
+            for (si = solist; si != NULL && si->list_serial <= serial; si = si->next) {
+            }
+        }
     }
     return rv;
 }
 
-static Elf_Sym* soinfo_elf_lookup(soinfo* si, unsigned hash, const char* name) {
+// Returns true if a library unloaded while dl_iterate_phdr had it pinned is still mapped.
+bool dl_has_unloaded_libraries() {
+  ScopedSoListReadLocker locker;
+  return gSoInfoUnloaded != NULL;
+}
+
+// Unmaps the unloaded libraries that are no longer pinned. The caller holds gDlMutex.
+void do_dl_release_unloaded_libraries() {
+  soinfo_pools_unprotect();
+  {
+    ScopedSoListWriteLocker locker;
+    soinfo_release_unloaded();
+  }
+  soinfo_pools_protect();
+}
+
+// Lazily computes (and caches) the SysV and GNU hashes of a symbol name, so that
+// looking a name up across many libraries only hashes it once per hash style.
+class SymbolName {
+ public:
+  explicit SymbolName(const char* name)
+      : name_(name), has_elf_hash_(false), has_gnu_hash_(false),
+        elf_hash_(0), gnu_hash_(0) {
+  }
+
+  const char* get_name() const {
+    return name_;
+  }
+
+  uint32_t elf_hash() {
+    if (!has_elf_hash_) {
+      const unsigned char* name = reinterpret_cast<const unsigned char*>(name_);
+      uint32_t h = 0, g;
+
+      while (*name) {
+        h = (h << 4) + *name++;
+        g = h & 0xf0000000;
+        h ^= g;
+        h ^= g >> 24;
+      }
+
+      elf_hash_ = h;
+      has_elf_hash_ = true;
+    }
+    return elf_hash_;
+  }
+
+  uint32_t gnu_hash() {
+    if (!has_gnu_hash_) {
+      const unsigned char* name = reinterpret_cast<const unsigned char*>(name_);
+      uint32_t h = 5381;
+
+      while (*name != 0) {
+        h += (h << 5) + *name++; // h*33 + c = h + h * 32 + c = h + h << 5 + c
+      }
+
+      gnu_hash_ = h;
+      has_gnu_hash_ = true;
+    }
+    return gnu_hash_;
+  }
+
+ private:
+  const char* name_;
+  bool has_elf_hash_;
+  bool has_gnu_hash_;
+  uint32_t elf_hash_;
+  uint32_t gnu_hash_;
+};
+
+/* only concern ourselves with global and weak symbol definitions */
+static bool is_symbol_global_and_defined(const Elf_Sym* s) {
+    switch (ELF_ST_BIND(s->st_info)) {
+    case STB_GLOBAL:
+    case STB_WEAK:
+        return s->st_shndx != SHN_UNDEF;
+    }
+    return false;
+}
+
+static Elf_Sym* soinfo_gnu_lookup(soinfo* si, SymbolName& symbol_name) {
+    const char* name = symbol_name.get_name();
+    uint32_t hash = symbol_name.gnu_hash();
+    const uint32_t kBloomMaskBits = sizeof(Elf_Addr) * 8;
+
+    TRACE_TYPE(LOOKUP, "SEARCH %s in %s@%p (gnu) %x %zd",
+               name, si->name, reinterpret_cast<void*>(si->base), hash, hash % si->gnu_nbucket);
+
+    // Reject the library outright if the bloom filter says it can't define this symbol.
+    uint32_t word_num = (hash / kBloomMaskBits) & si->gnu_maskwords;
+    Elf_Addr bloom_word = si->gnu_bloom_filter[word_num];
+    uint32_t h1 = hash % kBloomMaskBits;
+    uint32_t h2 = (hash >> si->gnu_shift2) % kBloomMaskBits;
+
+    if ((1 & (bloom_word >> h1) & (bloom_word >> h2)) == 0) {
+        return NULL;
+    }
+
+    uint32_t n = si->gnu_bucket[hash % si->gnu_nbucket];
+    if (n == 0) {
+        return NULL;
+    }
+
+    // The low bit of each chain entry marks the end of the chain; the other 31
+    // bits are the symbol's own hash, which lets us skip most strcmp(3) calls.
+    do {
+        Elf_Sym* s = si->symtab + n;
+        if (((si->gnu_chain[n] ^ hash) >> 1) == 0 &&
+            strcmp(si->strtab + s->st_name, name) == 0 &&
+            is_symbol_global_and_defined(s)) {
+            TRACE_TYPE(LOOKUP, "FOUND %s in %s (%p) %zd",
+                       name, si->name, reinterpret_cast<void*>(s->st_value),
+                       static_cast<size_t>(s->st_size));
+            return s;
+        }
+    } while ((si->gnu_chain[n++] & 1) == 0);
+
+    return NULL;
+}
+
+static Elf_Sym* soinfo_sysv_lookup(soinfo* si, SymbolName& symbol_name) {
     Elf_Sym* symtab = si->symtab;
     const char* strtab = si->strtab;
+    const char* name = symbol_name.get_name();
+    uint32_t hash = symbol_name.elf_hash();
 
     TRACE_TYPE(LOOKUP, "SEARCH %s in %s@%p %x %zd",
                name, si->name, reinterpret_cast<void*>(si->base), hash, hash % si->nbucket);
@@ -453,14 +868,7 @@ static Elf_Sym* soinfo_elf_lookup(soinfo* si, unsigned hash, const char* name) {
         Elf_Sym* s = symtab + n;
         if (strcmp(strtab + s->st_name, name)) continue;
 
-            /* only concern ourselves with global and weak symbol definitions */
-        switch (ELF_ST_BIND(s->st_info)) {
-        case STB_GLOBAL:
-        case STB_WEAK:
-            if (s->st_shndx == SHN_UNDEF) {
-                continue;
-            }
-
+        if (is_symbol_global_and_defined(s)) {
             TRACE_TYPE(LOOKUP, "FOUND %s in %s (%p) %zd",
                        name, si->name, reinterpret_cast<void*>(s->st_value),
                        static_cast<size_t>(s->st_size));
@@ -471,21 +879,15 @@ static Elf_Sym* soinfo_elf_lookup(soinfo* si, unsigned hash, const char* name) {
     return NULL;
 }
 
-static unsigned elfhash(const char* _name) {
-    const unsigned char* name = (const unsigned char*) _name;
-    unsigned h = 0, g;
-
-    while(*name) {
-        h = (h << 4) + *name++;
-        g = h & 0xf0000000;
-        h ^= g;
-        h ^= g >> 24;
+static Elf_Sym* soinfo_elf_lookup(soinfo* si, SymbolName& symbol_name) {
+    if ((si->flags & FLAG_GNU_HASH) != 0) {
+        return soinfo_gnu_lookup(si, symbol_name);
     }
-    return h;
+    return soinfo_sysv_lookup(si, symbol_name);
 }
 
 static Elf_Sym* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soinfo* needed[]) {
-    unsigned elf_hash = elfhash(name);
+    SymbolName symbol_name(name);
     Elf_Sym* s = NULL;
 
     if (si != NULL && somain != NULL) {
@@ -496,7 +898,7 @@ static Elf_Sym* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soi
          */
 
         if (si == somain) {
-            s = soinfo_elf_lookup(si, elf_hash, name);
+            s = soinfo_elf_lookup(si, symbol_name);
             if (s != NULL) {
                 *lsi = si;
                 goto done;
@@ -513,7 +915,7 @@ static Elf_Sym* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soi
             if (!si->has_DT_SYMBOLIC) {
                 DEBUG("%s: looking up %s in executable %s",
                       si->name, name, somain->name);
-                s = soinfo_elf_lookup(somain, elf_hash, name);
+                s = soinfo_elf_lookup(somain, symbol_name);
                 if (s != NULL) {
                     *lsi = somain;
                     goto done;
@@ -530,7 +932,7 @@ static Elf_Sym* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soi
              * and some the first non-weak definition.   This is system dependent.
              * Here we return the first definition found for simplicity.  */
 
-            s = soinfo_elf_lookup(si, elf_hash, name);
+            s = soinfo_elf_lookup(si, symbol_name);
             if (s != NULL) {
                 *lsi = si;
                 goto done;
@@ -544,7 +946,7 @@ static Elf_Sym* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soi
             if (si->has_DT_SYMBOLIC) {
                 DEBUG("%s: looking up %s in executable %s after local scope",
                       si->name, name, somain->name);
-                s = soinfo_elf_lookup(somain, elf_hash, name);
+                s = soinfo_elf_lookup(somain, symbol_name);
                 if (s != NULL) {
                     *lsi = somain;
                     goto done;
@@ -555,7 +957,7 @@ static Elf_Sym* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soi
 
     /* Next, look for it in the preloads list */
     for (int i = 0; gLdPreloads[i] != NULL; i++) {
-        s = soinfo_elf_lookup(gLdPreloads[i], elf_hash, name);
+        s = soinfo_elf_lookup(gLdPreloads[i], symbol_name);
         if (s != NULL) {
             *lsi = gLdPreloads[i];
             goto done;
@@ -565,7 +967,7 @@ static Elf_Sym* soinfo_do_lookup(soinfo* si, const char* name, soinfo** lsi, soi
     for (int i = 0; needed[i] != NULL; i++) {
         DEBUG("%s: looking up %s in %s",
               si->name, name, needed[i]->name);
-        s = soinfo_elf_lookup(needed[i], elf_hash, name);
+        s = soinfo_elf_lookup(needed[i], symbol_name);
         if (s != NULL) {
             *lsi = needed[i];
             goto done;
@@ -585,6 +987,45 @@ done:
     return NULL;
 }
 
+// Relocation tables frequently refer to the same symbol index several times
+// (a JUMP_SLOT and a GLOB_DAT for the same function, C++ vtables, ...), so we
+// remember the result of recent lookups by symbol index while relocating a
+// library. This is a direct-mapped cache: it's reset before each library is
+// relocated, and a collision just costs us a regular lookup.
+#define SYMBOL_CACHE_SIZE 512
+
+struct symbol_cache_entry_t {
+    unsigned sym;
+    soinfo* lsi;
+    Elf_Sym* s;
+};
+
+static symbol_cache_entry_t gSymbolCache[SYMBOL_CACHE_SIZE];
+
+static void symbol_cache_reset() {
+    // Symbol index 0 is STN_UNDEF, which is never looked up, so all-zeroes is an empty cache.
+    memset(gSymbolCache, 0, sizeof(gSymbolCache));
+}
+
+static Elf_Sym* soinfo_do_cached_lookup(soinfo* si, unsigned sym, soinfo** lsi, soinfo* needed[]) {
+    symbol_cache_entry_t* entry = &gSymbolCache[sym % SYMBOL_CACHE_SIZE];
+    if (entry->sym == sym) {
+        count_relocation(kRelocSymbolCached);
+        *lsi = entry->lsi;
+        return entry->s;
+    }
+
+    const char* sym_name = si->strtab + si->symtab[sym].st_name;
+    soinfo* found = NULL;
+    Elf_Sym* s = soinfo_do_lookup(si, sym_name, &found, needed);
+
+    entry->sym = sym;
+    entry->lsi = found;
+    entry->s = s;
+    *lsi = found;
+    return s;
+}
+
 /* This is used by dlsym(3).  It performs symbol lookup only within the
    specified soinfo object and not in any of its dependencies.
 
@@ -595,7 +1036,8 @@ done:
    Object Dependencies" in breadth first search order.
  */
 Elf_Sym* dlsym_handle_lookup(soinfo* si, const char* name) {
-    return soinfo_elf_lookup(si, elfhash(name), name);
+    SymbolName symbol_name(name);
+    return soinfo_elf_lookup(si, symbol_name);
 }
 
 /* This is used by dlsym(3) to performs a global symbol lookup. If the
@@ -604,7 +1046,7 @@ Elf_Sym* dlsym_handle_lookup(soinfo* si, const char* name) {
    specified soinfo (for RTLD_NEXT).
  */
 Elf_Sym* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start) {
-  unsigned elf_hash = elfhash(name);
+  SymbolName symbol_name(name);
 
   if (start == NULL) {
     start = solist;
@@ -612,7 +1054,10 @@ Elf_Sym* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start) {
 
   Elf_Sym* s = NULL;
   for (soinfo* si = start; (s == NULL) && (si != NULL); si = si->next) {
-    s = soinfo_elf_lookup(si, elf_hash, name);
+    if ((si->flags & FLAG_LOADING) != 0) {
+      continue;
+    }
+    s = soinfo_elf_lookup(si, symbol_name);
     if (s != NULL) {
       *found = si;
       break;
@@ -629,24 +1074,50 @@ Elf_Sym* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start) {
 
 soinfo* find_containing_library(const void* p) {
   Elf_Addr address = reinterpret_cast<Elf_Addr>(p);
-  for (soinfo* si = solist; si != NULL; si = si->next) {
-    if (address >= si->base && address - si->base < si->size) {
-      return si;
-    }
+  // Libraries don't overlap, so only the last one starting at or below 'address' can contain it.
+  size_t i = soinfo_address_index_upper_bound(address);
+  if (i == 0) {
+    return NULL;
+  }
+  soinfo* si = gSoInfoByAddress[i - 1];
+  if (address - si->base < si->size) {
+    return si;
   }
   return NULL;
 }
 
-Elf_Sym* dladdr_find_symbol(soinfo* si, const void* addr) {
-  Elf_Addr soaddr = reinterpret_cast<Elf_Addr>(addr) - si->base;
+static bool symbol_matches_soaddr(const Elf_Sym* sym, Elf_Addr soaddr) {
+  return sym->st_shndx != SHN_UNDEF &&
+      soaddr >= sym->st_value &&
+      soaddr < sym->st_value + sym->st_size;
+}
+
+static Elf_Sym* gnu_addr_lookup(soinfo* si, Elf_Addr soaddr) {
+  // DT_GNU_HASH doesn't record the size of the symbol table, so walk every
+  // bucket's chain instead; together they cover every hashed symbol.
+  for (size_t i = 0; i < si->gnu_nbucket; ++i) {
+    uint32_t n = si->gnu_bucket[i];
+    if (n == 0) {
+      continue;
+    }
+
+    do {
+      Elf_Sym* sym = &si->symtab[n];
+      if (symbol_matches_soaddr(sym, soaddr)) {
+        return sym;
+      }
+    } while ((si->gnu_chain[n++] & 1) == 0);
+  }
+
+  return NULL;
+}
 
+static Elf_Sym* elf_addr_lookup(soinfo* si, Elf_Addr soaddr) {
   // Search the library's symbol table for any defined symbol which
   // contains this address.
   for (size_t i = 0; i < si->nchain; ++i) {
     Elf_Sym* sym = &si->symtab[i];
-    if (sym->st_shndx != SHN_UNDEF &&
-        soaddr >= sym->st_value &&
-        soaddr < sym->st_value + sym->st_size) {
+    if (symbol_matches_soaddr(sym, soaddr)) {
       return sym;
     }
   }
@@ -654,6 +1125,246 @@ Elf_Sym* dladdr_find_symbol(soinfo* si, const void* addr) {
   return NULL;
 }
 
+// An STT_GNU_IFUNC symbol's value is the address of a resolver that returns the
+// address of the implementation to use (typically chosen by CPU features), and an
+// R_*_IRELATIVE relocation stores what the resolver at the addend returns. The
+// resolvers run while their library is still being relocated, so they mustn't
+// depend on anything that needs relocations or libc initialization.
+typedef Elf_Addr (*ifunc_resolver_t)();
+
+static Elf_Addr call_ifunc_resolver(Elf_Addr resolver_addr) {
+  Elf_Addr result = reinterpret_cast<ifunc_resolver_t>(resolver_addr)();
+  TRACE_TYPE(RELO, "Called ifunc resolver @ %p: got %p", reinterpret_cast<void*>(resolver_addr),
+             reinterpret_cast<void*>(result));
+  return result;
+}
+
+Elf_Addr soinfo_symbol_address(soinfo* si, Elf_Sym* s) {
+  Elf_Addr addr = static_cast<Elf_Addr>(s->st_value + si->load_bias);
+  if (ELF_ST_TYPE(s->st_info) == STT_GNU_IFUNC) {
+    return call_ifunc_resolver(addr);
+  }
+  return addr;
+}
+
+static void add_address_symbol(soinfo* si, uint32_t n, symbol_address_entry_t* entries, size_t* count) {
+  Elf_Sym* sym = &si->symtab[n];
+  // A symbol of size zero can never contain an address.
+  if (sym->st_shndx == SHN_UNDEF || sym->st_size == 0) {
+    return;
+  }
+  if (entries != NULL) {
+    if (ELF_ST_TYPE(sym->st_info) == STT_GNU_IFUNC) {
+      // dlsym(3) hands out the implementation, so map it back to the IFUNC symbol.
+      // Its end is filled in once the index is sorted.
+      entries[*count].value = soinfo_symbol_address(si, sym) - si->load_bias;
+      entries[*count].end = 0;
+    } else {
+      entries[*count].value = sym->st_value;
+      entries[*count].end = sym->st_value + sym->st_size;
+    }
+    entries[*count].max_end = 0;
+    entries[*count].sym = n;
+  }
+  ++*count;
+}
+
+// Counts the symbols that belong in the address index and, if 'entries' isn't
+// NULL, fills it in.
+static size_t collect_address_symbols(soinfo* si, symbol_address_entry_t* entries) {
+  size_t count = 0;
+  if ((si->flags & FLAG_GNU_HASH) != 0) {
+    for (size_t i = 0; i < si->gnu_nbucket; ++i) {
+      uint32_t n = si->gnu_bucket[i];
+      if (n == 0) {
+        continue;
+      }
+      do {
+        add_address_symbol(si, n, entries, &count);
+      } while ((si->gnu_chain[n++] & 1) == 0);
+    }
+  } else {
+    for (size_t i = 0; i < si->nchain; ++i) {
+      add_address_symbol(si, i, entries, &count);
+    }
+  }
+  return count;
+}
+
+static int compare_address_entries(const void* lhs, const void* rhs) {
+  const symbol_address_entry_t* l = reinterpret_cast<const symbol_address_entry_t*>(lhs);
+  const symbol_address_entry_t* r = reinterpret_cast<const symbol_address_entry_t*>(rhs);
+  if (l->value != r->value) {
+    return (l->value < r->value) ? -1 : 1;
+  }
+  // Prefer lower symbol table indexes among aliases, as the linear search did.
+  return (l->sym < r->sym) ? -1 : (l->sym > r->sym);
+}
+
+static bool is_ifunc_address_entry(soinfo* si, const symbol_address_entry_t* entry) {
+  return ELF_ST_TYPE(si->symtab[entry->sym].st_info) == STT_GNU_IFUNC;
+}
+
+static size_t address_index_byte_size(size_t count) {
+  return PAGE_END(count * sizeof(symbol_address_entry_t));
+}
+
+// Builds the dladdr index for 'si', calling the resolvers of its IFUNCs. Returns NULL
+// if there's nothing to index or no memory to index it in.
+static symbol_address_entry_t* soinfo_build_address_index(soinfo* si, size_t* index_count) {
+  size_t count = collect_address_symbols(si, NULL);
+  if (count == 0) {
+    return NULL;
+  }
+
+  void* map = mmap(NULL, address_index_byte_size(count), PROT_READ|PROT_WRITE,
+                   MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  symbol_address_entry_t* entries = reinterpret_cast<symbol_address_entry_t*>(map);
+  collect_address_symbols(si, entries);
+  qsort(entries, count, sizeof(*entries), compare_address_entries);
+
+  // An IFUNC covers exactly its implementation's own dynamic symbol, and stands in
+  // for it. An implementation without one (a hidden or static function, as in libc)
+  // has no known size, so its IFUNC covers nothing rather than whatever follows it.
+  for (size_t run = 0; run < count; ) {
+    size_t run_end = run;
+    Elf_Addr implementation_end = 0;
+    for (; run_end < count && entries[run_end].value == entries[run].value; ++run_end) {
+      const symbol_address_entry_t* entry = &entries[run_end];
+      if (!is_ifunc_address_entry(si, entry) && entry->end > implementation_end) {
+        implementation_end = entry->end;
+      }
+    }
+    bool has_ifunc = false;
+    for (size_t i = run; i < run_end; ++i) {
+      if (is_ifunc_address_entry(si, &entries[i])) {
+        has_ifunc = true;
+        entries[i].end = (implementation_end != 0) ? implementation_end : entries[i].value;
+      }
+    }
+    for (size_t i = run; has_ifunc && implementation_end != 0 && i < run_end; ++i) {
+      if (!is_ifunc_address_entry(si, &entries[i]) && entries[i].end == implementation_end) {
+        entries[i].end = entries[i].value;
+      }
+    }
+    run = run_end;
+  }
+
+  Elf_Addr max_end = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (entries[i].end > max_end) {
+      max_end = entries[i].end;
+    }
+    entries[i].max_end = max_end;
+  }
+
+  TRACE("[ built dladdr index of %zd symbols for '%s' ]", count, si->name);
+  *index_count = count;
+  return entries;
+}
+
+static void soinfo_free_address_index(soinfo* si) {
+  if (si->symbol_address_index != NULL) {
+    munmap(si->symbol_address_index, address_index_byte_size(si->symbol_address_index_count));
+    si->symbol_address_index = NULL;
+    si->symbol_address_index_count = 0;
+  }
+}
+
+static const symbol_address_entry_t* indexed_addr_lookup(soinfo* si, Elf_Addr soaddr) {
+  const symbol_address_entry_t* entries = si->symbol_address_index;
+
+  // Find the first entry starting after 'soaddr'.
+  size_t lo = 0;
+  size_t hi = si->symbol_address_index_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (entries[mid].value <= soaddr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // Walk back through the entries that start at or before 'soaddr' until none of
+  // the remaining ones can reach it. This is usually only a step or two: aliases
+  // and the odd symbol nested inside another one.
+  const symbol_address_entry_t* result = NULL;
+  for (size_t i = lo; i > 0 && entries[i - 1].max_end > soaddr; --i) {
+    if (entries[i - 1].end > soaddr && (result == NULL || entries[i - 1].sym < result->sym)) {
+      result = &entries[i - 1];
+    }
+  }
+  return result;
+}
+
+// Returns true if the library containing 'addr' hasn't had its dladdr index built yet.
+bool dladdr_needs_address_index(const void* addr) {
+  ScopedSoListReadLocker locker;
+  soinfo* si = find_containing_library(addr);
+  return si != NULL && si->symbol_address_index == NULL;
+}
+
+// Builds the dladdr index for the library containing 'addr'. The caller holds gDlMutex,
+// so the library can't be unloaded or indexed by anyone else meanwhile.
+void do_dladdr_build_address_index(const void* addr) {
+  // IFUNC resolvers may call dlsym(3) or dladdr(3), so build the index, which runs
+  // them, under the read lock, and only take the write lock to publish it.
+  soinfo* si;
+  symbol_address_entry_t* entries;
+  size_t count;
+  {
+    ScopedSoListReadLocker locker;
+    // Check again: the library may have been indexed or unloaded since we last looked.
+    si = find_containing_library(addr);
+    if (si == NULL || si->symbol_address_index != NULL) {
+      return;
+    }
+    entries = soinfo_build_address_index(si, &count);
+    if (entries == NULL) {
+      return;
+    }
+  }
+
+  // dladdr(3) is called with the soinfo pools read-only.
+  soinfo_pools_unprotect();
+  {
+    ScopedSoListWriteLocker locker;
+    si->symbol_address_index = entries;
+    si->symbol_address_index_count = count;
+  }
+  soinfo_pools_protect();
+}
+
+Elf_Sym* dladdr_find_symbol(soinfo* si, const void* addr, Elf_Addr* sym_addr) {
+  Elf_Addr soaddr = reinterpret_cast<Elf_Addr>(addr) - si->base;
+
+  if (si->symbol_address_index != NULL) {
+    const symbol_address_entry_t* entry = indexed_addr_lookup(si, soaddr);
+    if (entry == NULL) {
+      return NULL;
+    }
+    *sym_addr = si->load_bias + entry->value;
+    return &si->symtab[entry->sym];
+  }
+
+  // Fall back to a linear search if the index couldn't be built (or couldn't be
+  // built without a deadlock, because this thread holds the read lock).
+  Elf_Sym* sym;
+  if ((si->flags & FLAG_GNU_HASH) != 0) {
+    sym = gnu_addr_lookup(si, soaddr);
+  } else {
+    sym = elf_addr_lookup(si, soaddr);
+  }
+  if (sym != NULL) {
+    *sym_addr = si->load_bias + sym->st_value;
+  }
+  return sym;
+}
+
 #if 0
 static void dump(soinfo* si)
 {
@@ -703,17 +1414,24 @@ static int open_library(const char* name) {
   return fd;
 }
 
+// Called with the write lock held, but drops it while opening and mapping the file
+// so that readers aren't held up by the I/O. gDlMutex keeps other writers out.
 static soinfo* load_library(const char* name) {
+    solist_write_unlock();
+
     // Open the file.
     int fd = open_library(name);
     if (fd == -1) {
+        solist_write_lock();
         DL_ERR("library \"%s\" not found", name);
         return NULL;
     }
 
     // Read the ELF header and load the segments.
     ElfReader elf_reader(name, fd);
-    if (!elf_reader.Load()) {
+    bool loaded = elf_reader.Load();
+    solist_write_lock();
+    if (!loaded) {
         return NULL;
     }
 
@@ -725,7 +1443,7 @@ static soinfo* load_library(const char* name) {
     si->base = elf_reader.load_start();
     si->size = elf_reader.load_size();
     si->load_bias = elf_reader.load_bias();
-    si->flags = 0;
+    si->flags = FLAG_LOADING;
     si->entry = 0;
     si->dynamic = NULL;
     si->phnum = elf_reader.phdr_count();
@@ -735,7 +1453,6 @@ static soinfo* load_library(const char* name) {
 
 static soinfo *find_loaded_library(const char *name)
 {
-    soinfo *si;
     const char *bname;
 
     // TODO: don't use basename only for determining libraries
@@ -744,12 +1461,7 @@ static soinfo *find_loaded_library(const char *name)
     bname = strrchr(name, '/');
     bname = bname ? bname + 1 : name;
 
-    for (si = solist; si != NULL; si = si->next) {
-        if (!strcmp(bname, si->name)) {
-            return si;
-        }
-    }
-    return NULL;
+    return soinfo_name_hash_find(bname);
 }
 
 static soinfo* find_library_internal(const char* name) {
@@ -807,10 +1519,21 @@ static int soinfo_unload(soinfo* si) {
       }
     }
 
-    munmap(reinterpret_cast<void*>(si->base), si->size);
+    ScopedSoListWriteLocker locker;
     notify_gdb_of_unload(si);
-    soinfo_free(si);
+    if (soinfo_is_pinned(si)) {
+      // A dl_iterate_phdr callback is looking at it. Hide it from readers now, and
+      // unmap it once it's unpinned.
+      TRACE("deferring unmapping pinned '%s'", si->name);
+      soinfo_unlink(si);
+      si->next = gSoInfoUnloaded;
+      gSoInfoUnloaded = si;
+    } else {
+      munmap(reinterpret_cast<void*>(si->base), si->size);
+      soinfo_free(si);
+    }
     si->ref_count = 0;
+    soinfo_release_unloaded();
   } else {
     si->ref_count--;
     TRACE("not unloading '%s', decrementing ref_count to %zd", si->name, si->ref_count);
@@ -829,19 +1552,29 @@ soinfo* do_dlopen(const char* name, int flags) {
     DL_ERR("invalid flags to dlopen: %x", flags);
     return NULL;
   }
-  set_soinfo_pool_protection(PROT_READ | PROT_WRITE);
-  soinfo* si = find_library(name);
+  soinfo_pools_unprotect();
+  soinfo* si;
+  {
+    // Readers may see the new libraries as soon as they're linked, before their
+    // constructors have run; we don't want to hold them up for the constructors.
+    ScopedSoListWriteLocker locker;
+    // LD_BIND_LAZY applies to every library; RTLD_LAZY only to the ones this call loads.
+    bool old_bind_lazily = gBindLazily;
+    gBindLazily = old_bind_lazily || (flags & RTLD_LAZY) != 0;
+    si = find_library(name);
+    gBindLazily = old_bind_lazily;
+  }
   if (si != NULL) {
     si->CallConstructors();
   }
-  set_soinfo_pool_protection(PROT_READ);
+  soinfo_pools_protect();
   return si;
 }
 
 int do_dlclose(soinfo* si) {
-  set_soinfo_pool_protection(PROT_READ | PROT_WRITE);
+  soinfo_pools_unprotect();
   int result = soinfo_unload(si);
-  set_soinfo_pool_protection(PROT_READ);
+  soinfo_pools_protect();
   return result;
 }
 
@@ -866,7 +1599,7 @@ static int soinfo_relocate_a(soinfo* si, Elf_Rela* rela, unsigned count, soinfo*
     }
     if (sym != 0) {
       sym_name = (char *)(strtab + symtab[sym].st_name);
-      s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+      s = soinfo_do_cached_lookup(si, sym, &lsi, needed);
       if (s == NULL) {
         // We only allow an undefined symbol if this is a weak reference...
         s = &symtab[sym];
@@ -905,7 +1638,7 @@ static int soinfo_relocate_a(soinfo* si, Elf_Rela* rela, unsigned count, soinfo*
         }
       } else {
         // We got a definition.
-        sym_addr = static_cast<Elf_Addr>(s->st_value + lsi->load_bias);
+        sym_addr = soinfo_symbol_address(lsi, s);
       }
       count_relocation(kRelocSymbol);
     } else {
@@ -938,6 +1671,13 @@ static int soinfo_relocate_a(soinfo* si, Elf_Rela* rela, unsigned count, soinfo*
                  static_cast<size_t>(si->base));
       *reinterpret_cast<Elf_Addr*>(reloc) = si->base + rela->r_addend;
       break;
+    case R_X86_64_IRELATIVE:
+      count_relocation(kRelocRelative);
+      MARK(rela->r_offset);
+      TRACE_TYPE(RELO, "RELO IRELATIVE %08zx <- ifunc @ %08zx", static_cast<size_t>(reloc),
+                 static_cast<size_t>(si->base + rela->r_addend));
+      *reinterpret_cast<Elf_Addr*>(reloc) = call_ifunc_resolver(si->base + rela->r_addend);
+      break;
 
     case R_X86_64_32:
       count_relocation(kRelocRelative);
@@ -986,7 +1726,7 @@ static int soinfo_relocate(soinfo* si, Elf_Rel* rel, unsigned count,
         }
         if (sym != 0) {
             sym_name = (char *)(strtab + symtab[sym].st_name);
-            s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+            s = soinfo_do_cached_lookup(si, sym, &lsi, needed);
             if (s == NULL) {
                 /* We only allow an undefined symbol if this is a weak
                    reference..   */
@@ -1052,7 +1792,7 @@ static int soinfo_relocate(soinfo* si, Elf_Rel* rel, unsigned count,
                     return -1;
                 }
 #endif
-                sym_addr = static_cast<Elf_Addr>(s->st_value + lsi->load_bias);
+                sym_addr = soinfo_symbol_address(lsi, s);
             }
             count_relocation(kRelocSymbol);
         } else {
@@ -1132,6 +1872,21 @@ static int soinfo_relocate(soinfo* si, Elf_Rel* rel, unsigned count,
             *reinterpret_cast<Elf_Addr*>(reloc) += si->base;
             break;
 
+#if defined(ANDROID_ARM_LINKER)
+        case R_ARM_IRELATIVE:
+#elif defined(ANDROID_X86_LINKER)
+        case R_386_IRELATIVE:
+#endif /* ANDROID_*_LINKER */
+#if defined(ANDROID_ARM_LINKER) || defined(ANDROID_X86_LINKER)
+            count_relocation(kRelocRelative);
+            MARK(rel->r_offset);
+            TRACE_TYPE(RELO, "RELO IRELATIVE %p <- ifunc @ %p", reinterpret_cast<void*>(reloc),
+                       reinterpret_cast<void*>(si->base + *reinterpret_cast<Elf_Addr*>(reloc)));
+            *reinterpret_cast<Elf_Addr*>(reloc) =
+                call_ifunc_resolver(si->base + *reinterpret_cast<Elf_Addr*>(reloc));
+            break;
+#endif
+
 #if defined(ANDROID_X86_LINKER)
         case R_386_32:
             count_relocation(kRelocRelative);
@@ -1271,6 +2026,114 @@ static bool mips_relocate_got(soinfo* si, soinfo* needed[]) {
 }
 #endif
 
+#if defined(ANDROID_X86_64_LINKER)
+typedef Elf_Rela plt_reloc_t;
+#define PLT_RELOCS(si) ((si)->plt_rela)
+#define PLT_RELOC_COUNT(si) ((si)->plt_rela_count)
+#define PLT_RELOC_ADDEND(r) ((r)->r_addend)
+#else
+typedef Elf_Rel plt_reloc_t;
+#define PLT_RELOCS(si) ((si)->plt_rel)
+#define PLT_RELOC_COUNT(si) ((si)->plt_rel_count)
+#define PLT_RELOC_ADDEND(r) 0
+#endif
+
+static bool is_jump_slot_relocation(unsigned type) {
+#if defined(ANDROID_ARM_LINKER)
+    return type == R_ARM_JUMP_SLOT;
+#elif defined(ANDROID_X86_LINKER)
+    return type == R_386_JMP_SLOT;
+#elif defined(ANDROID_X86_64_LINKER)
+    return type == R_X86_64_JUMP_SLOT;
+#else
+    (void) type;
+    return false;
+#endif
+}
+
+// Lazy binding needs the PLT's GOT (whose first entries we fill in for the PLT0
+// stub), and a DT_JMPREL table that only contains JUMP_SLOT relocations, because
+// the trampoline identifies the symbol to bind by its index in that table.
+static bool soinfo_can_bind_lazily(soinfo* si) {
+    if (!LAZY_BINDING_SUPPORTED || (si->flags & FLAG_LINKER) != 0) {
+        return false;
+    }
+    if (si->plt_got == NULL || PLT_RELOCS(si) == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < PLT_RELOC_COUNT(si); ++i) {
+        if (!is_jump_slot_relocation(ELF_R_TYPE(PLT_RELOCS(si)[i].r_info))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void soinfo_prepare_lazy_binding(soinfo* si) {
+#if LAZY_BINDING_SUPPORTED
+    // GOT[1] and GOT[2] are reserved for the dynamic linker: PLT0 passes GOT[1]
+    // to the resolver it finds in GOT[2].
+    Elf_Addr* got = reinterpret_cast<Elf_Addr*>(si->plt_got);
+    got[1] = reinterpret_cast<Elf_Addr>(si);
+    got[2] = reinterpret_cast<Elf_Addr>(&__linker_lazy_bind_trampoline);
+
+    // Each JUMP_SLOT initially points back into the PLT at link-time addresses.
+    for (size_t i = 0; i < PLT_RELOC_COUNT(si); ++i) {
+        plt_reloc_t* rel = &PLT_RELOCS(si)[i];
+        Elf_Addr reloc = static_cast<Elf_Addr>(rel->r_offset + si->load_bias);
+        MARK(rel->r_offset);
+        *reinterpret_cast<Elf_Addr*>(reloc) += si->load_bias;
+    }
+#else
+    (void) si;
+#endif
+}
+
+Elf_Addr do_lazy_bind(soinfo* si, size_t plt_reloc_index) {
+    plt_reloc_t* rel = &PLT_RELOCS(si)[plt_reloc_index];
+    unsigned sym = ELF_R_SYM(rel->r_info);
+    Elf_Addr reloc = static_cast<Elf_Addr>(rel->r_offset + si->load_bias);
+    const char* sym_name = si->strtab + si->symtab[sym].st_name;
+
+    // We don't keep the DT_NEEDED list around after linking, so rebuild it.
+    size_t needed_count = 0;
+    for (Elf_Dyn* d = si->dynamic; d->d_tag != DT_NULL; ++d) {
+        if (d->d_tag == DT_NEEDED) {
+            ++needed_count;
+        }
+    }
+    soinfo** needed = (soinfo**) alloca((1 + needed_count) * sizeof(soinfo*));
+    soinfo** pneeded = needed;
+    for (Elf_Dyn* d = si->dynamic; d->d_tag != DT_NULL; ++d) {
+        if (d->d_tag == DT_NEEDED) {
+            soinfo* lsi = find_loaded_library(si->strtab + d->d_un.d_val);
+            if (lsi != NULL) {
+                *pneeded++ = lsi;
+            }
+        }
+    }
+    *pneeded = NULL;
+
+    soinfo* lsi = NULL;
+    Elf_Sym* s = soinfo_do_lookup(si, sym_name, &lsi, needed);
+    Elf_Addr sym_addr = 0;
+    if (s != NULL) {
+        sym_addr = soinfo_symbol_address(lsi, s);
+    } else if (ELF_ST_BIND(si->symtab[sym].st_info) != STB_WEAK) {
+        // There's no caller to report a failure to, and nowhere sensible to jump.
+        DL_ERR("cannot locate symbol \"%s\" referenced by \"%s\"...", sym_name, si->name);
+        __libc_format_fd(2, "CANNOT LINK EXECUTABLE: %s\n", linker_get_error_buffer());
+        __libc_fatal("%s", linker_get_error_buffer());
+    }
+    count_relocation(kRelocSymbol);
+    count_relocation(kRelocAbsolute);
+
+    TRACE_TYPE(RELO, "RELO LAZY JMP_SLOT %p <- %p %s", reinterpret_cast<void*>(reloc),
+               reinterpret_cast<void*>(sym_addr + PLT_RELOC_ADDEND(rel)), sym_name);
+    *reinterpret_cast<Elf_Addr*>(reloc) = sym_addr + PLT_RELOC_ADDEND(rel);
+    return *reinterpret_cast<Elf_Addr*>(reloc);
+}
+
 void soinfo::CallArray(const char* array_name UNUSED, linker_function_t* functions, size_t count, bool reverse) {
   if (functions == NULL) {
     return;
@@ -1298,10 +2161,6 @@ void soinfo::CallFunction(const char* function_name UNUSED, linker_function_t fu
   TRACE("[ Calling %s @ %p for '%s' ]", function_name, function, name);
   function();
   TRACE("[ Done calling %s @ %p for '%s' ]", function_name, function, name);
-
-  // The function may have called dlopen(3) or dlclose(3), so we need to ensure our data structures
-  // are still writable. This happens with our debug malloc (see http://b/7941716).
-  set_soinfo_pool_protection(PROT_READ | PROT_WRITE);
 }
 
 void soinfo::CallPreInitConstructors() {
@@ -1457,6 +2316,7 @@ static bool soinfo_link_image(soinfo* si) {
 
     // Extract useful information from dynamic section.
     uint32_t needed_count = 0;
+    bool bind_now = false;
     for (Elf_Dyn* d = si->dynamic; d->d_tag != DT_NULL; ++d) {
         DEBUG("d = %p, d[0](tag) = %p d[1](val) = %p",
               d, reinterpret_cast<void*>(d->d_tag), reinterpret_cast<void*>(d->d_un.d_val));
@@ -1467,6 +2327,32 @@ static bool soinfo_link_image(soinfo* si) {
             si->bucket = (unsigned *) (base + d->d_un.d_ptr + 8);
             si->chain = (unsigned *) (base + d->d_un.d_ptr + 8 + si->nbucket * 4);
             break;
+        case DT_GNU_HASH:
+            {
+                // Header: nbucket, symndx, maskwords, shift2; then the bloom
+                // filter, the buckets, and the hash values of symbols >= symndx.
+                uint32_t* gnu_hash = reinterpret_cast<uint32_t*>(base + d->d_un.d_ptr);
+                si->gnu_nbucket = gnu_hash[0];
+                uint32_t symndx = gnu_hash[1];
+                si->gnu_maskwords = gnu_hash[2];
+                si->gnu_shift2 = gnu_hash[3];
+                si->gnu_bloom_filter = reinterpret_cast<Elf_Addr*>(gnu_hash + 4);
+                si->gnu_bucket = reinterpret_cast<uint32_t*>(si->gnu_bloom_filter + si->gnu_maskwords);
+                si->gnu_chain = si->gnu_bucket + si->gnu_nbucket - symndx;
+
+                if (si->gnu_maskwords == 0 || (si->gnu_maskwords & (si->gnu_maskwords - 1)) != 0) {
+                    DL_ERR("invalid maskwords for DT_GNU_HASH in \"%s\": 0x%x",
+                           si->name, si->gnu_maskwords);
+                    return false;
+                }
+                // We only ever use maskwords as a mask.
+                --si->gnu_maskwords;
+
+                if (si->gnu_nbucket != 0) {
+                    si->flags |= FLAG_GNU_HASH;
+                }
+            }
+            break;
         case DT_STRTAB:
             si->strtab = (const char *) (base + d->d_un.d_ptr);
             break;
@@ -1496,11 +2382,21 @@ static bool soinfo_link_image(soinfo* si) {
 #endif
             break;
         case DT_PLTGOT:
-#if !defined(ANDROID_X86_64_LINKER)
-            /* Save this in case we decide to do lazy binding. We don't yet. */
+            /* Needed if we decide to do lazy binding. */
+#if defined(ANDROID_X86_64_LINKER)
+            si->plt_got = (Elf_Addr *)(base + d->d_un.d_ptr);
+#else
             si->plt_got = (unsigned *)(base + d->d_un.d_ptr);
-            break;
 #endif
+            break;
+        case DT_BIND_NOW:
+            bind_now = true;
+            break;
+        case DT_FLAGS_1:
+            if (d->d_un.d_val & DF_1_BIND_NOW) {
+                bind_now = true;
+            }
+            break;
         case DT_DEBUG:
             // Set the DT_DEBUG entry to the address of _r_debug for GDB
             // if the dynamic table is writable
@@ -1626,8 +2522,8 @@ static bool soinfo_link_image(soinfo* si) {
         DL_ERR("linker cannot have DT_NEEDED dependencies on other libraries");
         return false;
     }
-    if (si->nbucket == 0) {
-        DL_ERR("empty/missing DT_HASH in \"%s\" (built with --hash-style=gnu?)", si->name);
+    if (si->nbucket == 0 && (si->flags & FLAG_GNU_HASH) == 0) {
+        DL_ERR("empty/missing DT_HASH and DT_GNU_HASH in \"%s\"", si->name);
         return false;
     }
     if (si->strtab == 0) {
@@ -1693,8 +2589,15 @@ static bool soinfo_link_image(soinfo* si) {
         }
     }
 
+    symbol_cache_reset();
+
+    bool bind_lazily = gBindLazily && !bind_now && soinfo_can_bind_lazily(si);
+
 #if defined(ANDROID_X86_64_LINKER)
-    if (si->plt_rela != NULL) {
+    if (bind_lazily) {
+        DEBUG("[ lazily binding %s plt ]\n", si->name );
+        soinfo_prepare_lazy_binding(si);
+    } else if (si->plt_rela != NULL) {
         DEBUG("[ relocating %s plt ]\n", si->name );
         if (soinfo_relocate_a(si, si->plt_rela, si->plt_rela_count, needed)) {
             return false;
@@ -1707,7 +2610,10 @@ static bool soinfo_link_image(soinfo* si) {
         }
     }
 #else
-    if (si->plt_rel != NULL) {
+    if (bind_lazily) {
+        DEBUG("[ lazily binding %s plt ]", si->name );
+        soinfo_prepare_lazy_binding(si);
+    } else if (si->plt_rel != NULL) {
         DEBUG("[ relocating %s plt ]", si->name );
         if (soinfo_relocate(si, si->plt_rel, si->plt_rel_count, needed)) {
             return false;
@@ -1727,7 +2633,12 @@ static bool soinfo_link_image(soinfo* si) {
     }
 #endif
 
+    if (!relocating_linker && !soinfo_address_index_insert(si)) {
+        return false;
+    }
+
     si->flags |= FLAG_LINKED;
+    si->flags &= ~FLAG_LOADING;
     DEBUG("[ finished linking %s ]", si->name);
 
     if (si->has_text_relocations) {
@@ -1810,6 +2721,8 @@ static Elf_Addr __linker_init_post_relocation(KernelArgumentBlock& args, Elf_Add
     if (LD_DEBUG != NULL) {
       gLdDebugVerbosity = atoi(LD_DEBUG);
     }
+    // Any non-empty value enables lazy binding; it's stripped for setuid programs.
+    gBindLazily = (linker_env_get("LD_BIND_LAZY") != NULL);
 
     // Normally, these are cleaned by linker_env_init, but the test
     // doesn't cost us anything.
@@ -1822,6 +2735,9 @@ static Elf_Addr __linker_init_post_relocation(KernelArgumentBlock& args, Elf_Add
 
     INFO("[ android linker & debugger ]");
 
+    // libdl_info is statically allocated rather than coming from soinfo_alloc.
+    soinfo_name_hash_insert(&libdl_info);
+
     soinfo* si = soinfo_alloc(args.argv[0]);
     if (si == NULL) {
         exit(EXIT_FAILURE);
@@ -1897,12 +2813,16 @@ static Elf_Addr __linker_init_post_relocation(KernelArgumentBlock& args, Elf_Add
 
     somain = si;
 
-    if (!soinfo_link_image(si)) {
-        __libc_format_fd(2, "CANNOT LINK EXECUTABLE: %s\n", linker_get_error_buffer());
-        exit(EXIT_FAILURE);
-    }
+    {
+        // load_library expects to be called with the write lock held, as it is by dlopen(3).
+        ScopedSoListWriteLocker locker;
+        if (!soinfo_link_image(si)) {
+            __libc_format_fd(2, "CANNOT LINK EXECUTABLE: %s\n", linker_get_error_buffer());
+            exit(EXIT_FAILURE);
+        }
 
-    add_vdso(args);
+        add_vdso(args);
+    }
 
     si->CallPreInitConstructors();
 
@@ -1926,11 +2846,12 @@ static Elf_Addr __linker_init_post_relocation(KernelArgumentBlock& args, Elf_Add
                ));
 #endif
 #if STATS
-    PRINT("RELO STATS: %s: %d abs, %d rel, %d copy, %d symbol", args.argv[0],
+    PRINT("RELO STATS: %s: %d abs, %d rel, %d copy, %d symbol (%d cached)", args.argv[0],
            linker_stats.count[kRelocAbsolute],
            linker_stats.count[kRelocRelative],
            linker_stats.count[kRelocCopy],
-           linker_stats.count[kRelocSymbol]);
+           linker_stats.count[kRelocSymbol],
+           linker_stats.count[kRelocSymbolCached]);
 #endif
 #if COUNT_PAGES
     {
@@ -2024,9 +2945,9 @@ extern "C" Elf_Addr __linker_init(void* raw_args) {
   // We have successfully fixed our own relocations. It's safe to run
   // the main part of the linker now.
   args.abort_message_ptr = &gAbortMessage;
+  soinfo_pools_unprotect();
   Elf_Addr start_address = __linker_init_post_relocation(args, linker_addr);
-
-  set_soinfo_pool_protection(PROT_READ);
+  soinfo_pools_protect();
 
   // Return the address that the calling assembly stub should jump to.
   return start_address;
@@ -92,11 +92,24 @@ struct r_debug {
 #define FLAG_LINKED     0x00000001
 #define FLAG_EXE        0x00000004 // The main executable
 #define FLAG_LINKER     0x00000010 // The linker itself
+#define FLAG_GNU_HASH   0x00000040 // Uses DT_GNU_HASH rather than DT_HASH
+#define FLAG_LOADING    0x00000080 // In solist but not linked yet; readers skip it
 
 #define SOINFO_NAME_LEN 128
 
 typedef void (*linker_function_t)();
 
+// An entry in a library's address-sorted symbol index, built for dladdr(3).
+// An STT_GNU_IFUNC symbol's entry covers the implementation its resolver picks,
+// up to the next entry, rather than the resolver.
+struct symbol_address_entry_t {
+  Elf_Addr value;
+  Elf_Addr end;
+  // The greatest end of this and all preceding entries.
+  Elf_Addr max_end;
+  uint32_t sym;
+};
+
 struct soinfo {
  public:
   char name[SOINFO_NAME_LEN];
@@ -129,6 +142,8 @@ struct soinfo {
   unsigned* chain;
 
 #if defined(ANDROID_X86_64_LINKER)
+  Elf_Addr* plt_got;
+
   Elf_Rela *plt_rela;
   size_t plt_rela_count;
 
@@ -177,6 +192,25 @@ struct soinfo {
   bool has_text_relocations;
   bool has_DT_SYMBOLIC;
 
+  // DT_GNU_HASH. Only valid if FLAG_GNU_HASH is set in flags.
+  size_t gnu_nbucket;
+  uint32_t* gnu_bucket;
+  uint32_t* gnu_chain; // Indexed by symbol index (already offset by symndx).
+  uint32_t gnu_maskwords; // Number of bloom filter words minus one.
+  uint32_t gnu_shift2;
+  Elf_Addr* gnu_bloom_filter;
+
+  // Next soinfo in the same bucket of the linker's name-keyed hash table.
+  soinfo* name_hash_next;
+
+  // Built on the first dladdr(3) against this library, and freed with it.
+  symbol_address_entry_t* symbol_address_index;
+  size_t symbol_address_index_count;
+
+  // Increases in solist order, so dl_iterate_phdr can find its place again after
+  // its callback has let other threads (or itself) load and unload libraries.
+  size_t list_serial;
+
   void CallConstructors();
   void CallDestructors();
   void CallPreInitConstructors();
@@ -195,16 +229,55 @@ extern soinfo libdl_info;
 #ifndef DT_PREINIT_ARRAYSZ
 #define DT_PREINIT_ARRAYSZ 33
 #endif
+#ifndef DT_GNU_HASH
+#define DT_GNU_HASH        0x6ffffef5
+#endif
 
 void do_android_update_LD_LIBRARY_PATH(const char* ld_library_path);
 soinfo* do_dlopen(const char* name, int flags);
 int do_dlclose(soinfo* si);
+Elf_Addr do_lazy_bind(soinfo* si, size_t plt_reloc_index);
 
 Elf_Sym* dlsym_linear_lookup(const char* name, soinfo** found, soinfo* start);
 soinfo* find_containing_library(const void* addr);
 
-Elf_Sym* dladdr_find_symbol(soinfo* si, const void* addr);
+Elf_Sym* dladdr_find_symbol(soinfo* si, const void* addr, Elf_Addr* sym_addr);
+bool dladdr_needs_address_index(const void* addr);
+void do_dladdr_build_address_index(const void* addr);
+int do_dl_iterate_phdr(int (*cb)(dl_phdr_info* info, size_t size, void* data), void* data);
+bool dl_has_unloaded_libraries();
+void do_dl_release_unloaded_libraries();
 Elf_Sym* dlsym_handle_lookup(soinfo* si, const char* name);
+Elf_Addr soinfo_symbol_address(soinfo* si, Elf_Sym* s);
+
+// dlsym, dladdr, dl_iterate_phdr and lazy binding only read the list of loaded libraries,
+// so they share a read lock and run concurrently. dlopen and dlclose are serialized by
+// gDlMutex in dlfcn.cpp, and only take the write lock while they change what readers can
+// see; they drop it while a library is being opened and mapped. The read lock is
+// recursive within a thread (dlsym and dladdr run ifunc resolvers with it held), but a
+// thread holding it can't take gDlMutex: check solist_is_read_locked() first.
+// dl_iterate_phdr drops it around its callbacks, so they may call dlopen and dlclose, but
+// pins the library each callback is given: dlclose leaves a pinned library mapped, and
+// it's unmapped by whichever dlclose or dl_iterate_phdr next finds it unpinned.
+void solist_read_lock();
+void solist_read_unlock();
+bool solist_is_read_locked();
+
+class ScopedSoListReadLocker {
+ public:
+  ScopedSoListReadLocker() {
+    solist_read_lock();
+  }
+
+  ~ScopedSoListReadLocker() {
+    solist_read_unlock();
+  }
+
+ private:
+  // Disallow copy and assignment.
+  ScopedSoListReadLocker(const ScopedSoListReadLocker&);
+  void operator=(const ScopedSoListReadLocker&);
+};
 
 void debuggerd_init();
 extern "C" abort_msg_t* gAbortMessage;
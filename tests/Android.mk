@@ -30,8 +30,10 @@ benchmark_c_flags = \
 
 benchmark_src_files = \
     benchmark_main.cpp \
+    malloc_benchmark.cpp \
     math_benchmark.cpp \
     property_benchmark.cpp \
+    pthread_benchmark.cpp \
     string_benchmark.cpp \
     time_benchmark.cpp \
 
@@ -159,17 +161,39 @@ include $(BUILD_STATIC_LIBRARY)
 # Test library for the unit tests.
 # -----------------------------------------------------------------------------
 
-# Build no-elf-hash-table-library.so to test dlopen(3) on a library that
-# only has a GNU-style hash table. MIPS doesn't support GNU hash style.
+# Build no-elf-hash-table-library.so to test dlopen(3) and dlsym(3) on a library
+# that only has a GNU-style hash table. MIPS doesn't support GNU hash style.
 ifneq ($(TARGET_ARCH),mips)
 include $(CLEAR_VARS)
 LOCAL_MODULE := no-elf-hash-table-library
 LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
-LOCAL_SRC_FILES := empty.cpp
+LOCAL_SRC_FILES := no_elf_hash_table_library.cpp
 LOCAL_LDFLAGS := -Wl,--hash-style=gnu
 include $(BUILD_SHARED_LIBRARY)
 endif
 
+# Build lazy-binding-library.so to test dlopen(3) with RTLD_LAZY. Our default
+# LDFLAGS include -z now, which disables lazy binding. MIPS doesn't support it.
+ifneq ($(TARGET_ARCH),mips)
+include $(CLEAR_VARS)
+LOCAL_MODULE := lazy-binding-library
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SRC_FILES := lazy_binding_library.cpp
+LOCAL_LDFLAGS := -Wl,-z,lazy
+include $(BUILD_SHARED_LIBRARY)
+endif
+
+# Build ifunc-library.so to test dlopen(3) and dlsym(3) with STT_GNU_IFUNC symbols
+# and R_*_IRELATIVE relocations. The MIPS linker doesn't support them.
+ifneq ($(TARGET_ARCH),mips)
+include $(CLEAR_VARS)
+LOCAL_MODULE := ifunc-library
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SRC_FILES := ifunc_library.cpp
+LOCAL_SHARED_LIBRARIES := libdl
+include $(BUILD_SHARED_LIBRARY)
+endif
+
 # -----------------------------------------------------------------------------
 # Unit tests built against glibc.
 # -----------------------------------------------------------------------------
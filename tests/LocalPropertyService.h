@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <sys/_system_properties.h>
+
+// A stand-in for init's property service, setting the properties it's sent in
+// the property area of the calling process (see LocalPropertyTestState). If
+// 'batches' is false, it handles PROP_MSG_SETPROP_BATCH messages like the
+// property services that predate them, ignoring them. It waits 'read_delay_ms'
+// before reading from each connection, to stand in for a busy init.
+class LocalPropertyService {
+public:
+    explicit LocalPropertyService(bool batches = true, unsigned read_delay_ms = 0)
+            : valid(false), connections(0), handled(0), batches(batches),
+              read_delay_ms(read_delay_ms), fd(-1) {
+        char dir_template[] = "/data/local/tmp/prop-service-XXXXXX";
+        char *dirname = mkdtemp(dir_template);
+        if (!dirname) {
+            perror("making temp dir for property service failed (is /data/local/tmp writable?)");
+            return;
+        }
+
+        socket_dirname = dirname;
+        socket_filename = socket_dirname + "/" PROP_SERVICE_NAME;
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_LOCAL;
+        strncpy(addr.sun_path, socket_filename.c_str(), sizeof(addr.sun_path) - 1);
+
+        fd = socket(AF_LOCAL, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+            perror("creating the property service socket failed");
+            return;
+        }
+        if (pthread_create(&thread, NULL, ServiceThreadFn, this) != 0)
+            return;
+
+        __system_property_set_service_socket(socket_filename.c_str());
+        valid = true;
+    }
+
+    ~LocalPropertyService() {
+        if (valid) {
+            __system_property_set_service_socket("/dev/socket/" PROP_SERVICE_NAME);
+            shutdown(fd, SHUT_RDWR);
+            pthread_join(thread, NULL);
+        }
+        if (fd >= 0)
+            close(fd);
+        unlink(socket_filename.c_str());
+        rmdir(socket_dirname.c_str());
+    }
+
+    bool valid;
+    // The number of connections accepted so far, and how many of them have been handled.
+    volatile int connections;
+    volatile int handled;
+
+private:
+    static void *ServiceThreadFn(void *arg) {
+        LocalPropertyService *service = reinterpret_cast<LocalPropertyService *>(arg);
+        int s;
+
+        while ((s = accept(service->fd, NULL, NULL)) >= 0) {
+            service->connections++;
+            usleep(service->read_delay_ms * 1000);
+            service->HandleConnection(s);
+            close(s);
+            service->handled++;
+        }
+        return NULL;
+    }
+
+    void HandleConnection(int s) {
+        prop_msg msg;
+
+        if (recv(s, &msg, sizeof(msg), MSG_WAITALL) != sizeof(msg))
+            return;
+
+        if (msg.cmd == PROP_MSG_SETPROP) {
+            SetProperty(&msg);
+        } else if (msg.cmd == PROP_MSG_SETPROP_BATCH && batches) {
+            uint32_t handled = 0;
+            do {
+                SetProperty(&msg);
+                handled++;
+            } while (recv(s, &msg, sizeof(msg), MSG_WAITALL) == sizeof(msg));
+            send(s, &handled, sizeof(handled), MSG_NOSIGNAL);
+        }
+    }
+
+    static void SetProperty(prop_msg *msg) {
+        msg->name[PROP_NAME_MAX - 1] = 0;
+        msg->value[PROP_VALUE_MAX - 1] = 0;
+
+        prop_info *pi = (prop_info *)__system_property_find(msg->name);
+        if (pi)
+            __system_property_update(pi, msg->value, strlen(msg->value));
+        else
+            __system_property_add(msg->name, strlen(msg->name), msg->value, strlen(msg->value));
+    }
+
+    const bool batches;
+    const unsigned read_delay_ms;
+    int fd;
+    pthread_t thread;
+    std::string socket_dirname;
+    std::string socket_filename;
+};
@@ -17,8 +17,12 @@
 #include <gtest/gtest.h>
 
 #include <dlfcn.h>
+#include <errno.h>
 #include <libgen.h>
 #include <limits.h>
+#include <link.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdint.h>
 
@@ -174,6 +178,67 @@ TEST(dlfcn, dladdr) {
   ASSERT_EQ(0, dlclose(self));
 }
 
+#if defined(__BIONIC__)
+TEST(dlfcn, dlopen_already_loaded) {
+  dlerror(); // Clear any pending errors.
+  void* handle1 = dlopen("libc.so", RTLD_NOW);
+  ASSERT_TRUE(handle1 != NULL) << dlerror();
+  void* handle2 = dlopen("libc.so", RTLD_NOW);
+  ASSERT_TRUE(handle2 != NULL) << dlerror();
+  ASSERT_EQ(handle1, handle2);
+
+  // An address in libc should be found in libc, and dlsym should agree on the symbol.
+  void* sym = dlsym(handle1, "fopen");
+  ASSERT_TRUE(sym != NULL);
+  Dl_info info;
+  ASSERT_NE(0, dladdr(sym, &info));
+  ASSERT_STREQ("libc.so", info.dli_fname);
+  ASSERT_EQ(sym, info.dli_saddr);
+
+  ASSERT_EQ(0, dlclose(handle2));
+  ASSERT_EQ(0, dlclose(handle1));
+}
+#endif
+
+#if defined(__BIONIC__)
+TEST(dlfcn, dladdr_libc_symbols) {
+  void* handle = dlopen("libc.so", RTLD_NOW);
+  ASSERT_TRUE(handle != NULL) << dlerror();
+
+  const char* names[] = { "fopen", "malloc", "qsort", "strtol" };
+  for (size_t i = 0; i < sizeof(names)/sizeof(names[0]); ++i) {
+    SCOPED_TRACE(names[i]);
+    char* sym = reinterpret_cast<char*>(dlsym(handle, names[i]));
+    ASSERT_TRUE(sym != NULL);
+
+    // The start of the symbol and an address inside it both map back to the symbol.
+    Dl_info info;
+    ASSERT_NE(0, dladdr(sym, &info));
+    ASSERT_STREQ(names[i], info.dli_sname);
+    ASSERT_EQ(sym, info.dli_saddr);
+    ASSERT_NE(0, dladdr(sym + 1, &info));
+    ASSERT_STREQ(names[i], info.dli_sname);
+    ASSERT_EQ(sym, info.dli_saddr);
+
+    // Walk off the end of the symbol. The first address past it is either padding
+    // between symbols, which has no symbol, or the start of the next symbol.
+    char* p = sym + 1;
+    do {
+      ++p;
+      ASSERT_NE(0, dladdr(p, &info));
+    } while (info.dli_saddr == sym);
+    if (info.dli_saddr == NULL) {
+      ASSERT_TRUE(info.dli_sname == NULL);
+    } else {
+      ASSERT_EQ(p, info.dli_saddr);
+      ASSERT_STRNE(names[i], info.dli_sname);
+    }
+  }
+
+  ASSERT_EQ(0, dlclose(handle));
+}
+#endif
+
 TEST(dlfcn, dladdr_invalid) {
   Dl_info info;
 
@@ -188,7 +253,6 @@ TEST(dlfcn, dladdr_invalid) {
   ASSERT_TRUE(dlerror() == NULL); // dladdr(3) doesn't set dlerror(3).
 }
 
-// Our dynamic linker doesn't support GNU hash tables.
 #if defined(__BIONIC__)
 // GNU-style ELF hash tables are incompatible with the MIPS ABI.
 // MIPS requires .dynsym to be sorted to match the GOT but GNU-style requires sorting by hash code.
@@ -196,10 +260,211 @@ TEST(dlfcn, dladdr_invalid) {
 TEST(dlfcn, dlopen_library_with_only_gnu_hash) {
   dlerror(); // Clear any pending errors.
   void* handle = dlopen("no-elf-hash-table-library.so", RTLD_NOW);
-  ASSERT_TRUE(handle == NULL);
-  ASSERT_STREQ("dlopen failed: empty/missing DT_HASH in \"no-elf-hash-table-library.so\" (built with --hash-style=gnu?)", dlerror());
+  ASSERT_TRUE(handle != NULL) << dlerror();
+
+  void* sym = dlsym(handle, "GnuHashTestFunction");
+  ASSERT_TRUE(sym != NULL);
+  int (*function)() = reinterpret_cast<int(*)()>(sym);
+  ASSERT_EQ(42, function());
+
+  sym = dlsym(handle, "GnuHashTestOtherFunction");
+  ASSERT_TRUE(sym != NULL);
+  function = reinterpret_cast<int(*)()>(sym);
+  ASSERT_EQ(24, function());
+
+  // Symbols that aren't there should be rejected (usually by the bloom filter).
+  ASSERT_TRUE(dlsym(handle, "GnuHashTestMissingFunction") == NULL);
+  ASSERT_SUBSTR("undefined symbol: GnuHashTestMissingFunction", dlerror());
+
+  // dladdr(3) has to be able to find symbols without a DT_HASH symbol count.
+  Dl_info info;
+  ASSERT_NE(0, dladdr(reinterpret_cast<void*>(function), &info));
+  ASSERT_STREQ("GnuHashTestOtherFunction", info.dli_sname);
+
+  ASSERT_EQ(0, dlclose(handle));
+}
+#endif
+#endif
+
+#if defined(__BIONIC__) && !defined(__mips__)
+TEST(dlfcn, dlopen_lazy) {
+  dlerror(); // Clear any pending errors.
+  void* handle = dlopen("lazy-binding-library.so", RTLD_LAZY);
+  ASSERT_TRUE(handle != NULL) << dlerror();
+
+  void* sym = dlsym(handle, "LazyBindingTestFunction");
+  ASSERT_TRUE(sym != NULL);
+  size_t (*function)(const char*) = reinterpret_cast<size_t(*)(const char*)>(sym);
+
+  // The first call goes through the lazy binding trampoline, the second straight to strlen(3).
+  errno = 1234;
+  ASSERT_EQ(5U, function("hello"));
+  ASSERT_EQ(1234, errno);
+  ASSERT_EQ(3U, function("abc"));
+
+  ASSERT_EQ(0, dlclose(handle));
+}
+
+TEST(dlfcn, dlsym_ifunc) {
+  dlerror(); // Clear any pending errors.
+  void* handle = dlopen("ifunc-library.so", RTLD_NOW);
+  ASSERT_TRUE(handle != NULL) << dlerror();
+
+  // dlsym(3) returns what the resolver chose, not the resolver.
+  void* sym = dlsym(handle, "IfuncTestFunction");
+  ASSERT_TRUE(sym != NULL);
+  ASSERT_TRUE(sym != dlsym(handle, "IfuncTestResolver"));
+  ASSERT_EQ(42, reinterpret_cast<int(*)()>(sym)());
+
+  // dladdr(3) maps the implementation back to the IFUNC, in place of the implementation's
+  // own dynamic symbol.
+  ASSERT_EQ(sym, dlsym(handle, "IfuncTestImplementationAlias"));
+  Dl_info info;
+  ASSERT_NE(0, dladdr(sym, &info));
+  ASSERT_STREQ("IfuncTestFunction", info.dli_sname);
+  ASSERT_EQ(sym, info.dli_saddr);
+
+  // This one's resolver calls dlsym(3). It ran when dladdr(3) indexed the library above.
+  sym = dlsym(handle, "LookupIfuncTestFunction");
+  ASSERT_EQ(dlsym(handle, "IfuncTestImplementationAlias"), sym);
+  ASSERT_EQ(42, reinterpret_cast<int(*)()>(sym)());
+
+  // An implementation without a dynamic symbol has no known size, so dladdr(3) doesn't
+  // guess at which addresses belong to its IFUNC.
+  sym = dlsym(handle, "UnsizedIfuncTestFunction");
+  ASSERT_TRUE(sym != NULL);
+  ASSERT_EQ(43, reinterpret_cast<int(*)()>(sym)());
+  ASSERT_NE(0, dladdr(sym, &info));
+  ASSERT_TRUE(info.dli_sname == NULL) << info.dli_sname;
+
+  // This one calls through an R_*_IRELATIVE relocation.
+  sym = dlsym(handle, "CallHiddenIfuncTestFunction");
+  ASSERT_TRUE(sym != NULL);
+  ASSERT_EQ(42, reinterpret_cast<int(*)()>(sym)());
+
+  ASSERT_EQ(0, dlclose(handle));
 }
 #endif
+
+static int DlIteratePhdrDladdrCallback(dl_phdr_info*, size_t, void* data) {
+  // dladdr(3) from inside dl_iterate_phdr(3) mustn't deadlock.
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(&DlSymTestFunction), &info) != 0 &&
+      info.dli_sname != NULL && strcmp(info.dli_sname, "DlSymTestFunction") == 0) {
+    ++*reinterpret_cast<int*>(data);
+  }
+  return 0;
+}
+
+TEST(dlfcn, dl_iterate_phdr_dladdr) {
+  int found = 0;
+  ASSERT_EQ(0, dl_iterate_phdr(DlIteratePhdrDladdrCallback, &found));
+  ASSERT_GT(found, 0);
+}
+
+#if defined(__BIONIC__) && !defined(__mips__)
+static volatile bool gDlopenDlcloseLoopDone;
+
+static void* DlopenDlcloseLoopFn(void*) {
+  while (!gDlopenDlcloseLoopDone) {
+    void* handle = dlopen("no-elf-hash-table-library.so", RTLD_NOW);
+    if (handle == NULL) {
+      return reinterpret_cast<void*>(strdup(dlerror()));
+    }
+    dlclose(handle);
+  }
+  return NULL;
+}
+
+static int CountLibrariesCallback(dl_phdr_info*, size_t, void* data) {
+  ++*reinterpret_cast<size_t*>(data);
+  return 0;
+}
+
+TEST(dlfcn, dlsym_dladdr_concurrent_with_dlopen) {
+  gDlopenDlcloseLoopDone = false;
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, DlopenDlcloseLoopFn, NULL));
+
+  // Readers should keep working (and keep seeing the libraries that were already
+  // loaded) while another thread loads and unloads a library.
+  for (size_t i = 0; i < 1000; ++i) {
+    void* sym = dlsym(RTLD_DEFAULT, "DlSymTestFunction");
+    ASSERT_EQ(reinterpret_cast<void*>(&DlSymTestFunction), sym);
+
+    Dl_info info;
+    ASSERT_NE(0, dladdr(sym, &info));
+    ASSERT_STREQ("DlSymTestFunction", info.dli_sname);
+
+    size_t count = 0;
+    dl_iterate_phdr(CountLibrariesCallback, &count);
+    ASSERT_GT(count, 0U);
+  }
+
+  gDlopenDlcloseLoopDone = true;
+  void* result;
+  ASSERT_EQ(0, pthread_join(t, &result));
+  char* error = static_cast<char*>(result);
+  ASSERT_TRUE(error == NULL) << error;
+}
+
+static int ReadPhdrsCallback(dl_phdr_info* info, size_t, void* data) {
+  // Give a dlclose(3) on the other thread a chance to unmap the library, then read
+  // everything we were handed; that would fault if it had.
+  sched_yield();
+  size_t sum = strlen(info->dlpi_name);
+  for (size_t i = 0; i < info->dlpi_phnum; ++i) {
+    sum += info->dlpi_phdr[i].p_type + info->dlpi_phdr[i].p_memsz;
+  }
+  *reinterpret_cast<size_t*>(data) += sum;
+  return 0;
+}
+
+TEST(dlfcn, dl_iterate_phdr_concurrent_with_dlclose) {
+  gDlopenDlcloseLoopDone = false;
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, DlopenDlcloseLoopFn, NULL));
+
+  // A library being unloaded by another thread stays mapped until callbacks are done with it.
+  for (size_t i = 0; i < 1000; ++i) {
+    size_t sum = 0;
+    ASSERT_EQ(0, dl_iterate_phdr(ReadPhdrsCallback, &sum));
+    ASSERT_GT(sum, 0U);
+  }
+
+  gDlopenDlcloseLoopDone = true;
+  void* result;
+  ASSERT_EQ(0, pthread_join(t, &result));
+  char* error = static_cast<char*>(result);
+  ASSERT_TRUE(error == NULL) << error;
+}
+
+struct DlIteratePhdrDlopenState {
+  size_t calls;
+  size_t failures;
+};
+
+static int DlIteratePhdrDlopenCallback(dl_phdr_info*, size_t, void* data) {
+  DlIteratePhdrDlopenState* state = reinterpret_cast<DlIteratePhdrDlopenState*>(data);
+  ++state->calls;
+  void* handle = dlopen("no-elf-hash-table-library.so", RTLD_NOW);
+  if (handle == NULL || dlclose(handle) != 0) {
+    ++state->failures;
+  }
+  return 0;
+}
+
+TEST(dlfcn, dl_iterate_phdr_dlopen) {
+  size_t count = 0;
+  ASSERT_EQ(0, dl_iterate_phdr(CountLibrariesCallback, &count));
+
+  // dlopen(3) and dlclose(3) work from a dl_iterate_phdr(3) callback, and the iteration
+  // carries on over the same libraries even though each callback adds and removes one.
+  DlIteratePhdrDlopenState state = { 0, 0 };
+  ASSERT_EQ(0, dl_iterate_phdr(DlIteratePhdrDlopenCallback, &state));
+  ASSERT_EQ(0U, state.failures);
+  ASSERT_EQ(count, state.calls);
+}
 #endif
 
 TEST(dlfcn, dlopen_bad_flags) {
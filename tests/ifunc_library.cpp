@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+
+// IfuncTestFunction is an STT_GNU_IFUNC symbol, so dlsym(3) and anything
+// linking against it have to call the resolver to find the implementation.
+
+typedef int (*IfuncTestFunctionType)();
+
+// The implementation is hidden, as implementations usually are, but has an exported
+// alias, so that dladdr(3) knows its size.
+extern "C" __attribute__((visibility("hidden"))) int IfuncTestImplementation() {
+  return 42;
+}
+
+extern "C" int IfuncTestImplementationAlias() __attribute__((alias("IfuncTestImplementation")));
+
+extern "C" IfuncTestFunctionType IfuncTestResolver() {
+  return IfuncTestImplementation;
+}
+
+extern "C" int IfuncTestFunction() __attribute__((ifunc("IfuncTestResolver")));
+
+// A resolver may look symbols up itself. dladdr(3) runs every resolver in the library
+// when it first indexes it, so that mustn't deadlock.
+extern "C" IfuncTestFunctionType LookupIfuncTestResolver() {
+  void* implementation = dlsym(RTLD_DEFAULT, "IfuncTestImplementationAlias");
+  return reinterpret_cast<IfuncTestFunctionType>(implementation);
+}
+
+extern "C" int LookupIfuncTestFunction() __attribute__((ifunc("LookupIfuncTestResolver")));
+
+// This implementation has no dynamic symbol at all.
+static int UnsizedIfuncTestImplementation() {
+  return 43;
+}
+
+extern "C" IfuncTestFunctionType UnsizedIfuncTestResolver() {
+  return UnsizedIfuncTestImplementation;
+}
+
+extern "C" int UnsizedIfuncTestFunction() __attribute__((ifunc("UnsizedIfuncTestResolver")));
+
+// Calls to a hidden ifunc use an R_*_IRELATIVE relocation instead.
+extern "C" __attribute__((visibility("hidden"))) int HiddenIfuncTestFunction()
+    __attribute__((ifunc("IfuncTestResolver")));
+
+extern "C" int CallHiddenIfuncTestFunction() {
+  return HiddenIfuncTestFunction();
+}
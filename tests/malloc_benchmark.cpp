@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#define THREAD_COUNTS Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16)
+
+static void BM_malloc_free_small(int iters) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    free(malloc(16 + (i % 16) * 8));
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_malloc_free_small);
+
+static void* MallocFreeLoop(void* arg) {
+  int iters = *reinterpret_cast<int*>(arg);
+  void* ptrs[16];
+  for (int i = 0; i < iters; ++i) {
+    for (int j = 0; j < 16; ++j) {
+      ptrs[j] = malloc(16 + j * 8);
+    }
+    for (int j = 0; j < 16; ++j) {
+      free(ptrs[j]);
+    }
+  }
+  return NULL;
+}
+
+// Each thread does 'iters' rounds of 16 mallocs followed by 16 frees, so
+// this shows how small allocations scale as threads contend for malloc.
+static void BM_malloc_free_threads(int iters, int thread_count) {
+  StopBenchmarkTiming();
+
+  std::vector<pthread_t> threads(thread_count);
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], NULL, MallocFreeLoop, &iters);
+  }
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_malloc_free_threads)->THREAD_COUNTS;
@@ -18,6 +18,8 @@
 
 #include <stdlib.h>
 #include <malloc.h>
+#include <pthread.h>
+#include <string.h>
 
 TEST(malloc, malloc_std) {
   // Simple malloc test.
@@ -233,3 +235,60 @@ TEST(malloc, calloc_multiple_realloc) {
 
   free(ptr);
 }
+
+static void* SmallAllocationsThread(void* arg) {
+  void** handoff = reinterpret_cast<void**>(arg);
+  // Free what the main thread allocated, so chunks cross thread caches.
+  for (size_t i = 0; i < 64; i++) {
+    free(handoff[i]);
+  }
+  for (size_t round = 0; round < 100; round++) {
+    char* ptrs[64];
+    for (size_t i = 0; i < 64; i++) {
+      ptrs[i] = reinterpret_cast<char*>(malloc(i * 4 + 1));
+      if (ptrs[i] == NULL) {
+        return NULL;
+      }
+      memset(ptrs[i], static_cast<int>(i), i * 4 + 1);
+    }
+    for (size_t i = 0; i < 64; i++) {
+      for (size_t j = 0; j < i * 4 + 1; j++) {
+        if (ptrs[i][j] != static_cast<char>(i)) {
+          return NULL;
+        }
+      }
+      free(ptrs[i]);
+    }
+  }
+  // Leave some allocations for the main thread to free after we've exited.
+  for (size_t i = 0; i < 64; i++) {
+    handoff[i] = malloc(i * 4 + 1);
+  }
+  return handoff;
+}
+
+TEST(malloc, small_allocations_across_threads) {
+  void* handoff[8][64];
+  for (size_t t = 0; t < 8; t++) {
+    for (size_t i = 0; i < 64; i++) {
+      handoff[t][i] = malloc(i + 1);
+      ASSERT_TRUE(handoff[t][i] != NULL);
+    }
+  }
+
+  pthread_t threads[8];
+  for (size_t t = 0; t < 8; t++) {
+    ASSERT_EQ(0, pthread_create(&threads[t], NULL, SmallAllocationsThread, handoff[t]));
+  }
+  for (size_t t = 0; t < 8; t++) {
+    void* result;
+    ASSERT_EQ(0, pthread_join(threads[t], &result));
+    ASSERT_EQ(handoff[t], result);
+  }
+
+  for (size_t t = 0; t < 8; t++) {
+    for (size_t i = 0; i < 64; i++) {
+      free(handoff[t][i]);
+    }
+  }
+}
@@ -15,11 +15,14 @@
  */
 
 #include "benchmark.h"
+#include <limits.h>
 #include <unistd.h>
 
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
 
+#include "LocalPropertyService.h"
+
 #include <vector>
 #include <string>
 
@@ -67,6 +70,7 @@ struct LocalPropertyTestState {
             for (int j = 0; j < value_lens[i]; j++) {
                 values[i][j] = prop_name_chars[random() % (sizeof(prop_name_chars) - 1)];
             }
+            values[i][value_lens[i]] = 0;
             __system_property_add(names[i], name_lens[i], values[i], value_lens[i]);
         }
 
@@ -81,6 +85,13 @@ struct LocalPropertyTestState {
 
         __system_property_set_filename(PROP_FILENAME);
         unlink(pa_filename.c_str());
+        // The areas of the property name prefixes are numbered from 1.
+        for (int i = 1; ; i++) {
+            char area_filename[PATH_MAX];
+            snprintf(area_filename, sizeof(area_filename), "%s.%d", pa_filename.c_str(), i);
+            if (unlink(area_filename) < 0)
+                break;
+        }
         rmdir(pa_dirname.c_str());
 
         for (int i = 0; i < nprops; i++) {
@@ -146,3 +157,110 @@ static void BM_property_find(int iters, int nprops)
     StopBenchmarkTiming();
 }
 BENCHMARK(BM_property_find)->TEST_NUM_PROPS;
+
+// Like BM_property_get and BM_property_find, but repeatedly looking up the same
+// few properties, as a service polling its configuration would.
+#define HOT_PROPS 8
+
+static void BM_property_get_hot(int iters, int nprops)
+{
+    StopBenchmarkTiming();
+
+    LocalPropertyTestState pa(nprops);
+    char value[PROP_VALUE_MAX];
+
+    if (!pa.valid)
+        return;
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; i++) {
+        __system_property_get(pa.names[i % HOT_PROPS % nprops], value);
+    }
+    StopBenchmarkTiming();
+}
+BENCHMARK(BM_property_get_hot)->TEST_NUM_PROPS;
+
+static void BM_property_find_hot(int iters, int nprops)
+{
+    StopBenchmarkTiming();
+
+    LocalPropertyTestState pa(nprops);
+
+    if (!pa.valid)
+        return;
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; i++) {
+        __system_property_find(pa.names[i % HOT_PROPS % nprops]);
+    }
+    StopBenchmarkTiming();
+}
+BENCHMARK(BM_property_find_hot)->TEST_NUM_PROPS;
+
+// Reading HOT_PROPS properties together, as a consistent snapshot, rather
+// than one at a time as BM_property_get_hot does.
+static void BM_property_get_all_hot(int iters, int nprops)
+{
+    StopBenchmarkTiming();
+
+    LocalPropertyTestState pa(nprops);
+    char values[HOT_PROPS][PROP_VALUE_MAX];
+    const char *names[HOT_PROPS];
+
+    if (!pa.valid)
+        return;
+
+    for (int i = 0; i < HOT_PROPS; i++) {
+        names[i] = pa.names[i % nprops];
+    }
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; i += HOT_PROPS) {
+        __system_property_get_all(names, values, HOT_PROPS);
+    }
+    StopBenchmarkTiming();
+}
+BENCHMARK(BM_property_get_all_hot)->TEST_NUM_PROPS;
+
+// Setting properties through a stand-in for init's property service, one at
+// a time or in batches of nprops.
+static void BM_property_set(int iters, int nprops)
+{
+    StopBenchmarkTiming();
+
+    LocalPropertyTestState pa(nprops);
+    LocalPropertyService service;
+
+    if (!pa.valid || !service.valid)
+        return;
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; i++) {
+        __system_property_set(pa.names[i % nprops], pa.values[i % nprops]);
+    }
+    StopBenchmarkTiming();
+}
+BENCHMARK(BM_property_set)->TEST_NUM_PROPS;
+
+static void BM_property_set_all(int iters, int nprops)
+{
+    StopBenchmarkTiming();
+
+    LocalPropertyTestState pa(nprops);
+    LocalPropertyService service;
+
+    if (!pa.valid || !service.valid)
+        return;
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; i += nprops) {
+        __system_property_set_all(pa.names, pa.values, nprops);
+    }
+    StopBenchmarkTiming();
+}
+BENCHMARK(BM_property_set_all)->TEST_NUM_PROPS;
@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark.h"
+
+#include <pthread.h>
+#include <signal.h>
+
+#include <vector>
+
+#define THREAD_COUNTS Arg(2)->Arg(4)->Arg(8)->Arg(16)
+
+struct ContendedMutex {
+  pthread_mutex_t lock;
+  int iters;
+  volatile int count;
+};
+
+static void* ContendedMutexLoop(void* arg) {
+  ContendedMutex* m = reinterpret_cast<ContendedMutex*>(arg);
+  for (int i = 0; i < m->iters; ++i) {
+    pthread_mutex_lock(&m->lock);
+    // A short critical section, like most real ones.
+    for (int j = 0; j < 16; ++j) {
+      ++m->count;
+    }
+    pthread_mutex_unlock(&m->lock);
+  }
+  return NULL;
+}
+
+// 'thread_count' threads each lock and unlock the same mutex 'iters' times.
+static void ContendedMutexBenchmark(int iters, int thread_count, int type) {
+  StopBenchmarkTiming();
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, type);
+  ContendedMutex m;
+  pthread_mutex_init(&m.lock, &attr);
+  m.iters = iters;
+  m.count = 0;
+  std::vector<pthread_t> threads(thread_count);
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], NULL, ContendedMutexLoop, &m);
+  }
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  StopBenchmarkTiming();
+
+  pthread_mutex_destroy(&m.lock);
+  pthread_mutexattr_destroy(&attr);
+}
+
+static void BM_pthread_mutex_contended_normal(int iters, int thread_count) {
+  ContendedMutexBenchmark(iters, thread_count, PTHREAD_MUTEX_NORMAL);
+}
+BENCHMARK(BM_pthread_mutex_contended_normal)->THREAD_COUNTS;
+
+static void BM_pthread_mutex_contended_recursive(int iters, int thread_count) {
+  ContendedMutexBenchmark(iters, thread_count, PTHREAD_MUTEX_RECURSIVE);
+}
+BENCHMARK(BM_pthread_mutex_contended_recursive)->THREAD_COUNTS;
+
+static void BM_pthread_mutex_contended_adaptive(int iters, int thread_count) {
+  ContendedMutexBenchmark(iters, thread_count, PTHREAD_MUTEX_ADAPTIVE_NP);
+}
+BENCHMARK(BM_pthread_mutex_contended_adaptive)->THREAD_COUNTS;
+
+static void BM_pthread_rwlock_rdlock_uncontended(int iters) {
+  StopBenchmarkTiming();
+  pthread_rwlock_t lock;
+  pthread_rwlock_init(&lock, NULL);
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    pthread_rwlock_rdlock(&lock);
+    pthread_rwlock_unlock(&lock);
+  }
+
+  StopBenchmarkTiming();
+  pthread_rwlock_destroy(&lock);
+}
+BENCHMARK(BM_pthread_rwlock_rdlock_uncontended);
+
+struct ReadMostlyRwlock {
+  pthread_rwlock_t lock;
+  int iters;
+  volatile int value;
+};
+
+static void* ReadMostlyRwlockLoop(void* arg) {
+  ReadMostlyRwlock* rw = reinterpret_cast<ReadMostlyRwlock*>(arg);
+  for (int i = 0; i < rw->iters; ++i) {
+    // One write for every 64 reads.
+    if ((i & 63) == 0) {
+      pthread_rwlock_wrlock(&rw->lock);
+      ++rw->value;
+    } else {
+      pthread_rwlock_rdlock(&rw->lock);
+      rw->value;
+    }
+    pthread_rwlock_unlock(&rw->lock);
+  }
+  return NULL;
+}
+
+// 'thread_count' threads each take the same rwlock 'iters' times, almost always for reading.
+static void BM_pthread_rwlock_read_heavy(int iters, int thread_count) {
+  StopBenchmarkTiming();
+
+  ReadMostlyRwlock rw;
+  pthread_rwlock_init(&rw.lock, NULL);
+  rw.iters = iters;
+  rw.value = 0;
+  std::vector<pthread_t> threads(thread_count);
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], NULL, ReadMostlyRwlockLoop, &rw);
+  }
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  StopBenchmarkTiming();
+
+  pthread_rwlock_destroy(&rw.lock);
+}
+BENCHMARK(BM_pthread_rwlock_read_heavy)->Arg(1)->THREAD_COUNTS;
+
+// The mutex and condition variable barrier that code without
+// pthread_barrier_t has to write for itself.
+struct CondBarrier {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int count;
+  int arrived;
+  int generation;
+};
+
+static void CondBarrierWait(CondBarrier* b) {
+  pthread_mutex_lock(&b->lock);
+  int generation = b->generation;
+  if (++b->arrived == b->count) {
+    b->arrived = 0;
+    ++b->generation;
+    pthread_cond_broadcast(&b->cond);
+  } else {
+    while (b->generation == generation) {
+      pthread_cond_wait(&b->cond, &b->lock);
+    }
+  }
+  pthread_mutex_unlock(&b->lock);
+}
+
+struct BarrierPhases {
+  pthread_barrier_t barrier;
+  CondBarrier cond_barrier;
+  int iters;
+};
+
+static void* BarrierPhasesLoop(void* arg) {
+  BarrierPhases* b = reinterpret_cast<BarrierPhases*>(arg);
+  for (int i = 0; i < b->iters; ++i) {
+    pthread_barrier_wait(&b->barrier);
+  }
+  return NULL;
+}
+
+static void* CondBarrierPhasesLoop(void* arg) {
+  BarrierPhases* b = reinterpret_cast<BarrierPhases*>(arg);
+  for (int i = 0; i < b->iters; ++i) {
+    CondBarrierWait(&b->cond_barrier);
+  }
+  return NULL;
+}
+
+// 'thread_count' threads go through 'iters' phases together.
+static void BarrierPhasesBenchmark(int iters, int thread_count, void* (*loop)(void*)) {
+  StopBenchmarkTiming();
+
+  BarrierPhases b;
+  pthread_barrier_init(&b.barrier, NULL, thread_count);
+  pthread_mutex_init(&b.cond_barrier.lock, NULL);
+  pthread_cond_init(&b.cond_barrier.cond, NULL);
+  b.cond_barrier.count = thread_count;
+  b.cond_barrier.arrived = 0;
+  b.cond_barrier.generation = 0;
+  b.iters = iters;
+  std::vector<pthread_t> threads(thread_count);
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], NULL, loop, &b);
+  }
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  StopBenchmarkTiming();
+
+  pthread_cond_destroy(&b.cond_barrier.cond);
+  pthread_mutex_destroy(&b.cond_barrier.lock);
+  pthread_barrier_destroy(&b.barrier);
+}
+
+static void BM_pthread_barrier_wait(int iters, int thread_count) {
+  BarrierPhasesBenchmark(iters, thread_count, BarrierPhasesLoop);
+}
+BENCHMARK(BM_pthread_barrier_wait)->THREAD_COUNTS;
+
+static void BM_pthread_barrier_wait_cond_emulation(int iters, int thread_count) {
+  BarrierPhasesBenchmark(iters, thread_count, CondBarrierPhasesLoop);
+}
+BENCHMARK(BM_pthread_barrier_wait_cond_emulation)->THREAD_COUNTS;
+
+struct ContendedSpinlock {
+  pthread_spinlock_t lock;
+  int iters;
+  volatile int count;
+};
+
+static void* ContendedSpinlockLoop(void* arg) {
+  ContendedSpinlock* s = reinterpret_cast<ContendedSpinlock*>(arg);
+  for (int i = 0; i < s->iters; ++i) {
+    pthread_spin_lock(&s->lock);
+    for (int j = 0; j < 16; ++j) {
+      ++s->count;
+    }
+    pthread_spin_unlock(&s->lock);
+  }
+  return NULL;
+}
+
+// The same workload as BM_pthread_mutex_contended_*.
+static void BM_pthread_spin_lock_contended(int iters, int thread_count) {
+  StopBenchmarkTiming();
+
+  ContendedSpinlock s;
+  pthread_spin_init(&s.lock, PTHREAD_PROCESS_PRIVATE);
+  s.iters = iters;
+  s.count = 0;
+  std::vector<pthread_t> threads(thread_count);
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], NULL, ContendedSpinlockLoop, &s);
+  }
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  StopBenchmarkTiming();
+
+  pthread_spin_destroy(&s.lock);
+}
+BENCHMARK(BM_pthread_spin_lock_contended)->THREAD_COUNTS;
+
+static void* IdleThread(void*) {
+  return NULL;
+}
+
+static void BM_pthread_create_join(int iters) {
+  for (int i = 0; i < iters; ++i) {
+    pthread_t t;
+    pthread_create(&t, NULL, IdleThread, NULL);
+    pthread_join(t, NULL);
+  }
+}
+BENCHMARK(BM_pthread_create_join);
+
+static void BM_pthread_setspecific(int iters) {
+  pthread_key_t key;
+  pthread_key_create(&key, NULL);
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    pthread_setspecific(key, &key);
+  }
+
+  StopBenchmarkTiming();
+
+  pthread_key_delete(key);
+}
+BENCHMARK(BM_pthread_setspecific);
+
+// pthread_getspecific of a key in the TLS area, and of one beyond it.
+static void GetSpecificBenchmark(int iters, int extra_keys) {
+  std::vector<pthread_key_t> keys(extra_keys + 1);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    pthread_key_create(&keys[i], NULL);
+  }
+  pthread_key_t key = keys.back();
+  pthread_setspecific(key, &key);
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    pthread_getspecific(key);
+  }
+
+  StopBenchmarkTiming();
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    pthread_key_delete(keys[i]);
+  }
+}
+
+static void BM_pthread_getspecific(int iters) {
+  GetSpecificBenchmark(iters, 0);
+}
+BENCHMARK(BM_pthread_getspecific);
+
+static void BM_pthread_getspecific_dynamic_key(int iters) {
+  GetSpecificBenchmark(iters, 200);
+}
+BENCHMARK(BM_pthread_getspecific_dynamic_key);
+
+static void NoopDestructor(void*) {
+}
+
+static void* SetSpecificThread(void* arg) {
+  pthread_setspecific(*reinterpret_cast<pthread_key_t*>(arg), arg);
+  return NULL;
+}
+
+// Like BM_pthread_create_join, but each thread has a TLS destructor to run when it exits.
+static void BM_pthread_create_join_with_key(int iters) {
+  pthread_key_t key;
+  pthread_key_create(&key, NoopDestructor);
+
+  for (int i = 0; i < iters; ++i) {
+    pthread_t t;
+    pthread_create(&t, NULL, SetSpecificThread, &key);
+    pthread_join(t, NULL);
+  }
+
+  pthread_key_delete(key);
+}
+BENCHMARK(BM_pthread_create_join_with_key);
+
+struct IdleThreads {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool done;
+};
+
+static void* WaitUntilDone(void* arg) {
+  IdleThreads* idle = reinterpret_cast<IdleThreads*>(arg);
+  pthread_mutex_lock(&idle->lock);
+  while (!idle->done) {
+    pthread_cond_wait(&idle->cond, &idle->lock);
+  }
+  pthread_mutex_unlock(&idle->lock);
+  return NULL;
+}
+
+// pthread_kill(t, 0) on each of 'thread_count' live threads in turn, as a sampling profiler would.
+static void BM_pthread_kill_lookup(int iters, int thread_count) {
+  StopBenchmarkTiming();
+
+  IdleThreads idle;
+  pthread_mutex_init(&idle.lock, NULL);
+  pthread_cond_init(&idle.cond, NULL);
+  idle.done = false;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 64 * 1024);
+  std::vector<pthread_t> threads(thread_count);
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], &attr, WaitUntilDone, &idle);
+  }
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    pthread_kill(threads[i % thread_count], 0);
+  }
+
+  StopBenchmarkTiming();
+
+  pthread_mutex_lock(&idle.lock);
+  idle.done = true;
+  pthread_cond_broadcast(&idle.cond);
+  pthread_mutex_unlock(&idle.lock);
+  for (int i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_attr_destroy(&attr);
+  pthread_cond_destroy(&idle.cond);
+  pthread_mutex_destroy(&idle.lock);
+}
+BENCHMARK(BM_pthread_kill_lookup)->Arg(1)->Arg(10)->Arg(100)->Arg(1000);
@@ -17,9 +17,13 @@
 #include <gtest/gtest.h>
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
 #include <unistd.h>
 
 TEST(pthread, pthread_key_create) {
@@ -52,6 +56,85 @@ TEST(pthread, pthread_key_create_lots) {
 }
 #endif
 
+static pthread_key_t gDestructorKeys[2];
+static volatile int gDestructorCalls;
+
+static void CountingDestructor(void* value) {
+  __sync_fetch_and_add(&gDestructorCalls, 1);
+  // Destructors may set values again: they get another destructor call.
+  if (value == &gDestructorKeys[0]) {
+    pthread_setspecific(gDestructorKeys[1], &gDestructorKeys[1]);
+  }
+}
+
+static void* SetSpecificFn(void*) {
+  pthread_setspecific(gDestructorKeys[0], &gDestructorKeys[0]);
+  return NULL;
+}
+
+TEST(pthread, pthread_key_create__destructors) {
+  ASSERT_EQ(0, pthread_key_create(&gDestructorKeys[0], CountingDestructor));
+  ASSERT_EQ(0, pthread_key_create(&gDestructorKeys[1], CountingDestructor));
+  gDestructorCalls = 0;
+
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, SetSpecificFn, NULL));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+  ASSERT_EQ(2, gDestructorCalls);
+
+  // A new key doesn't inherit the destructor of a deleted one.
+  ASSERT_EQ(0, pthread_key_delete(gDestructorKeys[1]));
+  ASSERT_EQ(0, pthread_key_delete(gDestructorKeys[0]));
+  ASSERT_EQ(0, pthread_key_create(&gDestructorKeys[0], NULL));
+  ASSERT_EQ(0, pthread_create(&t, NULL, SetSpecificFn, NULL));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+  ASSERT_EQ(2, gDestructorCalls);
+  ASSERT_EQ(0, pthread_key_delete(gDestructorKeys[0]));
+}
+
+static void* SetAndGetAllFn(void* arg) {
+  std::vector<pthread_key_t>& keys = *reinterpret_cast<std::vector<pthread_key_t>*>(arg);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (pthread_getspecific(keys[i]) != NULL || pthread_setspecific(keys[i], &keys[i]) != 0) {
+      return NULL;
+    }
+  }
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (pthread_getspecific(keys[i]) != &keys[i]) {
+      return NULL;
+    }
+  }
+  return arg;
+}
+
+TEST(pthread, pthread_setspecific__lots_of_keys) {
+  // Well beyond the TLS slots, for the keys that need a block allocated by each thread.
+  std::vector<pthread_key_t> keys;
+  for (int i = 0; i < 1000; ++i) {
+    pthread_key_t key;
+    ASSERT_EQ(0, pthread_key_create(&key, CountingDestructor));
+    keys.push_back(key);
+  }
+  gDestructorCalls = 0;
+
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, SetAndGetAllFn, &keys));
+  void* result;
+  ASSERT_EQ(0, pthread_join(t, &result));
+  ASSERT_EQ(&keys, result);
+  ASSERT_EQ(1000, gDestructorCalls);
+
+  // Deleting a key clears its value, so it doesn't show through a new key.
+  ASSERT_EQ(0, pthread_setspecific(keys.back(), &keys));
+  ASSERT_EQ(0, pthread_key_delete(keys.back()));
+  ASSERT_EQ(0, pthread_key_create(&keys.back(), CountingDestructor));
+  ASSERT_TRUE(pthread_getspecific(keys.back()) == NULL);
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(0, pthread_key_delete(keys[i]));
+  }
+}
+
 static void* IdFn(void* arg) {
   return arg;
 }
@@ -107,6 +190,54 @@ TEST(pthread, pthread_create_EAGAIN) {
   ASSERT_EQ(EAGAIN, pthread_create(&t, &attributes, IdFn, NULL));
 }
 
+struct StackCheck {
+  size_t stack_size;
+  bool ok;
+};
+
+static void* StackCheckFn(void* arg) {
+  StackCheck* check = reinterpret_cast<StackCheck*>(arg);
+  pthread_attr_t attr;
+  pthread_getattr_np(pthread_self(), &attr);
+  void* stack_base;
+  size_t stack_size;
+  pthread_attr_getstack(&attr, &stack_base, &stack_size);
+
+  // We should be running on a stack of the size we asked for...
+  char local;
+  check->ok = (stack_size >= check->stack_size) &&
+      (&local >= reinterpret_cast<char*>(stack_base)) &&
+      (&local < reinterpret_cast<char*>(stack_base) + stack_size);
+#if !defined(__GLIBC__) // glibc doesn't give threads an alternate signal stack.
+  // ...with an alternate signal stack ready.
+  stack_t ss;
+  sigaltstack(NULL, &ss);
+  check->ok = check->ok && (ss.ss_sp != NULL) && (ss.ss_flags & SS_DISABLE) == 0;
+#endif
+  return NULL;
+}
+
+TEST(pthread, pthread_create__reuses_stacks) {
+  // Threads that exit leave their stacks to be reused; make sure new
+  // threads still get what they ask for when the sizes vary.
+  const size_t stack_sizes[] = { 64 * 1024, 128 * 1024, 0 };
+  for (size_t i = 0; i < 64; ++i) {
+    pthread_attr_t attr;
+    ASSERT_EQ(0, pthread_attr_init(&attr));
+    size_t stack_size = stack_sizes[i % 3];
+    if (stack_size != 0) {
+      ASSERT_EQ(0, pthread_attr_setstacksize(&attr, stack_size));
+    }
+    StackCheck check;
+    check.stack_size = stack_size;
+    check.ok = false;
+    pthread_t t;
+    ASSERT_EQ(0, pthread_create(&t, &attr, StackCheckFn, &check));
+    ASSERT_EQ(0, pthread_join(t, NULL));
+    ASSERT_TRUE(check.ok) << "iteration " << i;
+  }
+}
+
 TEST(pthread, pthread_no_join_after_detach) {
   pthread_t t1;
   ASSERT_EQ(0, pthread_create(&t1, NULL, SleepFn, reinterpret_cast<void*>(5)));
@@ -272,6 +403,56 @@ TEST(pthread, pthread_kill__in_signal_handler) {
   ASSERT_EQ(0, pthread_kill(pthread_self(), SIGALRM));
 }
 
+struct Gate {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool open;
+};
+
+static void* WaitForGateFn(void* arg) {
+  Gate* gate = reinterpret_cast<Gate*>(arg);
+  pthread_mutex_lock(&gate->lock);
+  while (!gate->open) {
+    pthread_cond_wait(&gate->cond, &gate->lock);
+  }
+  pthread_mutex_unlock(&gate->lock);
+  return NULL;
+}
+
+TEST(pthread, pthread_kill__lots_of_threads) {
+  Gate gate;
+  ASSERT_EQ(0, pthread_mutex_init(&gate.lock, NULL));
+  ASSERT_EQ(0, pthread_cond_init(&gate.cond, NULL));
+  gate.open = false;
+
+  pthread_attr_t attr;
+  ASSERT_EQ(0, pthread_attr_init(&attr));
+  ASSERT_EQ(0, pthread_attr_setstacksize(&attr, 64 * 1024));
+
+  // Enough threads that several share each slot of the thread table.
+  std::vector<pthread_t> threads(500);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], &attr, WaitForGateFn, &gate));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    ASSERT_EQ(0, pthread_kill(threads[i], 0));
+  }
+
+  pthread_mutex_lock(&gate.lock);
+  gate.open = true;
+  pthread_cond_broadcast(&gate.cond);
+  pthread_mutex_unlock(&gate.lock);
+
+  // Join in an order unrelated to creation, to take threads out of the middle of the table.
+  for (size_t i = 0; i < threads.size(); i += 2) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  for (size_t i = 1; i < threads.size(); i += 2) {
+    ASSERT_EQ(0, pthread_kill(threads[i], 0));
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+}
+
 TEST(pthread, pthread_detach__no_such_thread) {
   pthread_t dead_thread;
   MakeDeadThread(dead_thread);
@@ -443,3 +624,637 @@ TEST(pthread, pthread_attr_setstacksize) {
   ASSERT_EQ(GetActualStackSize(attributes), 32*1024U);
 #endif
 }
+
+TEST(pthread, pthread_mutexattr_settype_adaptive) {
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+  ASSERT_EQ(0, pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP));
+  int type;
+  ASSERT_EQ(0, pthread_mutexattr_gettype(&attr, &type));
+  ASSERT_EQ(PTHREAD_MUTEX_ADAPTIVE_NP, type);
+
+  pthread_mutex_t lock;
+  ASSERT_EQ(0, pthread_mutex_init(&lock, &attr));
+  ASSERT_EQ(0, pthread_mutex_lock(&lock));
+  ASSERT_EQ(EBUSY, pthread_mutex_trylock(&lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&lock));
+  ASSERT_EQ(0, pthread_mutex_trylock(&lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&lock));
+  ASSERT_EQ(0, pthread_mutex_destroy(&lock));
+  ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
+}
+
+struct MutexCounter {
+  pthread_mutex_t lock;
+  int count;
+};
+
+static void* MutexCounterFn(void* arg) {
+  MutexCounter* counter = reinterpret_cast<MutexCounter*>(arg);
+  for (size_t i = 0; i < 10000; ++i) {
+    pthread_mutex_lock(&counter->lock);
+    ++counter->count;
+    pthread_mutex_unlock(&counter->lock);
+  }
+  return NULL;
+}
+
+static void TestMutexContention(int type) {
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+  ASSERT_EQ(0, pthread_mutexattr_settype(&attr, type));
+  MutexCounter counter;
+  ASSERT_EQ(0, pthread_mutex_init(&counter.lock, &attr));
+  counter.count = 0;
+
+  pthread_t threads[8];
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, MutexCounterFn, &counter));
+  }
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  ASSERT_EQ(8 * 10000, counter.count);
+  ASSERT_EQ(0, pthread_mutex_destroy(&counter.lock));
+}
+
+TEST(pthread, pthread_mutex_lock__contended) {
+  TestMutexContention(PTHREAD_MUTEX_NORMAL);
+  TestMutexContention(PTHREAD_MUTEX_RECURSIVE);
+  TestMutexContention(PTHREAD_MUTEX_ERRORCHECK);
+  TestMutexContention(PTHREAD_MUTEX_ADAPTIVE_NP);
+}
+
+struct BroadcastState {
+  pthread_mutex_t lock;
+  pthread_cond_t* cond;
+  int generation;
+  int waiting;
+  int woken;
+};
+
+static void* BroadcastWaiterFn(void* arg) {
+  BroadcastState* state = reinterpret_cast<BroadcastState*>(arg);
+  pthread_mutex_lock(&state->lock);
+  int generation = state->generation;
+  ++state->waiting;
+  while (state->generation == generation) {
+    pthread_cond_wait(state->cond, &state->lock);
+  }
+  ++state->woken;
+  pthread_mutex_unlock(&state->lock);
+  return NULL;
+}
+
+static void InitBroadcastState(BroadcastState* state, pthread_cond_t* cond) {
+  ASSERT_EQ(0, pthread_mutex_init(&state->lock, NULL));
+  ASSERT_EQ(0, pthread_cond_init(cond, NULL));
+  state->cond = cond;
+  state->generation = 0;
+  state->waiting = 0;
+  state->woken = 0;
+}
+
+// Returns with the state's lock held once 'count' threads are blocked in pthread_cond_wait.
+static void WaitForBroadcastWaiters(BroadcastState* state, int count) {
+  pthread_mutex_lock(&state->lock);
+  while (state->waiting != count) {
+    pthread_mutex_unlock(&state->lock);
+    usleep(1000);
+    pthread_mutex_lock(&state->lock);
+  }
+}
+
+TEST(pthread, pthread_cond_broadcast__wakes_all_waiters) {
+  BroadcastState state;
+  pthread_cond_t cond;
+  InitBroadcastState(&state, &cond);
+
+  pthread_t threads[32];
+  for (size_t i = 0; i < 32; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, BroadcastWaiterFn, &state));
+  }
+
+  // Wait until every thread is blocked in pthread_cond_wait, then wake them all.
+  WaitForBroadcastWaiters(&state, 32);
+  ++state.generation;
+  ASSERT_EQ(0, pthread_cond_broadcast(&cond));
+  pthread_mutex_unlock(&state.lock);
+
+  for (size_t i = 0; i < 32; ++i) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  ASSERT_EQ(32, state.woken);
+  ASSERT_EQ(0, pthread_cond_destroy(&cond));
+  ASSERT_EQ(0, pthread_mutex_destroy(&state.lock));
+}
+
+TEST(pthread, pthread_cond_broadcast__colliding_conds) {
+  // bionic remembers the mutexes of condition variable waiters in a table with 64 slots
+  // hashed by address, so conds[0] and conds[64] share a slot.
+  pthread_cond_t conds[65];
+  BroadcastState a;
+  BroadcastState b;
+  InitBroadcastState(&a, &conds[0]);
+  InitBroadcastState(&b, &conds[64]);
+
+  // While a waiter on 'b' holds the slot, waiters on 'a' can't record their mutex there.
+  pthread_t b_thread;
+  ASSERT_EQ(0, pthread_create(&b_thread, NULL, BroadcastWaiterFn, &b));
+  WaitForBroadcastWaiters(&b, 1);
+  pthread_mutex_unlock(&b.lock);
+
+  pthread_t a_threads[3];
+  for (size_t i = 0; i < 2; ++i) {
+    ASSERT_EQ(0, pthread_create(&a_threads[i], NULL, BroadcastWaiterFn, &a));
+  }
+  WaitForBroadcastWaiters(&a, 2);
+  pthread_mutex_unlock(&a.lock);
+
+  // Once the slot is free, the next waiter on 'a' records its mutex.
+  pthread_mutex_lock(&b.lock);
+  ++b.generation;
+  ASSERT_EQ(0, pthread_cond_signal(b.cond));
+  pthread_mutex_unlock(&b.lock);
+  ASSERT_EQ(0, pthread_join(b_thread, NULL));
+
+  ASSERT_EQ(0, pthread_create(&a_threads[2], NULL, BroadcastWaiterFn, &a));
+  WaitForBroadcastWaiters(&a, 3);
+  ++a.generation;
+  pthread_mutex_unlock(&a.lock);
+
+  // Broadcast without the mutex held, so the first waiter woken finds it unlocked. Whether
+  // or not that waiter recorded its mutex, unlocking it must wake the next one.
+  ASSERT_EQ(0, pthread_cond_broadcast(a.cond));
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(0, pthread_join(a_threads[i], NULL));
+  }
+  ASSERT_EQ(3, a.woken);
+  ASSERT_EQ(1, b.woken);
+}
+
+TEST(pthread, pthread_mutexattr_setprotocol) {
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+  int protocol;
+  ASSERT_EQ(0, pthread_mutexattr_getprotocol(&attr, &protocol));
+  ASSERT_EQ(PTHREAD_PRIO_NONE, protocol);
+  ASSERT_EQ(0, pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT));
+  ASSERT_EQ(0, pthread_mutexattr_getprotocol(&attr, &protocol));
+  ASSERT_EQ(PTHREAD_PRIO_INHERIT, protocol);
+#if defined(__BIONIC__)
+  ASSERT_EQ(ENOTSUP, pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_PROTECT));
+#endif
+  ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
+}
+
+TEST(pthread, pthread_mutex_lock__priority_inheritance) {
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+  ASSERT_EQ(0, pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT));
+  ASSERT_EQ(0, pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK));
+  MutexCounter counter;
+  ASSERT_EQ(0, pthread_mutex_init(&counter.lock, &attr));
+  counter.count = 0;
+
+  ASSERT_EQ(0, pthread_mutex_lock(&counter.lock));
+  ASSERT_EQ(EDEADLK, pthread_mutex_lock(&counter.lock));
+  ASSERT_EQ(0, pthread_mutex_unlock(&counter.lock));
+  ASSERT_EQ(EPERM, pthread_mutex_unlock(&counter.lock));
+
+  // Contended use from several threads must still be mutually exclusive.
+  pthread_t threads[8];
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, MutexCounterFn, &counter));
+  }
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  ASSERT_EQ(8 * 10000, counter.count);
+
+  ASSERT_EQ(0, pthread_mutex_destroy(&counter.lock));
+  ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
+}
+
+struct PiWaiter {
+  pthread_mutex_t* lock;
+  volatile bool waiting;
+  timespec acquired;
+};
+
+// Returns the kernel's effective priority for a thread of this process (the
+// "priority" field of its stat file), which includes any priority-inheritance
+// boost: -1 - the real-time priority for a real-time thread, and 0 to 39 otherwise.
+// Returns INT_MAX if it can't be read.
+static int GetEffectivePriority(pid_t tid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return INT_MAX;
+  }
+  char buf[1024];
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) {
+    return INT_MAX;
+  }
+  buf[n] = '\0';
+
+  // The name can contain anything, so count the fields from the ')' after it.
+  // "priority" is the 18th field, and the state after the name is the 3rd.
+  char* p = strrchr(buf, ')');
+  for (int field = 2; p != NULL && field < 18; ++field) {
+    p = strchr(p + 1, ' ');
+  }
+  return (p != NULL) ? atoi(p + 1) : INT_MAX;
+}
+
+struct PiBoostWaiter {
+  pthread_mutex_t* lock;
+  volatile int setschedparam_result;
+  volatile bool waiting;
+};
+
+static void* PiBoostWaiterFn(void* arg) {
+  PiBoostWaiter* waiter = reinterpret_cast<PiBoostWaiter*>(arg);
+  sched_param param;
+  param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+  waiter->setschedparam_result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  waiter->waiting = true;
+  if (waiter->setschedparam_result == 0) {
+    pthread_mutex_lock(waiter->lock);
+    pthread_mutex_unlock(waiter->lock);
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_mutex_lock__priority_inheritance_boosts_owner) {
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+  ASSERT_EQ(0, pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT));
+  pthread_mutex_t lock;
+  ASSERT_EQ(0, pthread_mutex_init(&lock, &attr));
+
+  pid_t tid = gettid();
+  int unboosted_priority = GetEffectivePriority(tid);
+  ASSERT_NE(INT_MAX, unboosted_priority);
+  ASSERT_GE(unboosted_priority, 0);  // We're not a real-time thread...
+
+  ASSERT_EQ(0, pthread_mutex_lock(&lock));
+  PiBoostWaiter waiter;
+  waiter.lock = &lock;
+  waiter.setschedparam_result = -1;
+  waiter.waiting = false;
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, PiBoostWaiterFn, &waiter));
+  while (!waiter.waiting) {
+    usleep(100);
+  }
+  if (waiter.setschedparam_result != 0) {
+    ASSERT_EQ(0, pthread_mutex_unlock(&lock));
+    ASSERT_EQ(0, pthread_join(t, NULL));
+    ASSERT_EQ(EPERM, waiter.setschedparam_result);
+    fprintf(stderr, "skipping test: not allowed to create a SCHED_FIFO thread\n");
+    return;
+  }
+
+  // ...until a real-time thread blocks on a mutex we own, and lends us its priority.
+  int expected = -1 - sched_get_priority_min(SCHED_FIFO);
+  int priority = unboosted_priority;
+  for (size_t i = 0; i < 5000 && priority != expected; ++i) {
+    usleep(1000);
+    priority = GetEffectivePriority(tid);
+  }
+  ASSERT_EQ(expected, priority);
+
+  ASSERT_EQ(0, pthread_mutex_unlock(&lock));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+  ASSERT_EQ(unboosted_priority, GetEffectivePriority(tid));
+
+  ASSERT_EQ(0, pthread_mutex_destroy(&lock));
+  ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
+}
+
+static void* PiWaiterFn(void* arg) {
+  PiWaiter* waiter = reinterpret_cast<PiWaiter*>(arg);
+  // Run as a real-time thread if we're allowed to.
+  sched_param param;
+  param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+  pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+  waiter->waiting = true;
+  pthread_mutex_lock(waiter->lock);
+  clock_gettime(CLOCK_MONOTONIC, &waiter->acquired);
+  pthread_mutex_unlock(waiter->lock);
+  return NULL;
+}
+
+// Measures how long it takes a (SCHED_FIFO, if we have the privilege) thread
+// blocked on a priority-inheritance mutex to get it after it's released.
+TEST(pthread, pthread_mutex_unlock__priority_inheritance_wake_latency) {
+  pthread_mutexattr_t attr;
+  ASSERT_EQ(0, pthread_mutexattr_init(&attr));
+  ASSERT_EQ(0, pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT));
+  pthread_mutex_t lock;
+  ASSERT_EQ(0, pthread_mutex_init(&lock, &attr));
+
+  int64_t worst_ns = 0;
+  for (size_t i = 0; i < 20; ++i) {
+    PiWaiter waiter;
+    waiter.lock = &lock;
+    waiter.waiting = false;
+
+    ASSERT_EQ(0, pthread_mutex_lock(&lock));
+    pthread_t t;
+    ASSERT_EQ(0, pthread_create(&t, NULL, PiWaiterFn, &waiter));
+    while (!waiter.waiting) {
+      usleep(100);
+    }
+    usleep(10000);  // Give the waiter time to block in the kernel.
+
+    timespec released;
+    clock_gettime(CLOCK_MONOTONIC, &released);
+    ASSERT_EQ(0, pthread_mutex_unlock(&lock));
+    ASSERT_EQ(0, pthread_join(t, NULL));
+
+    int64_t ns = (waiter.acquired.tv_sec - released.tv_sec) * 1000000000LL +
+                 (waiter.acquired.tv_nsec - released.tv_nsec);
+    if (ns > worst_ns) {
+      worst_ns = ns;
+    }
+  }
+  RecordProperty("worst_wake_latency_us", static_cast<int>(worst_ns / 1000));
+  ASSERT_LT(worst_ns, 100000000LL);
+
+  ASSERT_EQ(0, pthread_mutex_destroy(&lock));
+  ASSERT_EQ(0, pthread_mutexattr_destroy(&attr));
+}
+
+TEST(pthread, pthread_rwlock_smoke) {
+  pthread_rwlock_t l;
+  ASSERT_EQ(0, pthread_rwlock_init(&l, NULL));
+
+  // Readers share the lock, and keep writers out.
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_tryrdlock(&l));
+  ASSERT_EQ(EBUSY, pthread_rwlock_trywrlock(&l));
+#if defined(__BIONIC__)
+  ASSERT_EQ(EBUSY, pthread_rwlock_destroy(&l));
+#endif
+  ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+#if defined(__BIONIC__)
+  ASSERT_EQ(EPERM, pthread_rwlock_unlock(&l));
+#endif
+
+  // A writer keeps everyone else out.
+  ASSERT_EQ(0, pthread_rwlock_wrlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_trywrlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+
+  ASSERT_EQ(0, pthread_rwlock_destroy(&l));
+}
+
+#if defined(__BIONIC__)
+// glibc prefers readers by default, so this only holds for bionic.
+struct RwlockWriter {
+  pthread_rwlock_t lock;
+  volatile bool done;
+};
+
+static void* RwlockWriterFn(void* arg) {
+  RwlockWriter* w = reinterpret_cast<RwlockWriter*>(arg);
+  pthread_rwlock_wrlock(&w->lock);
+  w->done = true;
+  pthread_rwlock_unlock(&w->lock);
+  return NULL;
+}
+
+TEST(pthread, pthread_rwlock_wrlock__blocks_new_readers) {
+  RwlockWriter w;
+  ASSERT_EQ(0, pthread_rwlock_init(&w.lock, NULL));
+  w.done = false;
+
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&w.lock));
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, RwlockWriterFn, &w));
+
+  // Once the writer is waiting, new readers have to wait behind it.
+  while (pthread_rwlock_tryrdlock(&w.lock) == 0) {
+    ASSERT_EQ(0, pthread_rwlock_unlock(&w.lock));
+    usleep(1000);
+  }
+  ASSERT_FALSE(w.done);
+
+  ASSERT_EQ(0, pthread_rwlock_unlock(&w.lock));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+  ASSERT_TRUE(w.done);
+  ASSERT_EQ(0, pthread_rwlock_destroy(&w.lock));
+}
+#endif
+
+TEST(pthread, pthread_rwlock_timedwrlock__timeout) {
+  pthread_rwlock_t l;
+  ASSERT_EQ(0, pthread_rwlock_init(&l, NULL));
+  ASSERT_EQ(0, pthread_rwlock_rdlock(&l));
+
+  timespec ts;
+  ASSERT_EQ(0, clock_gettime(CLOCK_REALTIME, &ts));
+  ts.tv_nsec += 10 * 1000 * 1000;
+  if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000 * 1000 * 1000;
+  }
+  ASSERT_EQ(ETIMEDOUT, pthread_rwlock_timedwrlock(&l, &ts));
+
+  // The writer gave up, so readers aren't held back any more.
+  ASSERT_EQ(0, pthread_rwlock_tryrdlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_unlock(&l));
+  ASSERT_EQ(0, pthread_rwlock_destroy(&l));
+}
+
+struct RwlockCounter {
+  pthread_rwlock_t lock;
+  volatile int a;
+  volatile int b;
+  volatile bool torn;
+};
+
+static void* RwlockCounterFn(void* arg) {
+  RwlockCounter* c = reinterpret_cast<RwlockCounter*>(arg);
+  for (size_t i = 0; i < 10000; ++i) {
+    if ((i % 8) == 0) {
+      pthread_rwlock_wrlock(&c->lock);
+      ++c->a;
+      ++c->b;
+    } else {
+      pthread_rwlock_rdlock(&c->lock);
+      if (c->a != c->b) {
+        c->torn = true;
+      }
+    }
+    pthread_rwlock_unlock(&c->lock);
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_rwlock__contended) {
+  RwlockCounter c;
+  ASSERT_EQ(0, pthread_rwlock_init(&c.lock, NULL));
+  c.a = c.b = 0;
+  c.torn = false;
+
+  pthread_t threads[8];
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, RwlockCounterFn, &c));
+  }
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  ASSERT_FALSE(c.torn);
+  ASSERT_EQ(8 * 1250, c.a);
+  ASSERT_EQ(0, pthread_rwlock_destroy(&c.lock));
+}
+
+TEST(pthread, pthread_spin_smoke) {
+  pthread_spinlock_t lock;
+  ASSERT_EQ(0, pthread_spin_init(&lock, PTHREAD_PROCESS_PRIVATE));
+  ASSERT_EQ(0, pthread_spin_trylock(&lock));
+  ASSERT_EQ(EBUSY, pthread_spin_trylock(&lock));
+  ASSERT_EQ(0, pthread_spin_unlock(&lock));
+  ASSERT_EQ(0, pthread_spin_lock(&lock));
+  ASSERT_EQ(0, pthread_spin_unlock(&lock));
+  ASSERT_EQ(0, pthread_spin_destroy(&lock));
+}
+
+struct SpinCounter {
+  pthread_spinlock_t lock;
+  int count;
+};
+
+static void* SpinCounterFn(void* arg) {
+  SpinCounter* counter = reinterpret_cast<SpinCounter*>(arg);
+  for (size_t i = 0; i < 10000; ++i) {
+    pthread_spin_lock(&counter->lock);
+    ++counter->count;
+    pthread_spin_unlock(&counter->lock);
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_spin_lock__contended) {
+  SpinCounter counter;
+  ASSERT_EQ(0, pthread_spin_init(&counter.lock, PTHREAD_PROCESS_PRIVATE));
+  counter.count = 0;
+
+  pthread_t threads[8];
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, SpinCounterFn, &counter));
+  }
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  ASSERT_EQ(8 * 10000, counter.count);
+  ASSERT_EQ(0, pthread_spin_destroy(&counter.lock));
+}
+
+TEST(pthread, pthread_barrierattr_setpshared) {
+  pthread_barrierattr_t attr;
+  ASSERT_EQ(0, pthread_barrierattr_init(&attr));
+  int pshared;
+  ASSERT_EQ(0, pthread_barrierattr_getpshared(&attr, &pshared));
+  ASSERT_EQ(PTHREAD_PROCESS_PRIVATE, pshared);
+  ASSERT_EQ(0, pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED));
+  ASSERT_EQ(0, pthread_barrierattr_getpshared(&attr, &pshared));
+  ASSERT_EQ(PTHREAD_PROCESS_SHARED, pshared);
+  ASSERT_EQ(EINVAL, pthread_barrierattr_setpshared(&attr, 123));
+  ASSERT_EQ(0, pthread_barrierattr_destroy(&attr));
+
+  pthread_barrier_t barrier;
+  ASSERT_EQ(EINVAL, pthread_barrier_init(&barrier, NULL, 0));
+}
+
+struct BarrierState {
+  pthread_barrier_t barrier;
+  volatile int phases[8];
+  volatile int serial_count;
+  volatile bool out_of_step;
+};
+
+struct BarrierThread {
+  BarrierState* state;
+  int id;
+};
+
+static void* BarrierFn(void* arg) {
+  BarrierState* state = reinterpret_cast<BarrierThread*>(arg)->state;
+  int id = reinterpret_cast<BarrierThread*>(arg)->id;
+  for (int phase = 1; phase <= 1000; ++phase) {
+    state->phases[id] = phase;
+    if (pthread_barrier_wait(&state->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+      __sync_fetch_and_add(&state->serial_count, 1);
+    }
+    // Nobody can get past the barrier until everyone has reached it.
+    for (size_t i = 0; i < 8; ++i) {
+      if (state->phases[i] < phase) {
+        state->out_of_step = true;
+      }
+    }
+    pthread_barrier_wait(&state->barrier);
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_barrier_wait) {
+  BarrierState state;
+  ASSERT_EQ(0, pthread_barrier_init(&state.barrier, NULL, 8));
+  for (size_t i = 0; i < 8; ++i) {
+    state.phases[i] = 0;
+  }
+  state.serial_count = 0;
+  state.out_of_step = false;
+
+  pthread_t threads[8];
+  BarrierThread args[8];
+  for (size_t i = 0; i < 8; ++i) {
+    args[i].state = &state;
+    args[i].id = i;
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, BarrierFn, &args[i]));
+  }
+  for (size_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+  ASSERT_FALSE(state.out_of_step);
+  // Exactly one thread per phase of the first barrier is told it was the last to arrive.
+  ASSERT_EQ(1000, state.serial_count);
+  ASSERT_EQ(0, pthread_barrier_destroy(&state.barrier));
+}
+
+static void* BarrierDestroyFn(void* arg) {
+  pthread_barrier_t* barrier = reinterpret_cast<pthread_barrier_t*>(arg);
+  if (pthread_barrier_wait(barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+    // The other threads may not have left pthread_barrier_wait yet, but we're allowed
+    // to destroy the barrier and reuse its memory. Zeroing it puts the barrier's phase
+    // back to where it started, so a waiter that looked at it again would never leave.
+    EXPECT_EQ(0, pthread_barrier_destroy(barrier));
+    memset(barrier, 0, sizeof(*barrier));
+  }
+  return NULL;
+}
+
+TEST(pthread, pthread_barrier_destroy__by_serial_thread) {
+  for (size_t i = 0; i < 1000; ++i) {
+    pthread_barrier_t barrier;
+    ASSERT_EQ(0, pthread_barrier_init(&barrier, NULL, 4));
+    pthread_t threads[4];
+    for (size_t j = 0; j < 4; ++j) {
+      ASSERT_EQ(0, pthread_create(&threads[j], NULL, BarrierDestroyFn, &barrier));
+    }
+    for (size_t j = 0; j < 4; ++j) {
+      ASSERT_EQ(0, pthread_join(threads[j], NULL));
+    }
+  }
+}
@@ -144,3 +144,78 @@ static void BM_string_strlen(int iters, int nbytes) {
   delete[] s;
 }
 BENCHMARK(BM_string_strlen)->AT_COMMON_SIZES;
+
+static void BM_string_memchr(int iters, int nbytes) {
+  StopBenchmarkTiming();
+  char* s = new char[nbytes];
+  memset(s, 'x', nbytes);
+  s[nbytes - 1] = 'y';
+  StartBenchmarkTiming();
+
+  volatile int c __attribute__((unused)) = 0;
+  for (int i = 0; i < iters; ++i) {
+    c += (memchr(s, 'y', nbytes) != NULL);
+  }
+
+  StopBenchmarkTiming();
+  SetBenchmarkBytesProcessed(int64_t(iters) * int64_t(nbytes));
+  delete[] s;
+}
+BENCHMARK(BM_string_memchr)->AT_COMMON_SIZES;
+
+static void BM_string_strchr(int iters, int nbytes) {
+  StopBenchmarkTiming();
+  char* s = new char[nbytes];
+  memset(s, 'x', nbytes);
+  s[nbytes - 1] = 0;
+  StartBenchmarkTiming();
+
+  volatile int c __attribute__((unused)) = 0;
+  for (int i = 0; i < iters; ++i) {
+    c += (strchr(s, 'y') != NULL);
+  }
+
+  StopBenchmarkTiming();
+  SetBenchmarkBytesProcessed(int64_t(iters) * int64_t(nbytes));
+  delete[] s;
+}
+BENCHMARK(BM_string_strchr)->AT_COMMON_SIZES;
+
+static void BM_string_strcmp(int iters, int nbytes) {
+  StopBenchmarkTiming();
+  char* s1 = new char[nbytes]; char* s2 = new char[nbytes];
+  memset(s1, 'x', nbytes);
+  memset(s2, 'x', nbytes);
+  s1[nbytes - 1] = 0;
+  s2[nbytes - 1] = 0;
+  StartBenchmarkTiming();
+
+  volatile int c __attribute__((unused)) = 0;
+  for (int i = 0; i < iters; ++i) {
+    c += strcmp(s1, s2);
+  }
+
+  StopBenchmarkTiming();
+  SetBenchmarkBytesProcessed(int64_t(iters) * int64_t(nbytes));
+  delete[] s1;
+  delete[] s2;
+}
+BENCHMARK(BM_string_strcmp)->AT_COMMON_SIZES;
+
+static void BM_string_strcpy(int iters, int nbytes) {
+  StopBenchmarkTiming();
+  char* src = new char[nbytes]; char* dst = new char[nbytes];
+  memset(src, 'x', nbytes);
+  src[nbytes - 1] = 0;
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    strcpy(dst, src);
+  }
+
+  StopBenchmarkTiming();
+  SetBenchmarkBytesProcessed(int64_t(iters) * int64_t(nbytes));
+  delete[] src;
+  delete[] dst;
+}
+BENCHMARK(BM_string_strcpy)->AT_COMMON_SIZES;
@@ -19,6 +19,9 @@
 #include <errno.h>
 #include <math.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wchar.h>
 
 #define KB 1024
 #define SMALL 1*KB
@@ -885,3 +888,49 @@ TEST(string, bzero) {
     ASSERT_EQ(0, memcmp(state.ptr1, state.ptr2, state.MAX_LEN));
   }
 }
+
+// Strings that end right before an unmapped page mustn't cause any reads from
+// it, however the optimized implementations read ahead.
+TEST(string, page_boundary) {
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  char* map = reinterpret_cast<char*>(mmap(NULL, 3 * page_size, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  ASSERT_NE(MAP_FAILED, map);
+  ASSERT_EQ(0, mprotect(map + 2 * page_size, page_size, PROT_NONE));
+  char* end = map + 2 * page_size;
+  char* copy = map;
+
+  for (size_t len = 0; len < 256; ++len) {
+    char* s = end - len - 1;
+    memset(s, 'x', len);
+    s[len] = '\0';
+
+    ASSERT_EQ(len, strlen(s));
+    ASSERT_EQ(len, strnlen(s, len + 100));
+    ASSERT_EQ(len, strnlen(s, SIZE_MAX));
+    ASSERT_TRUE(memchr(s, '\0', SIZE_MAX) == s + len);
+    ASSERT_TRUE(strchr(s, 'y') == NULL);
+    ASSERT_TRUE(strchr(s, '\0') == s + len);
+    ASSERT_TRUE(strrchr(s, 'y') == NULL);
+    ASSERT_TRUE(strrchr(s, '\0') == s + len);
+
+    ASSERT_TRUE(strcpy(copy, s) == copy);
+    ASSERT_EQ(0, strcmp(copy, s));
+    ASSERT_EQ(0, strcmp(s, copy));
+    ASSERT_EQ(0, strncmp(s, copy, SIZE_MAX));
+    ASSERT_EQ(0, memcmp(s, copy, len + 1));
+  }
+
+  for (size_t len = 0; len < 64; ++len) {
+    wchar_t* s = reinterpret_cast<wchar_t*>(end) - len - 1;
+    wmemset(s, L'x', len);
+    s[len] = L'\0';
+
+    ASSERT_EQ(len, wcslen(s));
+    ASSERT_TRUE(wcschr(s, L'y') == NULL);
+    ASSERT_TRUE(wcsrchr(s, L'y') == NULL);
+    ASSERT_EQ(0, wcscmp(s, s));
+  }
+
+  ASSERT_EQ(0, munmap(map, 3 * page_size));
+}
@@ -15,6 +15,8 @@
  */
 
 #include <gtest/gtest.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <string>
@@ -24,7 +26,10 @@
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
 
+#include "LocalPropertyService.h"
+
 extern void *__system_property_area__;
+extern "C" int __system_properties_init(void);
 
 struct LocalPropertyTestState {
     LocalPropertyTestState() : valid(false) {
@@ -57,6 +62,8 @@ struct LocalPropertyTestState {
         rmdir(pa_dirname.c_str());
     }
 public:
+    const char *filename() const { return pa_filename.c_str(); }
+
     bool valid;
 private:
     std::string pa_dirname;
@@ -117,6 +124,196 @@ TEST(properties, update) {
     ASSERT_STREQ(propvalue, "value6");
 }
 
+TEST(properties, find__cached) {
+    char propvalue[PROP_VALUE_MAX];
+    char name[PROP_NAME_MAX];
+    char value[PROP_VALUE_MAX];
+
+    {
+        LocalPropertyTestState pa;
+        ASSERT_TRUE(pa.valid);
+
+        // A property that wasn't found yet can still be added.
+        ASSERT_EQ(0, __system_property_find("property"));
+        ASSERT_EQ(0, __system_property_add("property", 8, "value1", 6));
+        ASSERT_NE((const prop_info *)NULL, __system_property_find("property"));
+
+        // More properties than fit in the lookup cache, looked up more than once.
+        for (int i = 0; i < 500; i++) {
+            int name_len = snprintf(name, PROP_NAME_MAX, "cached.property.%d", i);
+            int value_len = snprintf(value, PROP_VALUE_MAX, "value%d", i);
+            ASSERT_EQ(0, __system_property_add(name, name_len, value, value_len));
+        }
+        for (int round = 0; round < 2; round++) {
+            for (int i = 0; i < 500; i++) {
+                snprintf(name, PROP_NAME_MAX, "cached.property.%d", i);
+                int value_len = snprintf(value, PROP_VALUE_MAX, "value%d", i);
+                ASSERT_EQ(value_len, __system_property_get(name, propvalue));
+                ASSERT_STREQ(value, propvalue);
+            }
+        }
+        ASSERT_EQ(6, __system_property_get("property", propvalue));
+        ASSERT_STREQ("value1", propvalue);
+    }
+
+    // Lookups in another area don't find the properties of the previous one.
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+    ASSERT_EQ(0, __system_property_find("property"));
+    ASSERT_EQ(0, __system_property_add("property", 8, "value2", 6));
+    ASSERT_EQ(6, __system_property_get("property", propvalue));
+    ASSERT_STREQ("value2", propvalue);
+}
+
+static void *PropertySnapshotHelperFn(void *arg)
+{
+    volatile int *done = (volatile int *)arg;
+    prop_info *a = (prop_info *)__system_property_find("snapshot.a");
+    prop_info *b = (prop_info *)__system_property_find("snapshot.b");
+    char value[PROP_VALUE_MAX];
+
+    // snapshot.a is always updated first, so it's either equal to snapshot.b or one ahead.
+    for (int i = 1; !*done; i++) {
+        int value_len = snprintf(value, PROP_VALUE_MAX, "%d", i);
+        __system_property_update(a, value, value_len);
+        __system_property_update(b, value, value_len);
+    }
+
+    return NULL;
+}
+
+TEST(properties, get_all) {
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+
+    ASSERT_EQ(0, __system_property_add("ro.build.id", 11, "id", 2));
+    ASSERT_EQ(0, __system_property_add("ro.build.type", 13, "type", 4));
+    ASSERT_EQ(0, __system_property_add("ro.product", 10, "product", 7));
+    ASSERT_EQ(0, __system_property_add("other", 5, "other", 5));
+
+    const char *names[] = { "ro.product", "ro.build.type", "missing", "ro.build.id",
+                            "ro.build", "other", "ro.build.id.x", "ro..product", "other" };
+    const unsigned count = sizeof(names) / sizeof(names[0]);
+    const prop_info *pis[count];
+
+    ASSERT_EQ(5U, __system_property_find_all(names, pis, count));
+    for (unsigned i = 0; i < count; i++) {
+        ASSERT_EQ(__system_property_find(names[i]), pis[i]) << names[i];
+    }
+
+    char values[count][PROP_VALUE_MAX];
+    __system_property_read_all(pis, values, count);
+    ASSERT_STREQ("product", values[0]);
+    ASSERT_STREQ("type", values[1]);
+    ASSERT_STREQ("", values[2]);
+    ASSERT_STREQ("id", values[3]);
+    ASSERT_STREQ("", values[4]);
+    ASSERT_STREQ("other", values[5]);
+    ASSERT_STREQ("other", values[8]);
+
+    memset(values, 'x', sizeof(values));
+    ASSERT_EQ(5, __system_property_get_all(names, values, count));
+    ASSERT_STREQ("product", values[0]);
+    ASSERT_STREQ("", values[2]);
+    ASSERT_STREQ("id", values[3]);
+
+    // Snapshots aren't torn by concurrent updates.
+    ASSERT_EQ(0, __system_property_add("snapshot.a", 10, "0", 1));
+    ASSERT_EQ(0, __system_property_add("snapshot.b", 10, "0", 1));
+    const char *snapshot_names[] = { "snapshot.a", "snapshot.b" };
+    char snapshot_values[2][PROP_VALUE_MAX];
+    pthread_t t;
+    volatile int done = 0;
+    ASSERT_EQ(0, pthread_create(&t, NULL, PropertySnapshotHelperFn, (void *)&done));
+    for (int i = 0; i < 10000; i++) {
+        ASSERT_EQ(2, __system_property_get_all(snapshot_names, snapshot_values, 2));
+        int a = atoi(snapshot_values[0]);
+        int b = atoi(snapshot_values[1]);
+        ASSERT_TRUE(a == b || a == b + 1) << a << " " << b;
+    }
+    done = 1;
+    ASSERT_EQ(0, pthread_join(t, NULL));
+}
+
+TEST(properties, set_all) {
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+    char propvalue[PROP_VALUE_MAX];
+
+    ASSERT_EQ(0, __system_property_add("property2", 9, "old", 3));
+
+    const char *keys[] = { "property1", "property2", "property3" };
+    const char *values[] = { "value1", "value2", NULL };
+
+    {
+        LocalPropertyService service;
+        ASSERT_TRUE(service.valid);
+
+        ASSERT_EQ(0, __system_property_set("property", "value"));
+        ASSERT_EQ(1, service.connections);
+
+        // All the properties are set over a single connection.
+        ASSERT_EQ(0, __system_property_set_all(keys, values, 3));
+        ASSERT_EQ(2, service.connections);
+        ASSERT_EQ(5, __system_property_get("property", propvalue));
+        ASSERT_STREQ("value", propvalue);
+        ASSERT_EQ(6, __system_property_get("property1", propvalue));
+        ASSERT_STREQ("value1", propvalue);
+        ASSERT_EQ(6, __system_property_get("property2", propvalue));
+        ASSERT_STREQ("value2", propvalue);
+        ASSERT_EQ(0, __system_property_get("property3", propvalue));
+        ASSERT_NE((const prop_info *)NULL, __system_property_find("property3"));
+
+        ASSERT_EQ(0, __system_property_set_all(keys, values, 0));
+        ASSERT_EQ(2, service.connections);
+
+        const char *bad_keys[] = { "property4", "a_name_that_is_far_too_long_for_a_property" };
+        ASSERT_EQ(-1, __system_property_set_all(bad_keys, values, 2));
+        ASSERT_EQ(2, service.connections);
+        ASSERT_EQ(0, __system_property_find("property4"));
+    }
+
+    // A property service that doesn't support batches is sent the
+    // properties one at a time.
+    LocalPropertyService service(false);
+    ASSERT_TRUE(service.valid);
+
+    values[0] = "value3";
+    ASSERT_EQ(0, __system_property_set_all(keys, values, 2));
+    ASSERT_EQ(3, service.connections);
+    ASSERT_EQ(6, __system_property_get("property1", propvalue));
+    ASSERT_STREQ("value3", propvalue);
+    ASSERT_EQ(6, __system_property_get("property2", propvalue));
+    ASSERT_STREQ("value2", propvalue);
+}
+
+TEST(properties, set_all__slow_service) {
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+    char propvalue[PROP_VALUE_MAX];
+
+    // A property service that doesn't read the batch before we stop waiting for
+    // it hasn't acknowledged anything, so the properties are sent one at a time.
+    // This one doesn't support batches, so it only sets those.
+    LocalPropertyService service(false, 300);
+    ASSERT_TRUE(service.valid);
+
+    const char *keys[] = { "property1", "property2", "property3" };
+    const char *values[] = { "value1", "value2", "value3" };
+    ASSERT_EQ(0, __system_property_set_all(keys, values, 3));
+    for (int i = 0; i < 500 && service.handled < 4; i++) {
+        usleep(10000);
+    }
+    ASSERT_EQ(4, service.handled);
+
+    ASSERT_EQ(6, __system_property_get("property1", propvalue));
+    ASSERT_STREQ("value1", propvalue);
+    ASSERT_EQ(6, __system_property_get("property2", propvalue));
+    ASSERT_STREQ("value2", propvalue);
+    ASSERT_EQ(6, __system_property_get("property3", propvalue));
+    ASSERT_STREQ("value3", propvalue);
+}
+
 TEST(properties, fill) {
     LocalPropertyTestState pa;
     ASSERT_TRUE(pa.valid);
@@ -165,6 +362,80 @@ static void foreach_test_callback(const prop_info *pi, void* cookie) {
     (*count)++;
 }
 
+TEST(properties, prefix_areas) {
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+    char name[PROP_NAME_MAX];
+    char value[PROP_VALUE_MAX];
+    char propvalue[PROP_VALUE_MAX];
+    size_t count = 0;
+
+    // More properties under one prefix than fit in PA_SIZE.
+    for (int i = 0; i < 2000; i++) {
+        int name_len = snprintf(name, PROP_NAME_MAX, "persist.property.%d", i);
+        int value_len = snprintf(value, PROP_VALUE_MAX, "value%d", i);
+        ASSERT_EQ(0, __system_property_add(name, name_len, value, value_len)) << name;
+    }
+
+    // More prefixes than there can be prefix areas.
+    for (int i = 0; i < 100; i++) {
+        int name_len = snprintf(name, PROP_NAME_MAX, "prefix%d.property", i);
+        int value_len = snprintf(value, PROP_VALUE_MAX, "value%d", i);
+        ASSERT_EQ(0, __system_property_add(name, name_len, value, value_len)) << name;
+    }
+    ASSERT_EQ(0, __system_property_add("property", 8, "value", 5));
+
+    // Look them up as a reader would, mapping each area on first use.
+    ASSERT_EQ(0, __system_properties_init());
+
+    for (int i = 0; i < 100; i++) {
+        snprintf(name, PROP_NAME_MAX, "prefix%d.property", i);
+        int value_len = snprintf(value, PROP_VALUE_MAX, "value%d", i);
+        ASSERT_EQ(value_len, __system_property_get(name, propvalue)) << name;
+        ASSERT_STREQ(value, propvalue);
+    }
+    for (int i = 0; i < 2000; i++) {
+        snprintf(name, PROP_NAME_MAX, "persist.property.%d", i);
+        int value_len = snprintf(value, PROP_VALUE_MAX, "value%d", i);
+        ASSERT_EQ(value_len, __system_property_get(name, propvalue)) << name;
+        ASSERT_STREQ(value, propvalue);
+    }
+    ASSERT_EQ(5, __system_property_get("property", propvalue));
+    ASSERT_EQ(0, __system_property_find("persist.property"));
+    ASSERT_EQ(0, __system_property_find("missing.property"));
+
+    ASSERT_EQ(0, __system_property_foreach(foreach_test_callback, &count));
+    ASSERT_EQ(2101U, count);
+}
+
+TEST(properties, prefix_areas_from_environment) {
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+    char propvalue[PROP_VALUE_MAX];
+
+    ASSERT_EQ(0, __system_property_add("persist.property", 16, "value1", 6));
+    ASSERT_EQ(0, __system_property_add("property", 8, "value2", 6));
+
+    // A process that can't open the property file by name gets a descriptor for
+    // it from the environment, and still has to find the prefix areas.
+    int fd = open(pa.filename(), O_RDONLY | O_CLOEXEC);
+    ASSERT_NE(-1, fd);
+    char workspace[32];
+    snprintf(workspace, sizeof(workspace), "%d,0", fd);
+    ASSERT_EQ(0, setenv("ANDROID_PROPERTY_WORKSPACE", workspace, 1));
+    std::string missing_filename = std::string(pa.filename()) + ".missing";
+    ASSERT_EQ(0, __system_property_set_filename(missing_filename.c_str()));
+    ASSERT_EQ(0, __system_properties_init());
+
+    ASSERT_EQ(6, __system_property_get("persist.property", propvalue));
+    ASSERT_STREQ("value1", propvalue);
+    ASSERT_EQ(6, __system_property_get("property", propvalue));
+    ASSERT_STREQ("value2", propvalue);
+
+    unsetenv("ANDROID_PROPERTY_WORKSPACE");
+    close(fd);
+}
+
 TEST(properties, foreach) {
     LocalPropertyTestState pa;
     ASSERT_TRUE(pa.valid);
@@ -265,6 +536,85 @@ TEST(properties, wait) {
     ASSERT_EQ(0, pthread_join(t, &result));
 }
 
+static void *PropertyWaitSetHelperFn(void *arg)
+{
+    int *flag = (int *)arg;
+    prop_info *other = (prop_info *)__system_property_find("other");
+    prop_info *pi = (prop_info *)__system_property_find("property2");
+
+    // Updates of properties outside the set don't end the wait.
+    for (int i = 0; i < 10; i++) {
+        __system_property_update(other, i % 2 ? "odd" : "even", i % 2 ? 3 : 4);
+        usleep(10000);
+    }
+
+    *flag = 1;
+    __system_property_update(pi, "value2", 6);
+
+    return NULL;
+}
+
+TEST(properties, wait_set) {
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+    pthread_t t;
+    int flag = 0;
+
+    ASSERT_EQ(0, __system_property_add("property1", 9, "value1", 6));
+    ASSERT_EQ(0, __system_property_add("property2", 9, "value1", 6));
+    ASSERT_EQ(0, __system_property_add("other", 5, "value1", 6));
+
+    const prop_info *pis[2];
+    pis[0] = __system_property_find("property1");
+    pis[1] = __system_property_find("property2");
+    unsigned int serials[2] = { __system_property_serial(pis[0]), __system_property_serial(pis[1]) };
+    unsigned int old_serials[2] = { serials[0], serials[1] };
+
+    ASSERT_EQ(0, pthread_create(&t, NULL, PropertyWaitSetHelperFn, &flag));
+    ASSERT_EQ(1U, __system_property_wait_set(pis, serials, 2));
+    ASSERT_EQ(flag, 1);
+    ASSERT_EQ(old_serials[0], serials[0]);
+    ASSERT_NE(old_serials[1], serials[1]);
+    ASSERT_EQ(__system_property_serial(pis[1]), serials[1]);
+
+    void* result;
+    ASSERT_EQ(0, pthread_join(t, &result));
+
+    // A change missed before waiting is returned right away.
+    __system_property_update((prop_info *)pis[0], "value2", 6);
+    ASSERT_EQ(1U, __system_property_wait_set(pis, serials, 2));
+    ASSERT_EQ(__system_property_serial(pis[0]), serials[0]);
+}
+
+static void *PropertyWaitPrefixHelperFn(void *arg)
+{
+    int *flag = (int *)arg;
+    usleep(100000);
+
+    *flag = 1;
+    __system_property_add("sys.usb.config", 14, "adb", 3);
+
+    return NULL;
+}
+
+TEST(properties, wait_prefix) {
+    LocalPropertyTestState pa;
+    ASSERT_TRUE(pa.valid);
+    pthread_t t;
+    int flag = 0;
+
+    ASSERT_EQ(0, __system_property_add("sys.boot_completed", 18, "1", 1));
+    unsigned int serial = __system_property_wait_any(0);
+
+    ASSERT_EQ(0, pthread_create(&t, NULL, PropertyWaitPrefixHelperFn, &flag));
+    ASSERT_EQ(flag, 0);
+    ASSERT_NE(serial, __system_property_wait_prefix("sys.usb", serial));
+    ASSERT_EQ(flag, 1);
+
+    void* result;
+    ASSERT_EQ(0, pthread_join(t, &result));
+}
+
 class KilledByFault {
     public:
         explicit KilledByFault() {};
@@ -16,7 +16,12 @@
 
 #include "benchmark.h"
 
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
 
 #if defined(__BIONIC__)
 
@@ -36,3 +41,102 @@ static void BM_time_localtime_tz(int iters) {
 }
 BENCHMARK(BM_time_localtime_tz);
 #endif
+
+// clock_gettime(3), gettimeofday(3) and time(3) use the vDSO when the kernel provides one.
+// The *_syscall benchmarks show what they cost without it.
+static void BM_time_clock_gettime(int iters) {
+  StartBenchmarkTiming();
+
+  timespec t;
+  for (int i = 0; i < iters; ++i) {
+    clock_gettime(CLOCK_MONOTONIC, &t);
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_time_clock_gettime);
+
+static void BM_time_clock_gettime_syscall(int iters) {
+  StartBenchmarkTiming();
+
+  timespec t;
+  for (int i = 0; i < iters; ++i) {
+    syscall(__NR_clock_gettime, CLOCK_MONOTONIC, &t);
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_time_clock_gettime_syscall);
+
+static void BM_time_gettimeofday(int iters) {
+  StartBenchmarkTiming();
+
+  timeval tv;
+  for (int i = 0; i < iters; ++i) {
+    gettimeofday(&tv, NULL);
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_time_gettimeofday);
+
+static void BM_time_gettimeofday_syscall(int iters) {
+  StartBenchmarkTiming();
+
+  timeval tv;
+  for (int i = 0; i < iters; ++i) {
+    syscall(__NR_gettimeofday, &tv, NULL);
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_time_gettimeofday_syscall);
+
+static void BM_time_time(int iters) {
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    time(NULL);
+  }
+
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_time_time);
+
+static void TimerNoopCallback(sigval_t) {
+}
+
+// Creates, arms and deletes a SIGEV_THREAD timer while 'armed_timers' others are armed.
+static void BM_time_timer_create_SIGEV_THREAD(int iters, int armed_timers) {
+  sigevent se;
+  memset(&se, 0, sizeof(se));
+  se.sigev_notify = SIGEV_THREAD;
+  se.sigev_notify_function = TimerNoopCallback;
+
+  itimerspec ts;
+  memset(&ts, 0, sizeof(ts));
+  ts.it_value.tv_sec = 3600;
+
+  timer_t* timer_ids = new timer_t[armed_timers];
+  for (int i = 0; i < armed_timers; ++i) {
+    timer_create(CLOCK_MONOTONIC, &se, &timer_ids[i]);
+    timer_settime(timer_ids[i], 0, &ts, NULL);
+  }
+
+  StartBenchmarkTiming();
+
+  for (int i = 0; i < iters; ++i) {
+    timer_t timer_id;
+    timer_create(CLOCK_MONOTONIC, &se, &timer_id);
+    timer_settime(timer_id, 0, &ts, NULL);
+    timer_delete(timer_id);
+  }
+
+  StopBenchmarkTiming();
+
+  for (int i = 0; i < armed_timers; ++i) {
+    timer_delete(timer_ids[i]);
+  }
+  delete[] timer_ids;
+}
+BENCHMARK(BM_time_timer_create_SIGEV_THREAD)->Arg(1)->Arg(100)->Arg(1000);
@@ -18,7 +18,13 @@
 #include <features.h>
 #include <gtest/gtest.h>
 
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
 
 #ifdef __BIONIC__ // mktime_tz is a bionic extension.
 #include <libc/private/bionic_time.h>
@@ -67,3 +73,230 @@ TEST(time, mktime_10310929) {
   ASSERT_EQ(-1, mktime_tz(&t, "UTC"));
 }
 #endif
+
+TEST(time, clock_gettime) {
+  // Check that the vDSO (if we're using it) agrees with the kernel.
+  timespec ts0;
+  timespec ts1;
+  timespec ts2;
+  ASSERT_EQ(0, clock_gettime(CLOCK_MONOTONIC, &ts0));
+  ASSERT_EQ(0, syscall(__NR_clock_gettime, CLOCK_MONOTONIC, &ts1));
+  ASSERT_EQ(0, clock_gettime(CLOCK_MONOTONIC, &ts2));
+  int64_t t0 = ts0.tv_sec * 1000000000LL + ts0.tv_nsec;
+  int64_t t1 = ts1.tv_sec * 1000000000LL + ts1.tv_nsec;
+  int64_t t2 = ts2.tv_sec * 1000000000LL + ts2.tv_nsec;
+  ASSERT_LE(t0, t1);
+  ASSERT_LE(t1, t2);
+
+  // Errors from the vDSO should look like errors from the system call.
+  errno = 0;
+  ASSERT_EQ(-1, clock_gettime(12345, &ts0)); // No such clock.
+  ASSERT_EQ(EINVAL, errno);
+}
+
+TEST(time, gettimeofday_and_time) {
+  timespec before;
+  timespec after;
+  timeval tv;
+  ASSERT_EQ(0, clock_gettime(CLOCK_REALTIME, &before));
+  ASSERT_EQ(0, gettimeofday(&tv, NULL));
+  time_t now = time(NULL);
+  ASSERT_EQ(0, clock_gettime(CLOCK_REALTIME, &after));
+
+  int64_t before_ns = before.tv_sec * 1000000000LL + before.tv_nsec;
+  int64_t after_ns = after.tv_sec * 1000000000LL + after.tv_nsec;
+  int64_t tv_ns = tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
+  // gettimeofday(2) truncates to microseconds.
+  ASSERT_LE(before_ns / 1000 * 1000, tv_ns);
+  ASSERT_LE(tv_ns, after_ns);
+
+  // time(2) reads the coarse clock, which is never ahead of CLOCK_REALTIME but
+  // can trail it by a few timer ticks.
+  const int64_t kCoarseLagNs = 100000000LL;
+  ASSERT_LE((before_ns - kCoarseLagNs) / 1000000000LL, now);
+  ASSERT_LE(now, after.tv_sec);
+}
+
+TEST(time, clock) {
+  clock_t t0 = clock();
+  ASSERT_NE(static_cast<clock_t>(-1), t0);
+  ASSERT_GE(t0, 0);
+
+  // Spin for 10ms, so that clock(3) advances whether it measures CPU time or elapsed time.
+  timespec start;
+  ASSERT_EQ(0, clock_gettime(CLOCK_MONOTONIC, &start));
+  timespec now;
+  do {
+    ASSERT_EQ(0, clock_gettime(CLOCK_MONOTONIC, &now));
+  } while ((now.tv_sec - start.tv_sec) * 1000000000LL + (now.tv_nsec - start.tv_nsec) < 10000000LL);
+
+  clock_t t1 = clock();
+  ASSERT_GT(t1, t0);
+  ASSERT_LE(t1 - t0, 5 * CLOCKS_PER_SEC);
+}
+
+static void TimerCountingCallback(sigval_t value) {
+  __sync_fetch_and_add(reinterpret_cast<volatile int*>(value.sival_ptr), 1);
+}
+
+static int CreateSigevThreadTimer(volatile int* counter, timer_t* timer_id) {
+  sigevent se;
+  memset(&se, 0, sizeof(se));
+  se.sigev_notify = SIGEV_THREAD;
+  se.sigev_notify_function = TimerCountingCallback;
+  se.sigev_value.sival_ptr = const_cast<int*>(counter);
+  return timer_create(CLOCK_MONOTONIC, &se, timer_id);
+}
+
+static void SetTimer(timer_t timer_id, int64_t value_ns, int64_t interval_ns) {
+  itimerspec ts;
+  ts.it_value.tv_sec = value_ns / 1000000000;
+  ts.it_value.tv_nsec = value_ns % 1000000000;
+  ts.it_interval.tv_sec = interval_ns / 1000000000;
+  ts.it_interval.tv_nsec = interval_ns % 1000000000;
+  ASSERT_EQ(0, timer_settime(timer_id, 0, &ts, NULL));
+}
+
+static void WaitForCount(volatile int* counter, int expected) {
+  for (int i = 0; i < 500 && *counter < expected; ++i) {
+    usleep(10000);
+  }
+}
+
+TEST(time, timer_create_SIGEV_THREAD) {
+  volatile int counter = 0;
+  timer_t timer_id;
+  ASSERT_EQ(0, CreateSigevThreadTimer(&counter, &timer_id));
+
+  SetTimer(timer_id, 10000000, 0);
+  WaitForCount(&counter, 1);
+  ASSERT_EQ(1, counter);
+
+  // A one-shot timer is disarmed once it expired.
+  itimerspec ts;
+  ASSERT_EQ(0, timer_gettime(timer_id, &ts));
+  ASSERT_EQ(0, ts.it_value.tv_sec);
+  ASSERT_EQ(0, ts.it_value.tv_nsec);
+  usleep(50000);
+  ASSERT_EQ(1, counter);
+
+  ASSERT_EQ(0, timer_delete(timer_id));
+}
+
+// bionic runs a timer's callbacks one at a time; glibc starts a thread for each
+// expiration, so they can overlap and this test's counting doesn't hold there.
+#if defined(__BIONIC__)
+struct IntervalTimerState {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int count;
+  // The tenth callback waits in between, so that the test can disarm the timer
+  // while it knows which callback is running.
+  bool paused;
+  bool resumed;
+  bool returned;
+};
+
+static void IntervalTimerCallback(sigval_t value) {
+  IntervalTimerState* state = reinterpret_cast<IntervalTimerState*>(value.sival_ptr);
+  pthread_mutex_lock(&state->lock);
+  if (++state->count == 10) {
+    state->paused = true;
+    pthread_cond_broadcast(&state->cond);
+    while (!state->resumed) {
+      pthread_cond_wait(&state->cond, &state->lock);
+    }
+    state->returned = true;
+    pthread_cond_broadcast(&state->cond);
+  }
+  pthread_mutex_unlock(&state->lock);
+}
+
+TEST(time, timer_settime__interval) {
+  IntervalTimerState state;
+  pthread_mutex_init(&state.lock, NULL);
+  pthread_cond_init(&state.cond, NULL);
+  state.count = 0;
+  state.paused = state.resumed = state.returned = false;
+
+  sigevent se;
+  memset(&se, 0, sizeof(se));
+  se.sigev_notify = SIGEV_THREAD;
+  se.sigev_notify_function = IntervalTimerCallback;
+  se.sigev_value.sival_ptr = &state;
+  timer_t timer_id;
+  ASSERT_EQ(0, timer_create(CLOCK_MONOTONIC, &se, &timer_id));
+
+  SetTimer(timer_id, 1000000, 1000000);
+  pthread_mutex_lock(&state.lock);
+  while (!state.paused) {
+    pthread_cond_wait(&state.cond, &state.lock);
+  }
+  pthread_mutex_unlock(&state.lock);
+
+  // Disarm it while the tenth callback is running. A timer's callbacks don't overlap,
+  // so once that one has returned there's nothing left in flight, and the timer
+  // mustn't fire again.
+  SetTimer(timer_id, 0, 0);
+  pthread_mutex_lock(&state.lock);
+  state.resumed = true;
+  pthread_cond_broadcast(&state.cond);
+  while (!state.returned) {
+    pthread_cond_wait(&state.cond, &state.lock);
+  }
+  ASSERT_EQ(10, state.count);
+  pthread_mutex_unlock(&state.lock);
+
+  usleep(50000);
+  pthread_mutex_lock(&state.lock);
+  ASSERT_EQ(10, state.count);
+  pthread_mutex_unlock(&state.lock);
+
+  ASSERT_EQ(0, timer_delete(timer_id));
+}
+#endif
+
+TEST(time, timer_settime__rearm) {
+  volatile int counter = 0;
+  timer_t timer_id;
+  ASSERT_EQ(0, CreateSigevThreadTimer(&counter, &timer_id));
+
+  // Re-arming a timer replaces its previous expiration time.
+  SetTimer(timer_id, 10000000, 0);
+  SetTimer(timer_id, 3600LL * 1000000000LL, 0);
+  usleep(50000);
+  ASSERT_EQ(0, counter);
+
+  itimerspec ts;
+  ASSERT_EQ(0, timer_gettime(timer_id, &ts));
+  ASSERT_GT(ts.it_value.tv_sec, 3500);
+
+  ASSERT_EQ(0, timer_delete(timer_id));
+
+  errno = 0;
+  ASSERT_EQ(-1, timer_gettime(timer_id, &ts));
+  ASSERT_EQ(EINVAL, errno);
+}
+
+TEST(time, timer_create__lots_of_SIGEV_THREAD_timers) {
+  // SIGEV_THREAD timers share a few threads, so we can have many more than there
+  // are threads. Half of them never fire, and are deleted while armed.
+  const int timer_count = 1000;
+  volatile int counter = 0;
+  timer_t timer_ids[timer_count];
+  for (int i = 0; i < timer_count; ++i) {
+    ASSERT_EQ(0, CreateSigevThreadTimer(&counter, &timer_ids[i]));
+    if (i % 2 == 0) {
+      SetTimer(timer_ids[i], 1000000 + i * 10000, 0);
+    } else {
+      SetTimer(timer_ids[i], 3600LL * 1000000000LL, 0);
+    }
+  }
+
+  WaitForCount(&counter, timer_count / 2);
+  ASSERT_EQ(timer_count / 2, counter);
+
+  for (int i = 0; i < timer_count; ++i) {
+    ASSERT_EQ(0, timer_delete(timer_ids[i]));
+  }
+}